@@ -1,4 +1,5 @@
 #include <iostream>
+#include <string>
 #include "src/Constraints.h"
 #include "src/Shell.h"
 #include "src/DiskDriver.h"
@@ -8,8 +9,118 @@
 using std::cout;
 using std::endl;
 
-int main() {
-    Shell shell;
+//解析命令行参数得到挂载选项，参数有误时返回false
+static bool parseOptions(int argc, char *argv[], MountOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        if (i + 1 >= argc) {
+            cout << "missing value for '" << opt << "'" << endl;
+            return false;
+        }
+        std::string val = argv[++i];
+        if (opt == "-m") {
+            //磁盘后端：stream / pread / mmap
+            if (val == "stream") {
+                options.diskMode = DiskMode::STREAM;
+            } else if (val == "pread") {
+                options.diskMode = DiskMode::POSITIONAL;
+            } else if (val == "mmap") {
+                options.diskMode = DiskMode::MAPPED;
+            } else {
+                cout << "unknown disk mode '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-s") {
+            //mmap脏页写回策略：op / update / unmount
+            if (val == "op") {
+                options.syncPolicy = SyncPolicy::PER_OP;
+            } else if (val == "update") {
+                options.syncPolicy = SyncPolicy::ON_UPDATE;
+            } else if (val == "unmount") {
+                options.syncPolicy = SyncPolicy::ON_UNMOUNT;
+            } else {
+                cout << "unknown sync policy '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-d") {
+            //块缓存持久化模式：always / periodic / close
+            if (val == "always") {
+                options.writeBack.durability = Durability::ALWAYS;
+            } else if (val == "periodic") {
+                options.writeBack.durability = Durability::PERIODIC;
+            } else if (val == "close") {
+                options.writeBack.durability = Durability::ON_CLOSE;
+            } else {
+                cout << "unknown durability mode '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-a") {
+            //格式化时的空闲空间管理方式：stack / bitmap / groups
+            if (val == "stack") {
+                options.allocator = AllocatorKind::STACK;
+            } else if (val == "bitmap") {
+                options.allocator = AllocatorKind::BITMAP;
+            } else if (val == "groups") {
+                options.allocator = AllocatorKind::GROUPS;
+            } else {
+                cout << "unknown allocator '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-l") {
+            //新建文件的块映射方式：index / extent / blockmap
+            if (val == "index") {
+                options.layout = FileLayout::INDEX;
+            } else if (val == "extent") {
+                options.layout = FileLayout::EXTENT;
+            } else if (val == "blockmap") {
+                options.layout = FileLayout::BLOCKMAP;
+            } else {
+                cout << "unknown file layout '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-w") {
+            //写入时的块分配方式：immediate / delayed
+            if (val == "immediate") {
+                options.delayedAllocation = false;
+            } else if (val == "delayed") {
+                options.delayedAllocation = true;
+            } else {
+                cout << "unknown allocation mode '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-t") {
+            //回收的块是否批量在磁盘文件上打洞：on / off
+            if (val == "on") {
+                options.discard = true;
+            } else if (val == "off") {
+                options.discard = false;
+            } else {
+                cout << "unknown discard mode '" << val << "'" << endl;
+                return false;
+            }
+        } else if (opt == "-c") {
+            //块缓存容量（块数），0表示关闭缓存
+            try {
+                options.cacheBlocks = std::stoul(val);
+            } catch (const std::exception &) {
+                cout << "invalid cache size '" << val << "'" << endl;
+                return false;
+            }
+        } else {
+            cout << "unknown option '" << opt << "'" << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    MountOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        cout << "usage: FileSystem [-m stream|pread|mmap] [-s op|update|unmount] [-c cacheBlocks] [-d always|periodic|close] [-a stack|bitmap|groups] [-l index|extent|blockmap] [-w immediate|delayed] [-t on|off]" << endl;
+        return 1;
+    }
+    Shell shell(options);
     shell.running_shell();
     return 0;
 }
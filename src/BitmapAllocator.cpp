@@ -0,0 +1,220 @@
+
+
+#include "BitmapAllocator.h"
+#include "FileSystem.h"
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+BitmapAllocator::BitmapAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks)
+        : fs(fs), info(info), blockSize(blockSize), totalBlocks(totalBlocks), hint(0) {
+    bitmapBlocks = layout(totalBlocks);
+    wordsPerBlock = blockSize / sizeof(uint64_t);
+    words.assign(static_cast<size_t>(bitmapBlocks) * wordsPerBlock, 0);
+    freeCount.assign(bitmapBlocks, 0);
+    dirty.assign(bitmapBlocks, 0);
+}
+
+uint32_t BitmapAllocator::layout(uint32_t total) {
+    uint32_t bitsPerBlock = blockSize * 8u;
+    return (total + bitsPerBlock - 1) / bitsPerBlock;
+}
+
+void BitmapAllocator::format(uint32_t total, blockno_t firstFree) {
+    std::fill(words.begin(), words.end(), 0);
+    std::fill(freeCount.begin(), freeCount.end(), blockSize * 8u);
+    //引导块、位图、根目录i节点与根目录项已占用，位图末尾超出总块数的位也置1，查找时不会越界
+    setRange(0, firstFree, true);
+    uint64_t bits = words.size() * 64;
+    if (bits > total) {
+        setRange(total, bits - total, true);
+    }
+    //位图按批顺序写入，绕过块缓存
+    const uint32_t batch = 64;
+    for (uint32_t k = 0; k < bitmapBlocks; k += batch) {
+        uint32_t n = std::min(batch, bitmapBlocks - k);
+        fs->writeBlocks(1 + k, n, reinterpret_cast<char *>(&words[static_cast<size_t>(k) * wordsPerBlock]));
+    }
+    std::fill(dirty.begin(), dirty.end(), 0);
+    hint = firstFree;
+}
+
+void BitmapAllocator::load() {
+    const uint32_t batch = 64;
+    for (uint32_t k = 0; k < bitmapBlocks; k += batch) {
+        uint32_t n = std::min(batch, bitmapBlocks - k);
+        fs->readBlocks(1 + k, n, reinterpret_cast<char *>(&words[static_cast<size_t>(k) * wordsPerBlock]));
+    }
+    //用popcount重建每个位图块的空闲位计数
+    for (uint32_t k = 0; k < bitmapBlocks; ++k) {
+        uint32_t used = 0;
+        for (uint32_t w = 0; w < wordsPerBlock; ++w) {
+            used += __builtin_popcountll(words[static_cast<size_t>(k) * wordsPerBlock + w]);
+        }
+        freeCount[k] = blockSize * 8u - used;
+    }
+    std::fill(dirty.begin(), dirty.end(), 0);
+    hint = 0;
+}
+
+blockno_t BitmapAllocator::allocate(blockno_t goal) {
+    //从goal或上次分配的位置继续向后查找，到末尾后回到开头
+    uint64_t start = goal != 0 && goal < totalBlocks ? goal : hint;
+    uint64_t pos = findRun(start, totalBlocks, 1);
+    if (pos == NOT_FOUND) {
+        pos = findRun(0, start, 1);
+    }
+    if (pos == NOT_FOUND) {
+        return 0;
+    }
+    setRange(pos, 1, true);
+    hint = pos + 1;
+    return static_cast<blockno_t>(pos);
+}
+
+bool BitmapAllocator::free(blockno_t bno) {
+    if (bno == 0 || bno >= totalBlocks || !(words[bno / 64] & (1ull << (bno % 64)))) {
+        return false;
+    }
+    setRange(bno, 1, false);
+    return true;
+}
+
+uint32_t BitmapAllocator::allocateN(uint32_t count, blockno_t *out, blockno_t goal) {
+    uint64_t start = goal != 0 && goal < totalBlocks ? goal : hint;
+    uint64_t pos = findRun(start, totalBlocks, count);
+    if (pos == NOT_FOUND) {
+        pos = findRun(0, start, count);
+    }
+    if (pos == NOT_FOUND) {
+        return BlockAllocator::allocateN(count, out, goal);
+    }
+    setRange(pos, count, true);
+    for (uint32_t i = 0; i < count; ++i) {
+        out[i] = static_cast<blockno_t>(pos + i);
+    }
+    hint = pos + count;
+    return count;
+}
+
+uint32_t BitmapAllocator::freeN(const blockno_t *bnos, uint32_t count) {
+    std::vector<blockno_t> sorted(bnos, bnos + count);
+    std::sort(sorted.begin(), sorted.end());
+    uint32_t freed = 0;
+    size_t i = 0;
+    while (i < sorted.size()) {
+        //只回收确实已被占用的块，重复或无效的块号跳过
+        blockno_t bno = sorted[i];
+        if (bno == 0 || bno >= totalBlocks || !(words[bno / 64] & (1ull << (bno % 64)))) {
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < sorted.size() && sorted[j] == sorted[j - 1] + 1 &&
+               (words[sorted[j] / 64] & (1ull << (sorted[j] % 64)))) {
+            j++;
+        }
+        setRange(bno, j - i, false);
+        freed += j - i;
+        i = j;
+    }
+    return freed;
+}
+
+void BitmapAllocator::flush() {
+    for (uint32_t k = 0; k < bitmapBlocks; ++k) {
+        if (dirty[k]) {
+            fs->write(1 + k, 0, reinterpret_cast<char *>(&words[static_cast<size_t>(k) * wordsPerBlock]), blockSize);
+            dirty[k] = 0;
+        }
+    }
+}
+
+void BitmapAllocator::collectFree(std::vector<uint64_t> &bits) {
+    //位图中超出总块数的位为1，取反后不会越界
+    size_t n = std::min(bits.size(), words.size());
+    for (size_t w = 0; w < n; ++w) {
+        bits[w] |= ~words[w];
+    }
+}
+
+AllocatorKind BitmapAllocator::kind() {
+    return AllocatorKind::BITMAP;
+}
+
+uint64_t BitmapAllocator::findRun(uint64_t start, uint64_t end, uint32_t n) {
+    const uint64_t bitsPerBlock = blockSize * 8ull;
+    const uint64_t wordEnd = words.size();
+    uint64_t runStart = start;
+    uint64_t runLen = 0;
+    uint64_t pos = start;
+    //每一步消耗一个字内连续的全0段或全1段，段长由ctz直接得到
+    while (pos < end) {
+        uint64_t wi = pos / 64;
+        uint32_t bit = pos % 64;
+        //位于位图块开头且摘要显示该块已满，整块跳过
+        if (bit == 0 && wi % wordsPerBlock == 0 && freeCount[wi / wordsPerBlock] == 0) {
+            runLen = 0;
+            pos += bitsPerBlock;
+            continue;
+        }
+        uint64_t w = words[wi] >> bit;
+        if (w & 1) {
+            //已占用段：右移后高位补0，取反后高位为1，ctz不会越过本字
+            uint64_t inv = ~w;
+            pos += inv == 0 ? 64 : __builtin_ctzll(inv);
+            runLen = 0;
+            if (pos % 64 == 0) {
+                pos = std::max(pos, skipFull(pos / 64, std::min(wordEnd, (end + 63) / 64)) * 64);
+            }
+            continue;
+        }
+        //空闲段
+        uint32_t len = w == 0 ? 64 - bit : __builtin_ctzll(w);
+        if (runLen == 0) {
+            runStart = pos;
+        }
+        runLen += len;
+        pos += len;
+        if (runLen >= n) {
+            return runStart;
+        }
+    }
+    return NOT_FOUND;
+}
+
+uint64_t BitmapAllocator::skipFull(uint64_t wi, uint64_t end) {
+#ifdef __AVX2__
+    //一次比较4个字是否全为1
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    while (wi + 4 <= end) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&words[wi]));
+        if (!_mm256_testc_si256(v, ones)) {
+            break;
+        }
+        wi += 4;
+    }
+#endif
+    while (wi < end && words[wi] == ~0ull) {
+        wi++;
+    }
+    return wi;
+}
+
+void BitmapAllocator::setRange(uint64_t start, uint32_t n, bool used) {
+    uint64_t pos = start;
+    uint64_t end = start + n;
+    while (pos < end) {
+        uint64_t wi = pos / 64;
+        uint32_t bit = pos % 64;
+        uint32_t len = static_cast<uint32_t>(std::min<uint64_t>(64 - bit, end - pos));
+        uint64_t mask = (len == 64 ? ~0ull : (1ull << len) - 1) << bit;
+        uint64_t before = words[wi];
+        words[wi] = used ? before | mask : before & ~mask;
+        int delta = __builtin_popcountll(words[wi]) - __builtin_popcountll(before);
+        uint64_t blk = wi / wordsPerBlock;
+        freeCount[blk] -= delta;
+        dirty[blk] = 1;
+        pos += len;
+    }
+}
@@ -0,0 +1,46 @@
+
+
+#ifndef FILESYSTEM_BITMAPALLOCATOR_H
+#define FILESYSTEM_BITMAPALLOCATOR_H
+
+#include <vector>
+#include "BlockAllocator.h"
+
+/*
+ * @brief: 位图空闲空间管理器，每位对应一个磁盘块（1为已占用），整个位图常驻内存，
+ *         并为每个位图块维护空闲位计数作为摘要，查找时整块跳过已满的区域
+ */
+class BitmapAllocator : public BlockAllocator {
+public:
+    BitmapAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks);
+    uint32_t layout(uint32_t totalBlocks) override;
+    void format(uint32_t totalBlocks, blockno_t firstFree) override;
+    void load() override;
+    blockno_t allocate(blockno_t goal) override;       //从goal开始查找，未指定时从上次分配的位置之后开始
+    bool free(blockno_t bno) override;
+    void flush() override;
+    void collectFree(std::vector<uint64_t> &bits) override;
+    AllocatorKind kind() override;
+    uint32_t allocateN(uint32_t count, blockno_t *out, blockno_t goal) override;    //优先分配一段连续的块，找不到时逐块分配
+    uint32_t freeN(const blockno_t *bnos, uint32_t count) override; //排序后按连续段回收
+
+private:
+    static const uint64_t NOT_FOUND = ~0ull;
+    FileSystem *fs;                 //读写磁盘块
+    FileSystemInfo &info;           //超级块
+    uint16_t blockSize;             //块大小
+    uint32_t totalBlocks;           //磁盘总块数，也是位图的有效位数
+    uint32_t bitmapBlocks;          //位图占用的块数，位图从1号块开始存放
+    uint32_t wordsPerBlock;         //每个位图块包含的64位字数
+    uint64_t hint;                  //下一次查找的起点（上一次分配位置之后），使连续分配的块尽量相邻
+    std::vector<uint64_t> words;    //位图，末尾超出总块数的位置为1
+    std::vector<uint32_t> freeCount;    //每个位图块中的空闲位数
+    std::vector<uint8_t> dirty;     //位图块是否被修改
+
+    uint64_t findRun(uint64_t start, uint64_t end, uint32_t n);     //在[start,end)中查找至少n个连续空闲位，返回起点或NOT_FOUND
+    uint64_t skipFull(uint64_t wi, uint64_t end);                   //从第wi个字开始跳过全1的字，返回第一个非全1字的下标
+    void setRange(uint64_t start, uint32_t n, bool used);           //将[start,start+n)置为占用或空闲，并更新摘要
+};
+
+
+#endif //FILESYSTEM_BITMAPALLOCATOR_H
@@ -0,0 +1,62 @@
+
+
+#ifndef FILESYSTEM_BLOCKALLOCATOR_H
+#define FILESYSTEM_BLOCKALLOCATOR_H
+
+#include <cstdint>
+#include <vector>
+#include "Constraints.h"
+
+class FileSystem;
+class FileSystemInfo;
+
+/*
+ * @brief: 空闲空间管理方式，格式化时选定并记录在超级块的特性位中
+ */
+enum class AllocatorKind {
+    STACK,          //成组链接的空闲块栈（旧格式）
+    BITMAP,         //位图，可以查找连续的空闲块
+    GROUPS          //磁盘划分为分配组，每组有自己的位图与空闲块计数，不同组可以并发分配
+};
+
+/*
+ * @brief: 空闲空间管理器的公共接口，管理结构从1号块开始连续存放，FileSystem只通过该接口分配与回收磁盘块；
+ *         分配时可以给出期望靠近的块goal（0表示不指定），管理器尽量在其附近分配
+ */
+class BlockAllocator {
+public:
+    virtual ~BlockAllocator() = default;
+    virtual uint32_t layout(uint32_t totalBlocks) = 0;          //管理totalBlocks个块时管理结构本身占用的块数
+    virtual void format(uint32_t totalBlocks, blockno_t firstFree) = 0;     //在磁盘上建立管理结构，[firstFree,totalBlocks)为空闲块
+    virtual void load() = 0;                //挂载时从磁盘读入管理结构
+    virtual blockno_t allocate(blockno_t goal) = 0;     //分配一个空闲块，没有空闲块时返回0
+    virtual bool free(blockno_t bno) = 0;   //回收一个块，块号无效或本就空闲时返回false
+    virtual void flush() = 0;               //将修改过的管理结构写回磁盘，随超级块一起提交
+    virtual void collectFree(std::vector<uint64_t> &bits) = 0;     //把所有空闲块在bits中对应的位置1，bits由调用者按总块数分配，每位对应一个块
+    //批量分配至多count个块写入out，返回实际分配的块数（空闲块不足时少于count）
+    virtual uint32_t allocateN(uint32_t count, blockno_t *out, blockno_t goal) {
+        uint32_t n = 0;
+        while (n < count && (out[n] = allocate(n == 0 ? goal : out[n - 1] + 1)) != 0) {
+            n++;
+        }
+        return n;
+    }
+    //批量回收count个块，返回实际回收的块数
+    virtual uint32_t freeN(const blockno_t *bnos, uint32_t count) {
+        uint32_t n = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            n += free(bnos[i]) ? 1 : 0;
+        }
+        return n;
+    }
+    virtual AllocatorKind kind() = 0;       //管理方式
+    virtual bool compact() {                //整理空闲空间的管理结构，使之后的分配尽量得到连续的块，返回是否做了整理；位图本身按块号有序，不需要整理
+        return false;
+    }
+    virtual blockno_t spreadGoal() {        //新目录的期望位置，使目录分散到各处、目录中的文件靠近目录；不分组时不指定
+        return 0;
+    }
+};
+
+
+#endif //FILESYSTEM_BLOCKALLOCATOR_H
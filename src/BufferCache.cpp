@@ -0,0 +1,431 @@
+
+
+#include "BufferCache.h"
+#include <cstring>
+#include <algorithm>
+
+BufferCache::BufferCache(DiskDriver *disk, uint16_t blockSize, uint32_t capacity, const WriteBackPolicy &policy)
+        : disk(disk), blockSize(blockSize), capacity(capacity), policy(policy), stopping(false) {
+    reset(blockSize);
+    if (policy.durability != Durability::ALWAYS) {
+        flusher = std::thread(&BufferCache::flusherMain, this);
+    }
+    prefetcher = std::thread(&BufferCache::prefetcherMain, this);
+}
+
+BufferCache::~BufferCache() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    prefetchWakeup.notify_all();
+    if (flusher.joinable()) {
+        flusher.join();
+    }
+    if (prefetcher.joinable()) {
+        prefetcher.join();
+    }
+    flush();
+}
+
+void BufferCache::reset(uint16_t bsize) {
+    std::lock_guard<std::mutex> guard(lock);
+    blockSize = bsize;
+    hand = 0;
+    dirtyCount = 0;
+    table.clear();
+    prefetchQueue.clear();
+    inflight.clear();
+    pool.assign(static_cast<size_t>(capacity) * blockSize, 0);
+    buffers.assign(capacity, Buffer{});
+    for (uint32_t i = 0; i < capacity; ++i) {
+        buffers[i].data = pool.data() + static_cast<size_t>(i) * blockSize;
+    }
+    stat = CacheStat{};
+}
+
+void BufferCache::read(blockno_t bno, uint16_t offset, char *buf, uint16_t sz) {
+    std::lock_guard<std::mutex> guard(lock);
+    Buffer *b = find(bno);
+    if (b != nullptr) {
+        stat.hits++;
+        if (b->prefetched) {
+            b->prefetched = false;
+            stat.prefetchHits++;
+        }
+    } else {
+        stat.misses++;
+        b = allocate(bno, true);
+    }
+    if (b == nullptr) {
+        //所有缓冲区都被钉住，直接读磁盘
+        disk->readAt(blockOffset(bno) + offset, buf, sz);
+        return;
+    }
+    b->referenced = true;
+    std::memcpy(buf, b->data + offset, sz);
+}
+
+void BufferCache::write(blockno_t bno, uint16_t offset, const char *buf, uint16_t sz) {
+    std::lock_guard<std::mutex> guard(lock);
+    bool writeThrough = policy.durability == Durability::ALWAYS;
+    inflight.erase(bno);
+    Buffer *b = find(bno);
+    if (b == nullptr) {
+        //整块覆盖写不需要先读入旧数据；回写模式下部分写需要先读入整块，直写模式下部分写且未缓存时只写磁盘
+        bool fullBlock = offset == 0 && sz == blockSize;
+        if (fullBlock || !writeThrough) {
+            b = allocate(bno, !fullBlock);
+        }
+    }
+    if (b != nullptr) {
+        b->referenced = true;
+        std::memcpy(b->data + offset, buf, sz);
+    }
+    if (b == nullptr || writeThrough) {
+        disk->writeAt(blockOffset(bno) + offset, buf, sz);
+    } else {
+        markDirty(*b, offset, sz);
+    }
+}
+
+void BufferCache::readRun(blockno_t bno, uint32_t n, char *buf) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t i = 0;
+    while (i < n) {
+        Buffer *b = find(bno + i);
+        if (b != nullptr) {
+            stat.hits++;
+            if (b->prefetched) {
+                b->prefetched = false;
+                stat.prefetchHits++;
+            }
+            b->referenced = true;
+            std::memcpy(buf + static_cast<size_t>(i) * blockSize, b->data, blockSize);
+            i++;
+            continue;
+        }
+        //缓存中没有的块都与磁盘一致，连续的一段直接读入调用者的缓冲区，大块顺序读不会把工作集挤出缓存
+        uint32_t j = i + 1;
+        while (j < n && find(bno + j) == nullptr) {
+            j++;
+        }
+        stat.misses += j - i;
+        disk->readAt(blockOffset(bno + i), buf + static_cast<size_t>(i) * blockSize, (j - i) * blockSize);
+        i = j;
+    }
+}
+
+void BufferCache::writeRun(blockno_t bno, uint32_t n, const char *buf) {
+    std::lock_guard<std::mutex> guard(lock);
+    bool writeThrough = policy.durability == Durability::ALWAYS;
+    for (uint32_t i = 0; i < n; ++i) {
+        inflight.erase(bno + i);
+        Buffer *b = find(bno + i);
+        //整块覆盖写，回写模式下直接占用缓冲区而不读入旧数据
+        if (b == nullptr && !writeThrough) {
+            b = allocate(bno + i, false);
+        }
+        const char *src = buf + static_cast<size_t>(i) * blockSize;
+        if (b != nullptr) {
+            b->referenced = true;
+            std::memcpy(b->data, src, blockSize);
+            if (!writeThrough) {
+                markDirty(*b, 0, blockSize);
+            }
+        } else if (!writeThrough) {
+            disk->writeAt(blockOffset(bno + i), src, blockSize);
+        }
+    }
+    if (writeThrough) {
+        disk->writeAt(blockOffset(bno), buf, n * blockSize);
+    }
+}
+
+void BufferCache::flush() {
+    std::lock_guard<std::mutex> guard(lock);
+    writeBack(false);
+}
+
+void BufferCache::prefetch(const std::vector<blockno_t> &bnos) {
+    std::lock_guard<std::mutex> guard(lock);
+    //预读队列最多占用一半缓存，避免预读把工作集挤出缓存
+    for (blockno_t bno : bnos) {
+        if (prefetchQueue.size() >= capacity / 2) {
+            break;
+        }
+        if (bno != 0 && find(bno) == nullptr && inflight.count(bno) == 0) {
+            prefetchQueue.push_back(bno);
+        }
+    }
+    prefetchWakeup.notify_one();
+}
+
+void BufferCache::discard(blockno_t bno, uint32_t n) {
+    std::lock_guard<std::mutex> guard(lock);
+    auto drop = [this](Buffer &b) {
+        if (b.pinCount > 0) {
+            return;
+        }
+        if (b.dirty) {
+            b.dirty = false;
+            dirtyCount--;
+        }
+        b.valid = false;
+        table.erase(b.bno);
+    };
+    //范围比缓存大时遍历缓冲区，否则逐块查找
+    if (n > capacity) {
+        for (Buffer &b : buffers) {
+            if (b.valid && b.bno >= bno && b.bno - bno < n) {
+                drop(b);
+            }
+        }
+    } else {
+        for (uint32_t i = 0; i < n; ++i) {
+            Buffer *b = find(bno + i);
+            if (b != nullptr) {
+                drop(*b);
+            }
+        }
+    }
+    //正在预读的块读入后作废
+    for (auto it = inflight.begin(); it != inflight.end();) {
+        it = (*it >= bno && *it - bno < n) ? inflight.erase(it) : std::next(it);
+    }
+}
+
+void BufferCache::pin(blockno_t bno) {
+    std::lock_guard<std::mutex> guard(lock);
+    Buffer *b = find(bno);
+    if (b == nullptr) {
+        b = allocate(bno, true);
+    }
+    if (b != nullptr) {
+        b->pinCount++;
+    }
+}
+
+void BufferCache::unpin(blockno_t bno) {
+    std::lock_guard<std::mutex> guard(lock);
+    Buffer *b = find(bno);
+    if (b != nullptr && b->pinCount > 0) {
+        b->pinCount--;
+    }
+}
+
+Buffer *BufferCache::find(blockno_t bno) {
+    auto it = table.find(bno);
+    if (it == table.end()) {
+        return nullptr;
+    }
+    return &buffers[it->second];
+}
+
+Buffer *BufferCache::allocate(blockno_t bno, bool load) {
+    //CLOCK算法：跳过被钉住的缓冲区，引用位为1的清零后给第二次机会，最多转两圈
+    for (uint32_t n = 0; n < 2 * capacity; ++n) {
+        uint32_t idx = hand;
+        Buffer &b = buffers[idx];
+        hand = (hand + 1) % capacity;
+        if (b.pinCount > 0) {
+            continue;
+        }
+        if (b.valid && b.referenced) {
+            b.referenced = false;
+            continue;
+        }
+        if (b.valid) {
+            //换出脏块前先同步写回
+            if (b.dirty) {
+                writeDirty(b);
+            }
+            table.erase(b.bno);
+            stat.evictions++;
+        }
+        b.bno = bno;
+        b.valid = true;
+        b.referenced = true;
+        b.dirty = false;
+        b.prefetched = false;
+        b.pinCount = 0;
+        table[bno] = idx;
+        if (load) {
+            disk->readAt(blockOffset(bno), b.data, blockSize);
+        }
+        return &b;
+    }
+    return nullptr;
+}
+
+void BufferCache::markDirty(Buffer &b, uint16_t offset, uint32_t sz) {
+    if (b.dirty) {
+        b.dirtyBegin = std::min<uint16_t>(b.dirtyBegin, offset);
+        b.dirtyEnd = std::max<uint32_t>(b.dirtyEnd, offset + sz);
+        return;
+    }
+    b.dirty = true;
+    b.dirtyBegin = offset;
+    b.dirtyEnd = offset + sz;
+    b.dirtyTime = std::chrono::steady_clock::now();
+    dirtyCount++;
+    if (static_cast<uint64_t>(dirtyCount) * 100 >= static_cast<uint64_t>(policy.dirtyRatio) * capacity) {
+        wakeup.notify_one();
+    }
+}
+
+void BufferCache::writeDirty(Buffer &b) {
+    uint32_t begin = b.dirtyBegin / SECTOR_SIZE * SECTOR_SIZE;
+    uint32_t end = std::min<uint32_t>((b.dirtyEnd + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE, blockSize);
+    disk->writeAt(blockOffset(b.bno) + begin, b.data + begin, end - begin);
+    b.dirty = false;
+    dirtyCount--;
+    stat.writebacks++;
+    stat.flushIOs++;
+}
+
+void BufferCache::writeBack(bool onlyExpired) {
+    if (dirtyCount == 0) {
+        return;
+    }
+    //按块号排序所有脏块，块号连续的脏块组成一段，一段只发出一次磁盘写
+    std::vector<uint32_t> dirty;
+    for (uint32_t i = 0; i < capacity; ++i) {
+        if (buffers[i].valid && buffers[i].dirty) {
+            dirty.push_back(i);
+        }
+    }
+    std::sort(dirty.begin(), dirty.end(), [this](uint32_t a, uint32_t b) {
+        return buffers[a].bno < buffers[b].bno;
+    });
+    auto deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(policy.dirtyAgeMs);
+    std::vector<char> staging;
+    size_t i = 0;
+    while (i < dirty.size()) {
+        size_t j = i + 1;
+        while (j < dirty.size() && buffers[dirty[j]].bno == buffers[dirty[j - 1]].bno + 1) {
+            j++;
+        }
+        //只写回超时脏块时，一段中只要有一块超时就整段写回
+        bool expired = !onlyExpired;
+        for (size_t k = i; k < j && !expired; ++k) {
+            expired = buffers[dirty[k]].dirtyTime <= deadline;
+        }
+        if (expired && j - i == 1) {
+            writeDirty(buffers[dirty[i]]);
+        } else if (expired) {
+            //中间的块整块写回，第一块从脏数据所在的扇区开始，最后一块写到脏数据所在的扇区为止
+            size_t begin = buffers[dirty[i]].dirtyBegin / SECTOR_SIZE * SECTOR_SIZE;
+            size_t end = (j - i - 1) * blockSize +
+                         std::min<size_t>((buffers[dirty[j - 1]].dirtyEnd + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE, blockSize);
+            staging.resize((j - i) * blockSize);
+            for (size_t k = i; k < j; ++k) {
+                Buffer &b = buffers[dirty[k]];
+                std::memcpy(staging.data() + (k - i) * blockSize, b.data, blockSize);
+                b.dirty = false;
+                dirtyCount--;
+            }
+            disk->writeAt(blockOffset(buffers[dirty[i]].bno) + begin, staging.data() + begin, end - begin);
+            stat.writebacks += j - i;
+            stat.flushIOs++;
+        }
+        i = j;
+    }
+}
+
+void BufferCache::flusherMain() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        wakeup.wait_for(guard, std::chrono::milliseconds(policy.flushIntervalMs));
+        if (stopping) {
+            break;
+        }
+        bool tooDirty = static_cast<uint64_t>(dirtyCount) * 100 >= static_cast<uint64_t>(policy.dirtyRatio) * capacity;
+        if (tooDirty) {
+            writeBack(false);
+        } else if (policy.durability == Durability::PERIODIC) {
+            writeBack(true);
+        }
+    }
+}
+
+void BufferCache::prefetcherMain() {
+    std::unique_lock<std::mutex> guard(lock);
+    std::vector<blockno_t> run;
+    std::vector<char> staging;
+    while (true) {
+        prefetchWakeup.wait(guard, [this] { return stopping || !prefetchQueue.empty(); });
+        if (stopping) {
+            break;
+        }
+        //从队首取出一段连续且未缓存的块号
+        run.clear();
+        while (!prefetchQueue.empty() && run.size() < 64) {
+            blockno_t bno = prefetchQueue.front();
+            if (find(bno) != nullptr || inflight.count(bno) != 0) {
+                prefetchQueue.pop_front();
+                continue;
+            }
+            if (!run.empty() && bno != run.back() + 1) {
+                break;
+            }
+            run.push_back(bno);
+            inflight.insert(bno);
+            prefetchQueue.pop_front();
+        }
+        if (run.empty()) {
+            continue;
+        }
+        uint16_t bsize = blockSize;
+        staging.resize(run.size() * bsize);
+        guard.unlock();
+        disk->readAt(static_cast<uint64_t>(run.front()) * bsize, staging.data(), staging.size());
+        guard.lock();
+        //读盘期间块被写入、已被前台读入或缓存被重置的，丢弃读到的数据
+        for (size_t i = 0; i < run.size(); ++i) {
+            if (inflight.erase(run[i]) == 0 || bsize != blockSize || find(run[i]) != nullptr) {
+                continue;
+            }
+            Buffer *b = allocate(run[i], false);
+            if (b == nullptr) {
+                break;
+            }
+            std::memcpy(b->data, staging.data() + i * bsize, bsize);
+            //引用位清零，未被读取的预读块优先换出
+            b->referenced = false;
+            b->prefetched = true;
+            stat.prefetches++;
+        }
+        for (blockno_t bno : run) {
+            inflight.erase(bno);
+        }
+    }
+}
+
+uint64_t BufferCache::blockOffset(blockno_t bno) {
+    return static_cast<uint64_t>(bno) * blockSize;
+}
+
+uint32_t BufferCache::getCapacity() {
+    return capacity;
+}
+
+uint32_t BufferCache::getDirtyCount() {
+    std::lock_guard<std::mutex> guard(lock);
+    return dirtyCount;
+}
+
+Durability BufferCache::getDurability() {
+    return policy.durability;
+}
+
+CacheStat BufferCache::getStat() {
+    std::lock_guard<std::mutex> guard(lock);
+    return stat;
+}
+
+void BufferCache::resetStat() {
+    std::lock_guard<std::mutex> guard(lock);
+    stat = CacheStat{};
+}
@@ -0,0 +1,123 @@
+
+
+#ifndef FILESYSTEM_BUFFERCACHE_H
+#define FILESYSTEM_BUFFERCACHE_H
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include "DiskDriver.h"
+#include "Constraints.h"
+
+/*
+ * @brief: 持久化模式，决定写入的数据何时落盘
+ */
+enum class Durability {
+    ALWAYS,         //直写，每次写入立即写到磁盘
+    PERIODIC,       //回写，后台线程定期写回超过存活时间的脏块
+    ON_CLOSE        //回写，只在关闭文件、sync命令、卸载或脏块过多时写回
+};
+
+/*
+ * @brief: 回写策略参数
+ */
+struct WriteBackPolicy {
+    Durability durability = Durability::PERIODIC;  //持久化模式
+    uint32_t flushIntervalMs = 1000;                //后台写回线程的检查间隔
+    uint32_t dirtyAgeMs = 5000;                     //脏块存活超过该时间后被写回（PERIODIC）
+    uint32_t dirtyRatio = 50;                       //脏块占缓存的百分比超过该值时立即唤醒写回线程
+};
+
+/*
+ * @brief: 缓冲区，缓存一个磁盘块
+ */
+struct Buffer {
+    blockno_t bno;          //缓存的磁盘块号
+    bool valid;             //是否缓存了有效数据
+    bool referenced;        //CLOCK算法的引用位
+    bool dirty;             //是否被修改而尚未写回磁盘
+    bool prefetched;        //由预读载入且尚未被读取过
+    uint32_t pinCount;      //钉住计数，大于0时不会被换出
+    std::chrono::steady_clock::time_point dirtyTime;   //第一次变脏的时间
+    uint16_t dirtyBegin;    //块内被修改的字节范围[dirtyBegin,dirtyEnd)，回写时按扇区对齐只写这一段
+    uint16_t dirtyEnd;
+    char *data;             //块数据，指向缓冲池中的一个块
+};
+
+/*
+ * @brief: 缓存统计信息
+ */
+struct CacheStat {
+    uint64_t hits;          //命中次数
+    uint64_t misses;        //未命中次数
+    uint64_t evictions;     //换出次数
+    uint64_t writebacks;    //写回的脏块数
+    uint64_t flushIOs;      //写回时实际发出的磁盘写次数（相邻脏块合并为一次）
+    uint64_t prefetches;    //预读载入的块数
+    uint64_t prefetchHits;  //预读载入后被读取命中的块数
+};
+
+/*
+ * @brief: 块缓冲区缓存，位于文件系统与虚拟磁盘之间，以块为单位缓存磁盘数据，使用CLOCK算法换出；
+ *         ALWAYS模式直写磁盘，其余模式回写，由后台线程按时间或脏块比例合并写回
+ */
+class BufferCache {
+public:
+    BufferCache(DiskDriver *disk, uint16_t blockSize, uint32_t capacity, const WriteBackPolicy &policy);  //capacity为缓存的块数
+    ~BufferCache();                 //停止后台线程并写回所有脏块
+    void read(blockno_t bno, uint16_t offset, char *buf, uint16_t sz);        //从缓存读取，未命中时先整块读入
+    void write(blockno_t bno, uint16_t offset, const char *buf, uint16_t sz); //写入缓存中的块，直写或标记为脏块
+    void readRun(blockno_t bno, uint32_t n, char *buf);         //读取从bno开始的n个整块，已缓存的块从缓存复制，连续未命中的块合并为一次磁盘读且不占用缓存
+    void writeRun(blockno_t bno, uint32_t n, const char *buf);  //覆盖写入从bno开始的n个整块，直写模式下整段只发出一次磁盘写
+    void flush();                   //立即写回所有脏块
+    void prefetch(const std::vector<blockno_t> &bnos);  //将未缓存的块加入预读队列，由后台线程异步读入，不阻塞调用者
+    void pin(blockno_t bno);        //钉住bno所在缓冲区（必要时读入），使其常驻缓存
+    void unpin(blockno_t bno);      //解除一次钉住
+    void discard(blockno_t bno, uint32_t n);    //丢弃[bno,bno+n)的缓冲区（包括脏块，不写回）与进行中的预读，用于已回收并即将打洞的块；被钉住的块保留
+    void reset(uint16_t bsize);     //丢弃所有缓存（包括脏块）并按新的块大小重建（格式化后使用）
+    uint32_t getCapacity();         //缓存容量（块数）
+    uint32_t getDirtyCount();       //当前脏块数
+    Durability getDurability();     //持久化模式
+    CacheStat getStat();            //缓存统计信息
+    void resetStat();               //清空缓存统计
+
+private:
+    DiskDriver *disk;               //虚拟磁盘对象
+    uint16_t blockSize;             //块大小
+    uint32_t capacity;              //缓存块数
+    uint32_t hand;                  //CLOCK指针
+    uint32_t dirtyCount;            //脏块数
+    WriteBackPolicy policy;         //回写策略
+    std::vector<char> pool;         //缓冲池，capacity个块连续存放
+    std::vector<Buffer> buffers;    //缓冲区描述符
+    std::unordered_map<blockno_t, uint32_t> table;  //块号到缓冲区下标的映射
+    CacheStat stat;                 //统计信息
+
+    std::mutex lock;                //保护以上所有状态，写回线程与调用者共用
+    std::condition_variable wakeup; //唤醒写回线程
+    std::thread flusher;            //后台写回线程
+    bool stopping;                  //后台线程退出标记
+
+    std::deque<blockno_t> prefetchQueue;        //等待预读的块号
+    std::unordered_set<blockno_t> inflight;     //正在读入的预读块，期间被写入的块会从中移除，读入的旧数据随之作废
+    std::condition_variable prefetchWakeup;     //唤醒预读线程
+    std::thread prefetcher;                     //后台预读线程
+
+    Buffer *find(blockno_t bno);                //查找已缓存的块，未缓存返回nullptr
+    Buffer *allocate(blockno_t bno, bool load); //为bno分配缓冲区，load为真时从磁盘读入，全部被钉住时返回nullptr
+    void markDirty(Buffer &b, uint16_t offset, uint32_t sz);   //将缓冲区标记为脏块并扩大脏数据范围，脏块过多时唤醒写回线程
+    void writeDirty(Buffer &b);                 //同步写回一个脏块中按扇区对齐的脏数据范围
+    void writeBack(bool onlyExpired);           //写回脏块，相邻块合并为一次写，首尾两块只写到脏数据所在的扇区；onlyExpired为真时只写回超过存活时间的脏块
+    void flusherMain();                         //后台写回线程主循环
+    void prefetcherMain();                      //后台预读线程主循环，连续块号合并为一次读，读磁盘时不持有锁
+    uint64_t blockOffset(blockno_t bno);        //磁盘块bno起始处的字节偏移
+};
+
+
+#endif //FILESYSTEM_BUFFERCACHE_H
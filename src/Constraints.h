@@ -3,15 +3,22 @@
 #ifndef FILESYSTEM_CONSTRAINTS_H
 #define FILESYSTEM_CONSTRAINTS_H
 
-//目录项的大小，128 bit = 16 Byte
+#include <cstdint>
+
+//磁盘块号类型，块大小为4096 Byte时32位块号可寻址16TB
+typedef uint32_t blockno_t;
+//i节点号类型，i节点表中的第几条记录（从1开始），0表示无
+typedef uint32_t inodeno_t;
+
+//旧格式定长目录项的大小，128 bit = 16 Byte
 #define DIRECTORY_ITEM_SIZE 128
 //块大小，4096 Byte
 #define BLOCK_SIZE 32768
 //块大小，4096 Byte
 #define BLOCK_SIZE_BYTE (BLOCK_SIZE/8)
-//文件名最大长度
+//旧格式定长目录项的文件名最大长度
 #define FILE_NAME_LENGTH ((DIRECTORY_ITEM_SIZE - 32) / (8 * sizeof(char)))
-//目录项总项数
+//旧格式定长目录块的目录项总项数
 #define DIRECTORY_NUMS (BLOCK_SIZE/DIRECTORY_ITEM_SIZE)
 //文件索引表总项数
 #define FILE_INDEX_SIZE (BLOCK_SIZE/32-1)
@@ -19,6 +26,65 @@
 #define USERNAME_PASWORD_LENGTH 32
 //同时最多打开文件数
 #define FILE_OPEN_MAX_NUM 8
+//磁盘扇区大小，块缓存回写脏块时只写回按扇区对齐的脏数据范围
+#define SECTOR_SIZE 512
+//顺序读预读窗口的初始块数与最大块数
+#define READAHEAD_MIN_BLOCKS 4
+#define READAHEAD_MAX_BLOCKS 64
+//目录项缓存最多缓存的名字数
+#define DENTRY_CACHE_ENTRIES 8192
+//后台回收线程每批回收的块数，一批之后放开文件系统锁让前台命令执行；单个文件总是一次回收完
+#define RECLAIM_BATCH_BLOCKS 4096
+//沿..向上查找时最多经过的目录层数
+#define DIRECTORY_DEPTH_MAX 4096
+//分配组管理时每个分配组的块数（32MB），每组位图占1KB
+#define ALLOC_GROUP_BLOCKS 8192
+//延迟分配时每个打开的文件最多积攒的未分配数据块数，超过时立即分配并写出
+#define DELAYED_ALLOC_MAX_BLOCKS 1024
+//碎片整理每次搬移的块数（1MB），限速时在两次搬移之间休眠
+#define DEFRAG_CHUNK_BLOCKS 256
+//回收的块积攒到该块数（4MB）后一次在磁盘文件上打洞
+#define DISCARD_BATCH_BLOCKS 1024
+//64位磁盘格式中，旧的32位容量字段固定写入该标记，真实容量在其后的64位字段中
+#define DISK_CAPACITY_EXTENDED 0xFFFFFFFFu
+//磁盘头部布局：扩展标记(4)+未格式化标记(1)+块大小(2)+64位容量(8)，其后紧跟超级块
+#define DISK_HEADER_SIZE 15
+//超级块特性位：空闲空间使用位图管理，未设置时为空闲块栈
+#define FEATURE_BITMAP_ALLOCATOR 0x1u
+//超级块特性位：i节点为INODE_SIZE字节并带有块映射方式与映射根，未设置时为16字节的旧i节点
+#define FEATURE_INODE_LAYOUT 0x2u
+//超级块特性位：i节点集中存放在i节点表中，目录项记录i节点号；未设置时每个i节点独占一块，目录项记录其块号
+#define FEATURE_INODE_TABLE 0x4u
+//超级块特性位：目录由变长目录项记录组成，未设置时为16字节的定长目录项
+#define FEATURE_DIRENT 0x8u
+//超级块特性位：变长目录项记录了权限摘要，未设置时目录项只记录文件类型
+#define FEATURE_DIRENT_MODE 0x10u
+//超级块特性位：超级块记录了孤儿目录，删除的文件与目录挂在其下由后台线程回收；未设置时挂载时建立
+#define FEATURE_ORPHANS 0x20u
+//超级块特性位：空闲空间按分配组管理，1号块起为各组的描述符表与位图；与FEATURE_BITMAP_ALLOCATOR不同时设置
+#define FEATURE_ALLOC_GROUPS 0x40u
+//变长目录项：记录头8 Byte（i节点号、记录长度、名字长度、文件类型与权限摘要），名字最长255 Byte，记录长度按4 Byte对齐
+#define DIRENT_HEADER_SIZE 8
+#define DIRENT_NAME_MAX 255
+//i节点记录大小，128 Byte，其中末尾INODE_DATA_SIZE字节存放块映射的根
+#define INODE_SIZE 128
+#define INODE_DATA_SIZE (INODE_SIZE - 16)
+//内联小文件的最大字节数，不超过该大小的文件内容直接存放在i节点的data中
+#define INLINE_DATA_SIZE INODE_DATA_SIZE
+//i节点表每块容纳的i节点数；格式化时每INODE_RATIO_BLOCKS个块建立一个i节点，用完后每次扩展INODE_TABLE_GROW_BLOCKS块
+#define INODES_PER_BLOCK (BLOCK_SIZE_BYTE / INODE_SIZE)
+#define INODE_RATIO_BLOCKS 16
+#define INODE_TABLE_GROW_BLOCKS 32
+//区段树节点头部8 Byte，每项12 Byte；i节点内的树根与一个磁盘块各能容纳的项数
+#define EXTENT_PER_INODE ((INODE_DATA_SIZE - 8) / 12)
+#define EXTENT_PER_BLOCK ((BLOCK_SIZE_BYTE - 8) / 12)
+//多级块映射：i节点内除已映射块数(4 Byte)和三个间接块指针(12 Byte)外全部为直接块指针；每个间接块容纳的块号数
+#define BLOCKMAP_DIRECT ((INODE_DATA_SIZE - 16) / 4)
+#define BLOCKMAP_PER_BLOCK (BLOCK_SIZE_BYTE / 4)
+//目录散列索引每块容纳的槽数（每槽8 Byte）；目录超过一块时建立索引，装填超过3/4时槽数翻倍
+#define DIRECTORY_HASH_PER_BLOCK (BLOCK_SIZE_BYTE / 8)
+//旧的32位磁盘格式头部：容量(4)+未格式化标记(1)+块大小(2)
+#define LEGACY_DISK_HEADER_SIZE 7
 
 
 #endif //FILESYSTEM_CONSTRAINTS_H
@@ -0,0 +1,74 @@
+
+
+#include "DentryCache.h"
+
+DentryCache::DentryCache(uint32_t capacity) : capacity(capacity), stat{} {
+}
+
+bool DentryCache::lookup(inodeno_t dir, const std::string &name, Dentry &dentry) {
+    auto it = table.find(Key(dir, name));
+    if (it == table.end()) {
+        stat.misses++;
+        return false;
+    }
+    lru.splice(lru.begin(), lru, it->second.age);
+    dentry = it->second.dentry;
+    stat.hits++;
+    if (dentry.ino == 0) {
+        stat.negativeHits++;
+    }
+    return true;
+}
+
+void DentryCache::insert(inodeno_t dir, const std::string &name, const Dentry &dentry) {
+    if (capacity == 0) {
+        return;
+    }
+    Key key(dir, name);
+    auto it = table.find(key);
+    if (it != table.end()) {
+        it->second.dentry = dentry;
+        lru.splice(lru.begin(), lru, it->second.age);
+        return;
+    }
+    if (table.size() >= capacity) {
+        table.erase(lru.back());
+        lru.pop_back();
+    }
+    lru.push_front(key);
+    table.emplace(key, Node{dentry, lru.begin()});
+}
+
+void DentryCache::erase(inodeno_t dir, const std::string &name) {
+    auto it = table.find(Key(dir, name));
+    if (it != table.end()) {
+        lru.erase(it->second.age);
+        table.erase(it);
+    }
+}
+
+void DentryCache::eraseDirectory(inodeno_t dir) {
+    //空名字排在该目录所有名字之前
+    auto it = table.lower_bound(Key(dir, std::string()));
+    while (it != table.end() && it->first.first == dir) {
+        lru.erase(it->second.age);
+        it = table.erase(it);
+    }
+}
+
+void DentryCache::clear() {
+    table.clear();
+    lru.clear();
+}
+
+uint32_t DentryCache::size() {
+    return table.size();
+}
+
+DentryStat DentryCache::getStat() {
+    return stat;
+}
+
+void DentryCache::resetStat() {
+    stat = DentryStat{};
+}
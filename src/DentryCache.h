@@ -0,0 +1,61 @@
+
+
+#ifndef FILESYSTEM_DENTRYCACHE_H
+#define FILESYSTEM_DENTRYCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <list>
+#include <utility>
+#include "Constraints.h"
+#include "./entity/Dirent.h"
+
+/*
+ * @brief: 缓存的一次名字查找结果，ino为0表示该名字不存在（否定项）
+ */
+struct Dentry {
+    inodeno_t ino;      //名字指向的i节点号，0表示不存在
+    FileType type;      //文件类型
+    uint8_t mode;       //权限摘要
+};
+
+/*
+ * @brief: 目录项缓存统计信息
+ */
+struct DentryStat {
+    uint64_t hits;          //命中次数，包括否定项
+    uint64_t negativeHits;  //命中否定项的次数
+    uint64_t misses;        //未命中次数
+};
+
+/*
+ * @brief: 目录项缓存，只在内存中，把(目录i节点号,名字)映射到名字指向的i节点与类型，也记录查找失败的名字；
+ *         按LRU换出，目录项被删除、改名或改指向时由目录文件逐项作废，目录被删除时作废其下全部名字，格式化与挂载时清空
+ */
+class DentryCache {
+public:
+    explicit DentryCache(uint32_t capacity);    //capacity为最多缓存的名字数
+    bool lookup(inodeno_t dir, const std::string &name, Dentry &dentry);       //查找缓存，命中时移到LRU表头
+    void insert(inodeno_t dir, const std::string &name, const Dentry &dentry); //加入或覆盖一项，超出容量时换出最久未用的项
+    void erase(inodeno_t dir, const std::string &name);    //作废一项
+    void eraseDirectory(inodeno_t dir);         //作废dir目录下的全部名字
+    void clear();                               //清空缓存
+    uint32_t size();                            //当前缓存的名字数
+    DentryStat getStat();                       //统计信息
+    void resetStat();                           //清空统计
+
+private:
+    typedef std::pair<inodeno_t, std::string> Key;
+    struct Node {
+        Dentry dentry;
+        std::list<Key>::iterator age;           //在LRU表中的位置
+    };
+    uint32_t capacity;
+    std::map<Key, Node> table;                  //按目录i节点号有序，作废整个目录时按范围删除
+    std::list<Key> lru;                         //表头为最近使用的项
+    DentryStat stat;
+};
+
+
+#endif //FILESYSTEM_DENTRYCACHE_H
@@ -0,0 +1,702 @@
+
+
+#include "DirectoryFile.h"
+#include "FileSystem.h"
+
+std::unordered_map<inodeno_t, uint32_t> DirectoryFile::freeHint;
+
+DirectoryFile::DirectoryFile(FileSystem *fs, inodeno_t ino)
+        : fs(fs), ino(ino), iNode{}, blocks(0), index{}, slots(0), runLogical(0), runPhysical(0), runLength(0) {
+    if (!fs->readINode(ino, iNode) || !isDirectory()) {
+        return;
+    }
+    if (isLegacy()) {
+        blocks = 1;
+        return;
+    }
+    blocks = FileMap(fs, iNode).mappedBlocks();
+    if (iNode.bno != 0 && fs->readINode(iNode.bno, index)) {
+        slots = index.capacity / sizeof(DirectoryHashSlot);
+    }
+}
+
+bool DirectoryFile::create(FileSystem *fs, inodeno_t ino, inodeno_t parent, uint8_t uid, uint8_t flag) {
+    //新目录分散到空闲较多的位置，之后目录中的文件在目录附近分配
+    blockno_t bno = fs->blockAllocate(fs->directoryGoal());
+    if (bno == 0) {
+        return false;
+    }
+    //目录的第一项为本目录，第二项为上级目录，上级目录的记录占满块的其余部分
+    //两项的权限摘要分别取本目录与上级目录的i节点，根目录的上级是它自己
+    INode upNode{};
+    upNode.flag = flag;
+    if (parent != ino) {
+        fs->readINode(parent, upNode);
+    }
+    DirentBlock block{};
+    DirentHeader self{ino, recordSize(1), 1, typeMode(FileType::DIRECTORY, flag)};
+    DirentHeader up{parent, static_cast<uint16_t>(BLOCK_SIZE_BYTE - self.recordLength), 2,
+                    typeMode(FileType::DIRECTORY, upNode.flag)};
+    std::memcpy(block.bytes, &self, sizeof self);
+    std::memcpy(block.bytes + sizeof self, ".", 1);
+    std::memcpy(block.bytes + self.recordLength, &up, sizeof up);
+    std::memcpy(block.bytes + self.recordLength + sizeof up, "..", 2);
+    fs->write(bno, 0, block.bytes, BLOCK_SIZE_BYTE);
+
+    //目录按区段映射，连续扩展的目录块合并为一个区段
+    INode node{};
+    node.uid = uid;
+    node.flag = flag;
+    node.links = 1;
+    FileMap::init(node, FileLayout::EXTENT);
+    FileMap(fs, node).append(0, bno, 1);
+    node.capacity = recordSize(1) + recordSize(2);
+    fs->writeINode(ino, node);
+    return true;
+}
+
+bool DirectoryFile::convert(FileSystem *fs, const std::vector<std::pair<inodeno_t, std::vector<Dirent>>> &dirs) {
+    //先排好每个目录的新目录块并统计总块数，空闲块不够时不做任何修改
+    std::vector<DirectoryFile> files;
+    std::vector<std::vector<DirentBlock>> packed(dirs.size());
+    std::vector<uint64_t> bytes(dirs.size());
+    uint64_t need = 0;
+    for (size_t k = 0; k < dirs.size(); ++k) {
+        files.emplace_back(fs, dirs[k].first);
+        if (!files.back().isDirectory()) {
+            return false;
+        }
+        bytes[k] = pack(dirs[k].second, packed[k]);
+        need += packed[k].size();
+    }
+    if (need > fs->getFreeBlockNumber()) {
+        return false;
+    }
+
+    //全部目录的新块都写好后才切换i节点并回收旧块，中途失败时归还已写好的新块，所有目录保持原样
+    std::vector<INode> nodes(dirs.size());
+    for (size_t k = 0; k < dirs.size(); ++k) {
+        if (!files[k].stage(packed[k], nodes[k])) {
+            std::vector<blockno_t> unused;
+            for (size_t j = 0; j < k; ++j) {
+                FileMap(fs, nodes[j]).collect(unused);
+            }
+            fs->blockFreeN(unused.data(), unused.size());
+            return false;
+        }
+    }
+    for (size_t k = 0; k < dirs.size(); ++k) {
+        files[k].install(nodes[k], packed[k].size(), bytes[k]);
+    }
+    return true;
+}
+
+bool DirectoryFile::lookup(FileSystem *fs, inodeno_t dir, const std::string &name, Dirent &item) {
+    //先查目录项缓存，命中时不读取目录的i节点与目录块；未命中时查目录并记下结果，找不到的名字记为否定项
+    //超长的名字不可能存在于目录中，也不记入目录项缓存
+    if (!validName(name)) {
+        return false;
+    }
+    const std::string &key = name;
+    DentryCache *dentries = fs->getDentryCache();
+    Dentry dentry{};
+    if (!dentries->lookup(dir, key, dentry)) {
+        DirectoryFile directory(fs, dir);
+        if (!directory.isDirectory()) {
+            return false;
+        }
+        Dirent found{};
+        dentry = Dentry{};
+        if (directory.find(key, &found) != -1) {
+            dentry = Dentry{found.inodeIndex, found.fileType, found.mode};
+        }
+        dentries->insert(dir, key, dentry);
+    }
+    if (dentry.ino == 0) {
+        return false;
+    }
+    item.inodeIndex = dentry.ino;
+    item.fileType = dentry.type;
+    item.mode = dentry.mode;
+    item.name = key;
+    return true;
+}
+
+FileType DirectoryFile::typeOf(uint8_t flag) {
+    switch (flag & 0xC0) {
+        case 0x00:
+            return FileType::REGULAR;
+        case 0x40:
+            return FileType::DIRECTORY;
+        case 0x80:
+            return FileType::SYMLINK;
+        default:
+            return FileType::UNKNOWN;
+    }
+}
+
+uint8_t DirectoryFile::typeMode(FileType type, uint8_t mode) {
+    return static_cast<uint8_t>(type) | static_cast<uint8_t>((mode & 0x3F) << 2);
+}
+
+void DirectoryFile::fill(Dirent &item, const DirentHeader &header) {
+    item.inodeIndex = header.inodeIndex;
+    item.fileType = static_cast<FileType>(header.typeMode & 0x3);
+    item.mode = header.typeMode >> 2;
+}
+
+bool DirectoryFile::isDirectory() {
+    return (iNode.flag & 0xC0) == 0x40 && iNode.links != 0;
+}
+
+bool DirectoryFile::get(uint32_t pos, Dirent &item) {
+    if (pos / BLOCK_SIZE_BYTE >= blocks || pos % BLOCK_SIZE_BYTE + DIRENT_HEADER_SIZE > BLOCK_SIZE_BYTE) {
+        return false;
+    }
+    DirentHeader header{};
+    readHeader(pos, header);
+    if (header.inodeIndex == 0) {
+        return false;
+    }
+    char name[DIRENT_NAME_MAX];
+    fs->read(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE + DIRENT_HEADER_SIZE, name, header.nameLength);
+    fill(item, header);
+    item.name.assign(name, header.nameLength);
+    return true;
+}
+
+int64_t DirectoryFile::find(const std::string &name, Dirent *item) {
+    if (!validName(name)) {
+        return -1;
+    }
+    const std::string &key = name;
+    if (slots != 0) {
+        //沿探测序列查找，遇到空槽即不存在；散列值与名字长度都相同时才读取名字比较
+        uint32_t hash = hashName(key);
+        uint32_t s = hash & (slots - 1);
+        for (uint32_t probes = 0; probes < slots; ++probes, s = (s + 1) & (slots - 1)) {
+            DirectoryHashSlot slot{};
+            readSlot(s, slot);
+            if (slot.pos == 0) {
+                return -1;
+            }
+            if (slot.hash != hash) {
+                continue;
+            }
+            DirentHeader header{};
+            readHeader(slot.pos - 1, header);
+            if (header.nameLength != key.size()) {
+                continue;
+            }
+            char buf[DIRENT_NAME_MAX];
+            fs->read(blockAt((slot.pos - 1) / BLOCK_SIZE_BYTE), (slot.pos - 1) % BLOCK_SIZE_BYTE + DIRENT_HEADER_SIZE,
+                     buf, header.nameLength);
+            if (std::memcmp(buf, key.data(), key.size()) == 0) {
+                if (item != nullptr) {
+                    fill(*item, header);
+                    item->name = key;
+                }
+                return slot.pos - 1;
+            }
+        }
+        return -1;
+    }
+    //按顺序查找，名字长度不同的记录不比较名字
+    DirentBlock buf{};
+    for (uint32_t n = 0; n < blocks; ++n) {
+        const DirentBlock *block = viewBlock(n, buf);
+        if (block == nullptr) {
+            return -1;
+        }
+        for (uint32_t off = 0; off + DIRENT_HEADER_SIZE <= BLOCK_SIZE_BYTE;) {
+            DirentHeader header{};
+            std::memcpy(&header, block->bytes + off, sizeof header);
+            if (header.recordLength == 0) {
+                break;
+            }
+            if (header.inodeIndex != 0 && header.nameLength == key.size() &&
+                std::memcmp(block->bytes + off + sizeof header, key.data(), key.size()) == 0) {
+                if (item != nullptr) {
+                    fill(*item, header);
+                    item->name = key;
+                }
+                return n * BLOCK_SIZE_BYTE + off;
+            }
+            off += header.recordLength;
+        }
+    }
+    return -1;
+}
+
+bool DirectoryFile::add(const std::string &name, inodeno_t child, FileType type, uint8_t mode) {
+    if (!validName(name)) {
+        return false;
+    }
+    const std::string &key = name;
+    uint16_t need = recordSize(key.size());
+    //先找最近删除或插入过的块，再找最后一块，都放不下时扩展一块
+    auto it = freeHint.find(ino);
+    uint32_t hint = it != freeHint.end() && it->second < blocks ? it->second : blocks - 1;
+    uint32_t pos;
+    uint16_t length;
+    if (!place(hint, need, pos, length) && (hint == blocks - 1 || !place(blocks - 1, need, pos, length))) {
+        if (!grow()) {
+            return false;
+        }
+        pos = (blocks - 1) * BLOCK_SIZE_BYTE;
+        length = BLOCK_SIZE_BYTE;
+    }
+    writeRecord(pos, DirentHeader{child, length, static_cast<uint8_t>(key.size()), typeMode(type, mode)}, key);
+    freeHint[ino] = pos / BLOCK_SIZE_BYTE;
+    iNode.capacity += need;
+    fs->getDentryCache()->insert(ino, key, Dentry{child, type, static_cast<uint8_t>(mode & 0x3F)});
+
+    //目录超过一块时建立散列索引，装填超过3/4时槽数翻倍；重建失败且原索引已满时去掉索引，按顺序查找
+    if (blocks > 1 && estimateEntries() * 4 > static_cast<uint64_t>(slots) * 3) {
+        if (!buildIndex(indexSize(estimateEntries())) && slots != 0 && !indexInsert(hashName(key), pos)) {
+            dropIndex();
+        }
+    } else if (slots != 0 && !indexInsert(hashName(key), pos)) {
+        dropIndex();
+    }
+    fs->writeINode(ino, iNode);
+    return true;
+}
+
+void DirectoryFile::remove(uint32_t pos) {
+    Dirent removed{};
+    if (!get(pos, removed)) {
+        return;
+    }
+    if (slots != 0) {
+        indexErase(hashName(removed.name), pos);
+    }
+    fs->getDentryCache()->erase(ino, removed.name);
+    //只清零记录的i节点号，空位留给之后的add合并复用
+    inodeno_t none = 0;
+    fs->write(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE, reinterpret_cast<char *>(&none), sizeof none);
+    freeHint[ino] = pos / BLOCK_SIZE_BYTE;
+    iNode.capacity -= recordSize(removed.name.size());
+    //有效记录不到目录大小的1/4时紧凑目录，失败时保持原样
+    if (blocks > 1 && iNode.capacity * 4 < static_cast<uint64_t>(blocks) * BLOCK_SIZE_BYTE && compact()) {
+        return;
+    }
+    fs->writeINode(ino, iNode);
+}
+
+bool DirectoryFile::rename(uint32_t pos, const std::string &name) {
+    Dirent item{};
+    if (!get(pos, item)) {
+        return false;
+    }
+    if (!validName(name)) {
+        return false;
+    }
+    const std::string &key = name;
+    DirentHeader header{};
+    readHeader(pos, header);
+    if (recordSize(key.size()) > header.recordLength) {
+        //原记录放不下新名字，插入新记录后删除原记录
+        if (!add(key, item.inodeIndex, item.fileType, item.mode)) {
+            return false;
+        }
+        remove(pos);
+        return true;
+    }
+    if (slots != 0) {
+        indexErase(hashName(item.name), pos);
+    }
+    fs->getDentryCache()->erase(ino, item.name);
+    fs->getDentryCache()->insert(ino, key, Dentry{item.inodeIndex, item.fileType, item.mode});
+    header.nameLength = key.size();
+    writeRecord(pos, header, key);
+    if (slots != 0 && !indexInsert(hashName(key), pos)) {
+        dropIndex();
+    }
+    iNode.capacity = iNode.capacity - recordSize(item.name.size()) + recordSize(key.size());
+    fs->writeINode(ino, iNode);
+    return true;
+}
+
+void DirectoryFile::setINode(uint32_t pos, inodeno_t child) {
+    Dirent item{};
+    if (get(pos, item)) {
+        fs->write(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE, reinterpret_cast<char *>(&child), sizeof child);
+        fs->getDentryCache()->erase(ino, item.name);
+    }
+}
+
+void DirectoryFile::setMode(uint32_t pos, uint8_t mode) {
+    DirentHeader header{};
+    Dirent item{};
+    if (get(pos, item)) {
+        readHeader(pos, header);
+        header.typeMode = typeMode(item.fileType, mode);
+        fs->write(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE + offsetof(DirentHeader, typeMode),
+                  reinterpret_cast<char *>(&header.typeMode), sizeof header.typeMode);
+        fs->getDentryCache()->erase(ino, item.name);
+    }
+}
+
+blockno_t DirectoryFile::blockAt(uint32_t n) {
+    if (isLegacy()) {
+        return n == 0 ? iNode.bno : 0;
+    }
+    uint32_t run;
+    return FileMap(fs, iNode).lookup(n, run);
+}
+
+void DirectoryFile::collect(std::vector<blockno_t> &blocks) {
+    //目录即将被删除，其i节点号会被重新分配，缓存中这个目录下的名字全部作废
+    fs->getDentryCache()->eraseDirectory(ino);
+    if (isLegacy()) {
+        blocks.push_back(iNode.bno);
+        return;
+    }
+    if (iNode.bno != 0) {
+        FileMap(fs, index).collect(blocks);
+        fs->freeINode(iNode.bno);
+    }
+    FileMap(fs, iNode).collect(blocks);
+}
+
+bool DirectoryFile::isLegacy() {
+    return iNode.layout == FileLayout::INDEX;
+}
+
+uint16_t DirectoryFile::recordSize(uint32_t nameLength) {
+    return (DIRENT_HEADER_SIZE + nameLength + 3) / 4 * 4;
+}
+
+bool DirectoryFile::validName(const std::string &name) {
+    return name.size() <= DIRENT_NAME_MAX;
+}
+
+const DirentBlock *DirectoryFile::viewBlock(uint32_t n, DirentBlock &fallback) {
+    blockno_t bno = blockAt(n);
+    if (bno == 0) {
+        return nullptr;
+    }
+    return fs->view(bno, fallback);
+}
+
+void DirectoryFile::readHeader(uint32_t pos, DirentHeader &header) {
+    fs->read(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE, reinterpret_cast<char *>(&header), sizeof header);
+}
+
+void DirectoryFile::writeRecord(uint32_t pos, const DirentHeader &header, const std::string &name) {
+    char record[DIRENT_HEADER_SIZE + DIRENT_NAME_MAX];
+    std::memcpy(record, &header, sizeof header);
+    std::memcpy(record + sizeof header, name.data(), name.size());
+    fs->write(blockAt(pos / BLOCK_SIZE_BYTE), pos % BLOCK_SIZE_BYTE, record, sizeof header + name.size());
+}
+
+bool DirectoryFile::place(uint32_t n, uint16_t need, uint32_t &pos, uint16_t &length) {
+    DirentBlock buf{};
+    const DirentBlock *block = viewBlock(n, buf);
+    if (block == nullptr) {
+        return false;
+    }
+    uint32_t base = n * BLOCK_SIZE_BYTE;
+    for (uint32_t off = 0; off + DIRENT_HEADER_SIZE <= BLOCK_SIZE_BYTE;) {
+        DirentHeader header{};
+        std::memcpy(&header, block->bytes + off, sizeof header);
+        if (header.recordLength == 0) {
+            return false;
+        }
+        if (header.inodeIndex == 0) {
+            //把其后相邻的空位并入这条空记录，只改写它的记录头
+            uint32_t merged = header.recordLength;
+            DirentHeader next{};
+            while (off + merged + DIRENT_HEADER_SIZE <= BLOCK_SIZE_BYTE) {
+                std::memcpy(&next, block->bytes + off + merged, sizeof next);
+                if (next.inodeIndex != 0 || next.recordLength == 0) {
+                    break;
+                }
+                merged += next.recordLength;
+            }
+            if (merged != header.recordLength) {
+                header.recordLength = merged;
+                writeRecord(base + off, header, std::string());
+            }
+            if (merged >= need) {
+                pos = base + off;
+                length = merged;
+                return true;
+            }
+            off += merged;
+            continue;
+        }
+        //有效记录多余的尾部拆分出来作为新记录
+        uint16_t used = recordSize(header.nameLength);
+        if (header.recordLength - used >= need) {
+            pos = base + off + used;
+            length = header.recordLength - used;
+            header.recordLength = used;
+            fs->write(blockAt(n), off, reinterpret_cast<char *>(&header), sizeof header);
+            return true;
+        }
+        off += header.recordLength;
+    }
+    return false;
+}
+
+bool DirectoryFile::grow() {
+    FileMap fileMap(fs, iNode);
+    blockno_t bno = fs->blockAllocate(fileMap.goal());
+    if (bno == 0) {
+        return false;
+    }
+    if (!fileMap.append(blocks, bno, 1)) {
+        fs->blockFree(bno);
+        return false;
+    }
+    //新的目录块可能残留旧数据，写入一条占满整块的空记录
+    DirentBlock block{};
+    DirentHeader header{0, BLOCK_SIZE_BYTE, 0, 0};
+    std::memcpy(block.bytes, &header, sizeof header);
+    fs->write(bno, 0, block.bytes, BLOCK_SIZE_BYTE);
+    blocks++;
+    fs->writeINode(ino, iNode);
+    return true;
+}
+
+bool DirectoryFile::compact() {
+    std::vector<Dirent> entries;
+    forEach([&entries](uint32_t, const Dirent &item) {
+        entries.push_back(item);
+        return true;
+    });
+    return rewrite(entries);
+}
+
+bool DirectoryFile::rewrite(const std::vector<Dirent> &entries) {
+    std::vector<DirentBlock> packed;
+    uint64_t bytes = pack(entries, packed);
+    INode node{};
+    if (!stage(packed, node)) {
+        return false;
+    }
+    install(node, packed.size(), bytes);
+    return true;
+}
+
+uint64_t DirectoryFile::pack(const std::vector<Dirent> &entries, std::vector<DirentBlock> &packed) {
+    //按顺序排入各块，放不下的记录从下一块开始，每块最后一条记录占满块的剩余部分
+    packed.assign(1, DirentBlock{});
+    std::vector<uint32_t> last(1, 0);
+    uint32_t off = 0;
+    uint64_t bytes = 0;
+    for (const Dirent &item : entries) {
+        const std::string &key = item.name;
+        uint16_t need = recordSize(key.size());
+        if (off + need > BLOCK_SIZE_BYTE) {
+            packed.emplace_back();
+            last.push_back(0);
+            off = 0;
+        }
+        DirentHeader header{item.inodeIndex, need, static_cast<uint8_t>(key.size()), typeMode(item.fileType, item.mode)};
+        std::memcpy(packed.back().bytes + off, &header, sizeof header);
+        std::memcpy(packed.back().bytes + off + sizeof header, key.data(), key.size());
+        last.back() = off;
+        off += need;
+        bytes += need;
+    }
+    for (size_t n = 0; n < packed.size(); ++n) {
+        DirentHeader header{};
+        std::memcpy(&header, packed[n].bytes + last[n], sizeof header);
+        header.recordLength = BLOCK_SIZE_BYTE - last[n];
+        std::memcpy(packed[n].bytes + last[n], &header, sizeof header);
+    }
+    return bytes;
+}
+
+bool DirectoryFile::stage(const std::vector<DirentBlock> &packed, INode &node) {
+    //新的块映射只包含放得下全部有效记录的块，只写新分配的块，原目录不变
+    node = iNode;
+    FileMap::init(node, FileLayout::EXTENT);
+    FileMap fileMap(fs, node);
+    for (uint32_t n = 0; n < packed.size(); ++n) {
+        blockno_t bno = fs->blockAllocate(n == 0 ? blockAt(0) : fileMap.goal());
+        if (bno == 0 || !fileMap.append(n, bno, 1)) {
+            std::vector<blockno_t> unused;
+            fileMap.collect(unused);
+            if (bno != 0) {
+                unused.push_back(bno);
+            }
+            fs->blockFreeN(unused.data(), unused.size());
+            return false;
+        }
+        fs->write(bno, 0, packed[n].bytes, BLOCK_SIZE_BYTE);
+    }
+    return true;
+}
+
+void DirectoryFile::install(const INode &node, uint32_t count, uint64_t bytes) {
+    //回收旧的目录块与散列索引，目录项的位置都变了，索引按新位置重建
+    std::vector<blockno_t> old;
+    if (isLegacy()) {
+        old.push_back(iNode.bno);
+    } else {
+        FileMap(fs, iNode).collect(old);
+    }
+    fs->blockFreeN(old.data(), old.size());
+    if (slots != 0) {
+        dropIndex();
+    }
+    iNode = node;
+    iNode.bno = 0;
+    iNode.capacity = bytes;
+    blocks = count;
+    freeHint[ino] = blocks - 1;
+    if (blocks > 1) {
+        buildIndex(indexSize(estimateEntries()));
+    }
+    fs->writeINode(ino, iNode);
+}
+
+uint32_t DirectoryFile::hashName(const std::string &name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+blockno_t DirectoryFile::slotBlock(uint32_t n) {
+    //散列索引按块连续分配，通常只有一个区段，记住最近的连续块避免每次查区段树
+    if (n < runLogical || n >= runLogical + runLength) {
+        runLogical = n;
+        runPhysical = FileMap(fs, index).lookup(n, runLength);
+    }
+    return runPhysical + (n - runLogical);
+}
+
+void DirectoryFile::readSlot(uint32_t s, DirectoryHashSlot &slot) {
+    fs->read(slotBlock(s / DIRECTORY_HASH_PER_BLOCK), s % DIRECTORY_HASH_PER_BLOCK * sizeof slot,
+             reinterpret_cast<char *>(&slot), sizeof slot);
+}
+
+void DirectoryFile::writeSlot(uint32_t s, const DirectoryHashSlot &slot) {
+    fs->write(slotBlock(s / DIRECTORY_HASH_PER_BLOCK), s % DIRECTORY_HASH_PER_BLOCK * sizeof slot,
+              reinterpret_cast<const char *>(&slot), sizeof slot);
+}
+
+bool DirectoryFile::indexInsert(uint32_t hash, uint32_t pos) {
+    DirectoryHashSlot slot{};
+    uint32_t s = hash & (slots - 1);
+    for (uint32_t probes = 0; probes < slots; ++probes) {
+        readSlot(s, slot);
+        if (slot.pos == 0) {
+            writeSlot(s, DirectoryHashSlot{hash, pos + 1});
+            return true;
+        }
+        s = (s + 1) & (slots - 1);
+    }
+    return false;
+}
+
+void DirectoryFile::indexErase(uint32_t hash, uint32_t pos) {
+    uint32_t mask = slots - 1;
+    DirectoryHashSlot slot{};
+    uint32_t hole = hash & mask;
+    for (uint32_t probes = 0;; ++probes, hole = (hole + 1) & mask) {
+        if (probes == slots) {
+            return;
+        }
+        readSlot(hole, slot);
+        if (slot.pos == pos + 1) {
+            break;
+        }
+        if (slot.pos == 0) {
+            return;
+        }
+    }
+    //后面同一探测序列上的槽依次前移填补空位，使查找遇到空槽即可停止
+    for (uint32_t s = (hole + 1) & mask; s != hole; s = (s + 1) & mask) {
+        readSlot(s, slot);
+        if (slot.pos == 0) {
+            break;
+        }
+        //空位在该槽的起始位置与当前位置之间时才能前移
+        if (((s - (slot.hash & mask)) & mask) >= ((s - hole) & mask)) {
+            writeSlot(hole, slot);
+            hole = s;
+        }
+    }
+    writeSlot(hole, DirectoryHashSlot{});
+}
+
+uint64_t DirectoryFile::estimateEntries() {
+    //每条记录至少recordSize(1)字节
+    return iNode.capacity / recordSize(1);
+}
+
+bool DirectoryFile::buildIndex(uint32_t n) {
+    inodeno_t indexNo = fs->allocINode();
+    if (indexNo == 0) {
+        return false;
+    }
+    //散列索引是不出现在任何目录中的普通文件，属主与目录相同
+    INode node{};
+    node.uid = iNode.uid;
+    node.links = 1;
+    FileMap::init(node, FileLayout::EXTENT);
+    FileMap fileMap(fs, node);
+    std::vector<char> zero(BLOCK_SIZE_BYTE, 0);
+    for (uint32_t i = 0; i < n / DIRECTORY_HASH_PER_BLOCK; ++i) {
+        blockno_t bno = fs->blockAllocate(i == 0 ? blockAt(0) : fileMap.goal());
+        if (bno == 0 || !fileMap.append(i, bno, 1)) {
+            std::vector<blockno_t> unused;
+            fileMap.collect(unused);
+            if (bno != 0) {
+                unused.push_back(bno);
+            }
+            fs->blockFreeN(unused.data(), unused.size());
+            fs->freeINode(indexNo);
+            return false;
+        }
+        fs->write(bno, 0, zero.data(), BLOCK_SIZE_BYTE);
+    }
+    node.capacity = static_cast<uint64_t>(n) * sizeof(DirectoryHashSlot);
+    fs->writeINode(indexNo, node);
+
+    //换用新索引后把全部目录项插入一遍，再回收旧索引
+    INode old = index;
+    inodeno_t oldNo = iNode.bno;
+    index = node;
+    slots = n;
+    runLength = 0;
+    forEach([this](uint32_t pos, const Dirent &item) {
+        indexInsert(hashName(item.name), pos);
+        return true;
+    });
+    if (oldNo != 0) {
+        std::vector<blockno_t> freed;
+        FileMap(fs, old).collect(freed);
+        fs->blockFreeN(freed.data(), freed.size());
+        fs->freeINode(oldNo);
+    }
+    iNode.bno = indexNo;
+    fs->writeINode(ino, iNode);
+    return true;
+}
+
+void DirectoryFile::dropIndex() {
+    std::vector<blockno_t> freed;
+    FileMap(fs, index).collect(freed);
+    fs->blockFreeN(freed.data(), freed.size());
+    fs->freeINode(iNode.bno);
+    iNode.bno = 0;
+    index = INode{};
+    slots = 0;
+    runLength = 0;
+}
+
+uint32_t DirectoryFile::indexSize(uint64_t entries) {
+    uint32_t n = DIRECTORY_HASH_PER_BLOCK;
+    while (n < entries * 2) {
+        n *= 2;
+    }
+    return n;
+}
@@ -0,0 +1,122 @@
+
+
+#ifndef FILESYSTEM_DIRECTORYFILE_H
+#define FILESYSTEM_DIRECTORYFILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Constraints.h"
+#include "FileMap.h"
+#include "./entity/INode.h"
+#include "./entity/Dirent.h"
+#include "./entity/DirectoryHash.h"
+
+class FileSystem;
+
+/*
+ * @brief: 目录文件，目录的内容是若干个目录块，按i节点的块映射访问，可以增长到任意多块；
+ *         每块由变长目录项记录首尾相接铺满，目录项的位置是其记录在目录文件中的字节偏移，i节点的capacity为全部有效记录所需的字节数。
+ *         目录项记录子项的文件类型与权限摘要，列目录、按路径查找时不读取子项的i节点；权限摘要在chmod时随所改路径的目录项更新，以i节点为准。
+ *         删除只把记录的i节点号清零留下空位，插入时合并相邻空位、拆分有效记录多余的尾部来复用；有效记录不到1/4时紧凑整个目录。
+ *         超过一块的目录在i节点的bno中记录散列索引文件，按名字的散列值定位目录项；没有索引的目录按顺序查找。
+ *         修改目录项时同步作废目录项缓存中对应的名字。
+ *         旧格式的定长目录在挂载时整体转换
+ */
+class DirectoryFile {
+public:
+    DirectoryFile(FileSystem *fs, inodeno_t ino);
+    static bool create(FileSystem *fs, inodeno_t ino, inodeno_t parent, uint8_t uid, uint8_t flag);  //在已分配的ino号i节点上建立只含.和..的空目录，空间不足返回false
+    static bool convert(FileSystem *fs, const std::vector<std::pair<inodeno_t, std::vector<Dirent>>> &dirs);  //用各自的目录项重写dirs中全部旧格式目录并回收原有的目录块；空间不足时所有目录保持不变并返回false
+    static bool lookup(FileSystem *fs, inodeno_t dir, const std::string &name, Dirent &item);   //经目录项缓存在dir目录中按名字查找目录项，找不到或名字超长返回false；不给出目录项的位置
+    static FileType typeOf(uint8_t flag);               //i节点flag对应的文件类型
+    static bool validName(const std::string &name);     //名字不超过DIRENT_NAME_MAX字节
+
+    bool isDirectory();                                 //ino号i节点是否为目录
+    bool get(uint32_t pos, Dirent &item);               //读取位置pos处的目录项，越界或是空位返回false
+    int64_t find(const std::string &name, Dirent *item = nullptr);  //按名字查找目录项，返回其位置，找不到或名字超长返回-1；先比较名字长度，有散列索引时只读取散列值相同的目录项
+    bool add(const std::string &name, inodeno_t ino, FileType type, uint8_t mode);    //在空位提示所在块或最后一块中找空间写入目录项，mode为i节点flag的低6位；都放不下时扩展一块；名字超过DIRENT_NAME_MAX字节或空间不足返回false
+    void remove(uint32_t pos);                          //删除位置pos处的目录项，只清零该记录的i节点号；有效记录过少时紧凑整个目录，其余目录项的位置随之改变
+    bool rename(uint32_t pos, const std::string &name); //修改位置pos处目录项的名字，原记录放不下时重新插入，位置随之改变；名字超长或空间不足返回false
+    void setINode(uint32_t pos, inodeno_t ino);         //修改位置pos处目录项指向的i节点
+    void setMode(uint32_t pos, uint8_t mode);           //修改位置pos处目录项的权限摘要，只写回一个字节
+    blockno_t blockAt(uint32_t n);                      //第n个目录块所在的磁盘块，不存在返回0
+    void collect(std::vector<blockno_t> &blocks);       //收集目录块、散列索引与块映射占用的元数据块，散列索引的i节点立即归还i节点表
+    template<class F>
+    void forEach(F f);                                  //按顺序对每个有效目录项调用f(pos, item)，f返回false时停止
+
+private:
+    FileSystem *fs;
+    inodeno_t ino;
+    INode iNode;
+    uint32_t blocks;    //目录块数
+    INode index;        //散列索引文件的i节点
+    uint32_t slots;     //散列索引的槽数，0表示没有索引
+    uint64_t runLogical;    //最近一次查到的散列索引连续块：起始逻辑块、物理块与块数
+    blockno_t runPhysical;
+    uint32_t runLength;
+    static std::unordered_map<inodeno_t, uint32_t> freeHint;    //各目录最近删除或插入目录项的块，只在内存中，失效时只影响查找空间的起点
+
+    bool isLegacy();    //转换前的旧格式单块目录
+    static uint8_t typeMode(FileType type, uint8_t mode);       //文件类型与权限摘要合成记录头中的一个字节
+    static void fill(Dirent &item, const DirentHeader &header); //从记录头取出i节点号、文件类型与权限摘要
+    static uint16_t recordSize(uint32_t nameLength);    //容纳nameLength字节名字的最短记录长度
+    const DirentBlock *viewBlock(uint32_t n, DirentBlock &fallback);    //第n个目录块的只读视图
+    void readHeader(uint32_t pos, DirentHeader &header);
+    void writeRecord(uint32_t pos, const DirentHeader &header, const std::string &name);   //只写回记录头与名字所在的字节
+    bool place(uint32_t n, uint16_t need, uint32_t &pos, uint16_t &length);    //在第n块中找出至少need字节的空位，顺带合并相邻空位或拆分有效记录多余的尾部
+    bool grow();        //追加一个只含一条空记录的目录块
+    bool compact();     //把有效目录项紧凑地重写到新的目录块中
+    bool rewrite(const std::vector<Dirent> &entries);   //把entries按顺序紧凑地写入新分配的目录块，回收旧块与旧索引并按需重建散列索引；空间不足时保持不变并返回false
+    static uint64_t pack(const std::vector<Dirent> &entries, std::vector<DirentBlock> &packed);    //把entries按顺序紧凑地排入packed中的目录块，返回全部有效记录的字节数
+    bool stage(const std::vector<DirentBlock> &packed, INode &node);    //为packed分配新块并写入，node为指向新块的映射；原目录不变，空间不足时归还已分配的块并返回false
+    void install(const INode &node, uint32_t count, uint64_t bytes);   //换用stage得到的count块新映射，回收旧块与旧索引并按需重建散列索引
+    static uint32_t hashName(const std::string &name);  //名字的FNV-1a散列值
+    blockno_t slotBlock(uint32_t n);                    //散列索引第n块所在的磁盘块
+    void readSlot(uint32_t s, DirectoryHashSlot &slot);
+    void writeSlot(uint32_t s, const DirectoryHashSlot &slot);
+    bool indexInsert(uint32_t hash, uint32_t pos);      //为位置pos处的目录项插入一个槽，索引已满返回false
+    void indexErase(uint32_t hash, uint32_t pos);       //删除指向位置pos的槽，其后的槽向前回填，不留删除标记
+    uint64_t estimateEntries();                         //按有效记录的字节数估计的目录项个数上限
+    bool buildIndex(uint32_t n);                        //按全部目录项建立n个槽的散列索引并替换原有索引，空间不足时保持不变并返回false
+    void dropIndex();                                   //回收散列索引
+    static uint32_t indexSize(uint64_t entries);        //容纳entries个目录项且装填不超过1/2的槽数
+};
+
+
+template<class F>
+void DirectoryFile::forEach(F f) {
+    //跳过空位，遇到全部有效记录后不再读后面的块
+    DirentBlock buf{};
+    Dirent item{};
+    uint64_t seen = 0;
+    for (uint32_t n = 0; n < blocks && seen < iNode.capacity; ++n) {
+        const DirentBlock *block = viewBlock(n, buf);
+        if (block == nullptr) {
+            return;
+        }
+        for (uint32_t off = 0; off + DIRENT_HEADER_SIZE <= BLOCK_SIZE_BYTE;) {
+            DirentHeader header{};
+            std::memcpy(&header, block->bytes + off, sizeof header);
+            if (header.recordLength == 0) {
+                break;
+            }
+            if (header.inodeIndex != 0) {
+                fill(item, header);
+                item.name.assign(block->bytes + off + sizeof header, header.nameLength);
+                seen += recordSize(header.nameLength);
+                if (!f(n * BLOCK_SIZE_BYTE + off, item)) {
+                    return;
+                }
+            }
+            off += header.recordLength;
+        }
+    }
+}
+
+
+#endif //FILESYSTEM_DIRECTORYFILE_H
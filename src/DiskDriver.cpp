@@ -1,5 +1,14 @@
 
+
 #include "DiskDriver.h"
+#include "Constraints.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 DiskDriver *DiskDriver::instance = nullptr;
 
@@ -14,80 +23,352 @@ DiskDriver *DiskDriver::getInstance() {
 
 DiskDriver::DiskDriver() {
     isOpen = false;
+    fd = -1;
+    cursor = 0;
+    mode = DiskMode::POSITIONAL;
+    mapBase = nullptr;
+    mapSize = 0;
+    pageSize = sysconf(_SC_PAGESIZE);
+    syncPolicy = SyncPolicy::ON_UPDATE;
+    canDiscard = true;
+    resetStat();
 }
 
-bool DiskDriver::open() {
+bool DiskDriver::open(DiskMode m) {
     if (isOpen) {
         return true;
     }
     std::ifstream t(diskName);      //使用读入流来判断文件是否存在
-    if (t.is_open()) {
-        t.close();
+    if (!t.is_open()) {
+        return false;
+    }
+    t.close();
+    mode = m;
+    cursor = 0;
+    if (mode == DiskMode::STREAM) {
         disk.open(diskName, std::ios::in | std::ios::out | std::ios::binary);
-        isOpen = true;
-        return true;
     }
-    return false;
+    //STREAM后端也打开一个描述符，只用于打洞
+    fd = ::open(diskName.c_str(), O_RDWR);
+    if (fd < 0) {
+        disk.close();
+        return false;
+    }
+    if (mode == DiskMode::MAPPED) {
+        //整个磁盘文件只映射一次，之后的块读写都只是指针运算
+        struct stat st{};
+        fstat(fd, &st);
+        mapSize = st.st_size;
+        void *p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+        mapBase = static_cast<char *>(p);
+        dirtyPages.assign((mapSize / pageSize + 1 + 63) / 64, 0);
+    }
+    isOpen = true;
+    return true;
 }
 
 bool DiskDriver::close() {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
     if (!isOpen) {
         return true;
     }
-    disk.close();
+    if (mode == DiskMode::STREAM) {
+        disk.close();
+    } else if (mode == DiskMode::MAPPED) {
+        sync();
+        munmap(mapBase, mapSize);
+        mapBase = nullptr;
+        mapSize = 0;
+    }
+    ::close(fd);
+    fd = -1;
     isOpen = false;
     return true;
 }
 
-bool DiskDriver::init(uint32_t sz) {
+bool DiskDriver::init(uint64_t sz, bool preallocate) {
     if (isOpen) {
         return false;
     }
-    std::ofstream c(diskName, std::ios::binary | std::ios::out);
-    //填充虚拟磁盘
-    c.seekp(0, std::ios::beg);
-    for (uint32_t i = 0; i < sz; ++i) {
-        c.write("", 1);
-    }
-    c.seekp(0, std::ios::beg);
-    c.write(reinterpret_cast<char *>(&sz), sizeof(sz));
-    int8_t ok = -1;     //未格式化标记
-    c.write(reinterpret_cast<char *>(&ok), sizeof(ok));
-    c.close();
-    return true;
+    int c = ::open(diskName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (c < 0) {
+        return false;
+    }
+    //默认只设置文件长度得到稀疏文件，常数时间完成；preallocate时真正分配磁盘区段，避免之后写入时再分配
+    bool ok = false;
+    if (preallocate) {
+        ok = fallocate(c, 0, 0, sz) == 0;
+        if (!ok) {
+            std::cerr << "disk: preallocate not supported, fall back to sparse file" << std::endl;
+        }
+    }
+    if (!ok) {
+        ok = ftruncate(c, sz) == 0;
+    }
+    if (ok) {
+        //写入64位格式的磁盘头部：扩展标记、未格式化标记、块大小（未定为0）、64位容量
+        char header[DISK_HEADER_SIZE] = {};
+        uint32_t extended = DISK_CAPACITY_EXTENDED;
+        int8_t unformatted = -1;     //未格式化标记
+        std::memcpy(header, &extended, sizeof(extended));
+        std::memcpy(header + 4, &unformatted, sizeof(unformatted));
+        std::memcpy(header + 7, &sz, sizeof(sz));
+        ok = pwrite(c, header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    }
+    ::close(c);
+    return ok;
 }
 
-void DiskDriver::seekStart(uint32_t sz) {
-    disk.seekp(sz, std::ios::beg);
-    //std::cout<<cursor<<std::endl;
+void DiskDriver::seekStart(uint64_t sz) {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    stat.seekCalls++;
+    if (mode == DiskMode::STREAM) {
+        disk.seekp(sz, std::ios::beg);
+        stat.syscalls++;
+    } else {
+        cursor = sz;        //只移动模拟读写头，不产生系统调用
+    }
 }
 
-void DiskDriver::seekCurrent(uint32_t sz) {
-    disk.seekp(sz, std::ios::cur);
-    //std::cout<<cursor<<std::endl;
+void DiskDriver::seekCurrent(uint64_t sz) {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    stat.seekCalls++;
+    if (mode == DiskMode::STREAM) {
+        disk.seekp(sz, std::ios::cur);
+        stat.syscalls++;
+    } else {
+        cursor += sz;
+    }
 }
 
 void DiskDriver::read(char *buf, uint32_t sz) {
-    disk.read(buf, sz);
-    disk.flush();
-    disk.clear();
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (mode == DiskMode::STREAM) {
+        stat.readCalls++;
+        stat.syscalls += 2;     //read + flush
+        stat.bytesRead += sz;
+        disk.read(buf, sz);
+        disk.flush();
+        disk.clear();
+    } else {
+        readAt(cursor, buf, sz);
+        cursor += sz;
+    }
 }
 
 void DiskDriver::write(const char *buf, uint32_t sz) {
-    disk.write(buf, sz);
-    disk.flush();
-    disk.clear();
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (mode == DiskMode::STREAM) {
+        stat.writeCalls++;
+        stat.syscalls += 2;     //write + flush
+        stat.bytesWritten += sz;
+        disk.write(buf, sz);
+        disk.flush();
+        disk.clear();
+    } else {
+        writeAt(cursor, buf, sz);
+        cursor += sz;
+    }
 }
 
-DiskDriver::~DiskDriver() {
-    if (isOpen) {
-        disk.close();
+void DiskDriver::readAt(uint64_t pos, char *buf, uint32_t sz) {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (mode == DiskMode::STREAM) {
+        seekStart(pos);
+        read(buf, sz);
+        return;
+    }
+    stat.readCalls++;
+    stat.bytesRead += sz;
+    if (mode == DiskMode::MAPPED) {
+        uint32_t n = pos < mapSize ? static_cast<uint32_t>(std::min<uint64_t>(sz, mapSize - pos)) : 0;
+        std::memcpy(buf, mapBase + pos, n);
+        std::memset(buf + n, 0, sz - n);
+        return;
+    }
+    uint32_t done = 0;
+    while (done < sz) {
+        stat.syscalls++;
+        ssize_t n = ::pread(fd, buf + done, sz - done, static_cast<off_t>(pos) + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            //超出磁盘文件末尾的部分视为全0，与未写入的磁盘块保持一致
+            std::memset(buf + done, 0, sz - done);
+            break;
+        }
+        done += n;
     }
 }
 
+void DiskDriver::writeAt(uint64_t pos, const char *buf, uint32_t sz) {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (mode == DiskMode::STREAM) {
+        seekStart(pos);
+        write(buf, sz);
+        return;
+    }
+    stat.writeCalls++;
+    stat.bytesWritten += sz;
+    if (mode == DiskMode::MAPPED) {
+        if (pos >= mapSize || sz > mapSize - pos) {
+            std::cerr << "disk: write out of range at " << pos << std::endl;
+            return;
+        }
+        std::memcpy(mapBase + pos, buf, sz);
+        markDirty(pos, sz);
+        if (syncPolicy == SyncPolicy::PER_OP) {
+            sync();
+        }
+        return;
+    }
+    uint32_t done = 0;
+    while (done < sz) {
+        stat.syscalls++;
+        ssize_t n = ::pwrite(fd, buf + done, sz - done, static_cast<off_t>(pos) + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::cerr << "disk: write failed at " << pos + done << std::endl;
+            break;
+        }
+        done += n;
+    }
+}
+
+const char *DiskDriver::view(uint64_t pos, uint32_t sz) {
+    if (mode != DiskMode::MAPPED || pos >= mapSize || sz > mapSize - pos) {
+        return nullptr;
+    }
+    stat.readCalls++;
+    return mapBase + pos;
+}
+
+bool DiskDriver::discard(uint64_t pos, uint64_t sz) {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (!isOpen || !canDiscard || sz == 0) {
+        return false;
+    }
+    if (mode == DiskMode::STREAM) {
+        //先把流中缓冲的数据写出，避免之后覆盖打过的洞
+        disk.flush();
+    }
+    //保持文件长度不变；映射区中对应的页随之变为全0，不需要另外处理
+    stat.syscalls++;
+    if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(pos), static_cast<off_t>(sz)) != 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+            canDiscard = false;
+            std::cerr << "disk: punching holes is not supported by the host file system" << std::endl;
+        }
+        return false;
+    }
+    stat.discardCalls++;
+    stat.bytesDiscarded += sz;
+    return true;
+}
+
+uint64_t DiskDriver::footprint() {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (!isOpen) {
+        return 0;
+    }
+    if (mode == DiskMode::STREAM) {
+        disk.flush();
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(st.st_blocks) * 512;
+}
+
+void DiskDriver::setSyncPolicy(SyncPolicy policy) {
+    syncPolicy = policy;
+}
+
+void DiskDriver::commit() {
+    if (mode == DiskMode::MAPPED && syncPolicy == SyncPolicy::ON_UPDATE) {
+        sync();
+    }
+}
+
+void DiskDriver::markDirty(uint64_t pos, uint32_t sz) {
+    if (sz == 0) {
+        return;
+    }
+    for (uint64_t pg = pos / pageSize; pg <= (pos + sz - 1) / pageSize; ++pg) {
+        dirtyPages[pg / 64] |= 1ull << (pg % 64);
+    }
+}
+
+void DiskDriver::sync() {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    if (!isOpen) {
+        return;
+    }
+    if (mode == DiskMode::STREAM) {
+        stat.syscalls++;
+        disk.flush();
+        return;
+    }
+    if (mode == DiskMode::POSITIONAL) {
+        stat.syscalls++;
+        fdatasync(fd);
+        return;
+    }
+    //把连续的脏页合并为一次msync
+    uint64_t pages = (mapSize + pageSize - 1) / pageSize;
+    uint64_t pg = 0;
+    while (pg < pages) {
+        if (!(dirtyPages[pg / 64] & (1ull << (pg % 64)))) {
+            //整个字为0时一次跳过64页
+            pg = (dirtyPages[pg / 64] == 0) ? (pg / 64 + 1) * 64 : pg + 1;
+            continue;
+        }
+        uint64_t start = pg;
+        while (pg < pages && (dirtyPages[pg / 64] & (1ull << (pg % 64)))) {
+            dirtyPages[pg / 64] &= ~(1ull << (pg % 64));
+            pg++;
+        }
+        uint64_t len = std::min<uint64_t>((pg - start) * pageSize, mapSize - start * pageSize);
+        stat.syscalls++;
+        msync(mapBase + start * pageSize, len, MS_SYNC);
+    }
+}
+
+DiskMode DiskDriver::getMode() {
+    return mode;
+}
+
+const DiskStat &DiskDriver::getStat() {
+    return stat;
+}
+
+void DiskDriver::resetStat() {
+    std::lock_guard<std::recursive_mutex> guard(ioLock);
+    stat = DiskStat{};
+}
+
+DiskDriver::~DiskDriver() {
+    close();
+}
+
 void DiskDriver::revokeInstance() {
     delete instance;
     instance = nullptr;
 }
 
+void DiskDriver::setDiskName(const std::string &name) {
+    diskName = name;
+}
 
+const std::string &DiskDriver::getDiskName() {
+    return diskName;
+}
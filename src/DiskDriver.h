@@ -7,6 +7,40 @@
 #include <fstream>
 #include <string>
 #include <cstdint>
+#include <vector>
+#include <mutex>
+
+/*
+ * @brief: 磁盘后端类型，STREAM使用fstream，POSITIONAL使用文件描述符配合pread/pwrite，MAPPED将整个磁盘文件映射到内存
+ */
+enum class DiskMode {
+    STREAM,         //fstream后端，所有读写共享一个读写头，每次读写后flush
+    POSITIONAL,     //pread/pwrite后端，每次调用自带偏移量，一次读写对应一次系统调用
+    MAPPED          //mmap后端，open时映射一次，读写退化为内存拷贝，脏页按msync策略写回
+};
+
+/*
+ * @brief: MAPPED后端的脏页写回策略
+ */
+enum class SyncPolicy {
+    PER_OP,         //每次写入后立即msync对应脏页
+    ON_UPDATE,      //FileSystem::update()提交元数据时msync所有脏页
+    ON_UNMOUNT      //只在卸载（close）时msync
+};
+
+/*
+ * @brief: 磁盘读写统计信息
+ */
+struct DiskStat {
+    uint64_t readCalls;     //读调用次数
+    uint64_t writeCalls;    //写调用次数
+    uint64_t seekCalls;     //移动读写头次数（仅STREAM后端会真正产生seek）
+    uint64_t syscalls;      //估算的系统调用次数
+    uint64_t bytesRead;     //读出字节数
+    uint64_t bytesWritten;  //写入字节数
+    uint64_t discardCalls;  //在磁盘文件上打洞的次数
+    uint64_t bytesDiscarded;    //打洞释放的字节数
+};
 
 /*
  * @brief: 模拟磁盘，支持挂载磁盘模拟文件、读写头前后移动（以字节为单位）、初始化磁盘功能
@@ -15,20 +49,45 @@ class DiskDriver {
 public:
     static DiskDriver* getInstance();       //为了防止冲突，使用单例获取虚拟磁盘对象
     static void revokeInstance();           //销毁单例
-    bool open();                            //打开虚拟磁盘文件，返回是否打开成功
+    static void setDiskName(const std::string &name);   //改用name作为虚拟磁盘文件，只在磁盘关闭时调用
+    static const std::string &getDiskName();            //虚拟磁盘文件名
+    bool open(DiskMode m = DiskMode::POSITIONAL);   //以指定后端打开虚拟磁盘文件，返回是否打开成功
     bool close();                           //关闭虚拟磁盘文件，返回是否关闭
-    bool init(uint32_t sz);                 //创建未格式化的指定容量的虚拟磁盘文件，单位为Byte
-    void seekStart(uint32_t sz);            //将读写头移动到距起始sz字节处
-    void seekCurrent(uint32_t sz);          //将读写头移动到距当前位置sz字节处
+    bool init(uint64_t sz, bool preallocate = false);   //创建未格式化的指定容量的虚拟磁盘文件，单位为Byte，preallocate为真时预分配真实磁盘空间
+    void seekStart(uint64_t sz);            //将读写头移动到距起始sz字节处
+    void seekCurrent(uint64_t sz);          //将读写头移动到距当前位置sz字节处
     void read(char* buf, uint32_t sz);      //从当前位置读出sz字节到buf缓冲区
     void write(const char *buf, uint32_t sz);     //从当前位置将sz字节写入文件
+    void readAt(uint64_t pos, char *buf, uint32_t sz);         //从距起始pos字节处读出sz字节，不依赖读写头
+    void writeAt(uint64_t pos, const char *buf, uint32_t sz);  //从距起始pos字节处写入sz字节，不依赖读写头
+    const char *view(uint64_t pos, uint32_t sz);        //MAPPED后端下返回[pos,pos+sz)的只读指针，其他后端返回nullptr
+    bool discard(uint64_t pos, uint64_t sz);    //在磁盘文件的[pos,pos+sz)处打洞，归还宿主机的存储空间，之后读出全0；宿主文件系统不支持时返回false
+    uint64_t footprint();                   //磁盘文件在宿主机上实际占用的字节数
+    void setSyncPolicy(SyncPolicy policy);  //设置MAPPED后端的脏页写回策略
+    void commit();                          //元数据提交点，MAPPED后端ON_UPDATE策略下写回脏页
+    void sync();                            //立即将已写入的数据落盘：MAPPED后端msync脏页，POSITIONAL后端fdatasync，STREAM后端flush
+    DiskMode getMode();                     //当前使用的后端
+    const DiskStat &getStat();              //读写统计信息
+    void resetStat();                       //清空统计信息
     ~DiskDriver();
 private:
     static DiskDriver *instance;
     static std::string diskName;        //虚拟磁盘文件名
-    std::fstream disk;                  //C++文件对象模拟磁盘，同时起到读写头的作用
+    std::fstream disk;                  //C++文件对象模拟磁盘，同时起到读写头的作用（STREAM后端）
+    int fd;                             //虚拟磁盘文件描述符（POSITIONAL与MAPPED后端读写，STREAM后端只用于打洞）
+    uint64_t cursor;                    //POSITIONAL/MAPPED后端下为兼容seekStart/read/write接口而模拟的读写头
+    char *mapBase;                      //MAPPED后端的映射起始地址
+    uint64_t mapSize;                   //映射长度，即磁盘文件大小
+    uint32_t pageSize;                  //系统页大小
+    std::vector<uint64_t> dirtyPages;   //脏页位图，每位对应映射区中的一页
+    SyncPolicy syncPolicy;              //脏页写回策略
+    DiskMode mode;                      //当前后端
+    DiskStat stat;                      //读写统计
     bool isOpen;                        //磁盘是否打开标记
+    bool canDiscard;                    //宿主文件系统是否支持打洞，第一次失败后不再尝试
+    std::recursive_mutex ioLock;        //保护读写头、映射区与统计信息，缓存的后台写回线程与前台共用磁盘
     DiskDriver();
+    void markDirty(uint64_t pos, uint32_t sz);  //将[pos,pos+sz)覆盖的页标记为脏页
 };
 
 
@@ -0,0 +1,553 @@
+
+
+#include "FileMap.h"
+#include "FileSystem.h"
+
+FileMap::FileMap(FileSystem *fs, INode &iNode, FileIndexCursor *cursor)
+        : fs(fs), iNode(iNode), cursor(cursor), localCursor{}, metaGoal(0) {
+    if (this->cursor == nullptr) {
+        this->cursor = &localCursor;
+    }
+}
+
+void FileMap::init(INode &iNode, FileLayout layout) {
+    iNode.layout = layout;
+    iNode.bno = 0;
+    std::memset(iNode.data, 0, sizeof iNode.data);
+}
+
+uint64_t FileMap::metadataBound(uint64_t blocks) {
+    //映射元数据最多约占数据块的 1/256，再留出余量
+    return blocks / 256 + 16;
+}
+
+blockno_t FileMap::lookup(uint64_t lblk, uint32_t &run) {
+    run = 0;
+    if (iNode.layout == FileLayout::INLINE) {
+        return 0;
+    }
+    if (iNode.layout == FileLayout::EXTENT) {
+        return extentLookup(lblk, run);
+    }
+    if (iNode.layout == FileLayout::BLOCKMAP) {
+        return blockMapLookup(lblk, run);
+    }
+    return indexLookup(lblk, run);
+}
+
+bool FileMap::append(uint64_t lblk, blockno_t pblk, uint32_t n) {
+    if (n == 0) {
+        return true;
+    }
+    //内联文件没有块映射，需要先用expandInline转换
+    if (iNode.layout == FileLayout::INLINE) {
+        return false;
+    }
+    metaGoal = pblk + n;
+    if (iNode.layout == FileLayout::EXTENT) {
+        return extentAppend(lblk, pblk, n);
+    }
+    if (iNode.layout == FileLayout::BLOCKMAP) {
+        return blockMapAppend(lblk, pblk, n);
+    }
+    return indexAppend(lblk, pblk, n);
+}
+
+uint32_t FileMap::appendBlocks(uint64_t lblk, blockno_t *blocks, uint32_t n) {
+    //连续分配时整批只增加或延长一个区段
+    std::sort(blocks, blocks + n);
+    uint32_t i = 0;
+    while (i < n) {
+        uint32_t j = i + 1;
+        while (j < n && blocks[j] == blocks[j - 1] + 1) {
+            j++;
+        }
+        if (!append(lblk + i, blocks[i], j - i)) {
+            break;
+        }
+        i = j;
+    }
+    return i;
+}
+
+uint64_t FileMap::mappedBlocks() {
+    if (iNode.layout == FileLayout::INLINE) {
+        return 0;
+    }
+    if (iNode.layout == FileLayout::EXTENT) {
+        return extentEnd();
+    }
+    if (iNode.layout == FileLayout::BLOCKMAP) {
+        return blockMapRoot()->mapped;
+    }
+    //索引表布局中光标不会越过文件末尾，至少映射了前ceil(capacity/块大小)块，创建文件时已分配第0块；
+    //预分配的块在文件末尾之后，沿索引表继续数到第一个空项
+    if (iNode.bno == 0) {
+        return 0;
+    }
+    uint64_t n = std::max<uint64_t>(1, (iNode.capacity + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE);
+    uint32_t run;
+    while (indexLookup(n, run) != 0) {
+        n += run;
+    }
+    return n;
+}
+
+blockno_t FileMap::goal() {
+    uint64_t mapped = mappedBlocks();
+    if (mapped == 0) {
+        return 0;
+    }
+    uint32_t run;
+    blockno_t last = lookup(mapped - 1, run);
+    return last == 0 ? 0 : last + 1;
+}
+
+void FileMap::collect(std::vector<blockno_t> &blocks) {
+    if (iNode.layout == FileLayout::INLINE) {
+        return;
+    }
+    if (iNode.layout == FileLayout::EXTENT) {
+        extentCollect(*rootHeader(), rootEntries(), blocks);
+        return;
+    }
+    if (iNode.layout == FileLayout::BLOCKMAP) {
+        BlockMapRoot *root = blockMapRoot();
+        for (int i = 0; i < BLOCKMAP_DIRECT; ++i) {
+            if (root->direct[i] != 0) {
+                blocks.push_back(root->direct[i]);
+            }
+        }
+        for (int level = 1; level <= 3; ++level) {
+            blockMapCollect(root->indirect[level - 1], level, blocks);
+        }
+        return;
+    }
+    indexCollect(blocks);
+}
+
+bool FileMap::expandInline(FileLayout layout, blockno_t goal) {
+    if (iNode.layout != FileLayout::INLINE) {
+        return true;
+    }
+    //内联内容先取出，映射根与内联数据共用data
+    std::vector<char> block(BLOCK_SIZE_BYTE, 0);
+    std::memcpy(block.data(), iNode.data, iNode.capacity);
+    INode saved = iNode;
+    init(iNode, layout);
+    if (iNode.capacity == 0) {
+        return true;
+    }
+    blockno_t pblk = fs->blockAllocate(goal);
+    if (pblk == 0 || !append(0, pblk, 1)) {
+        if (pblk != 0) {
+            fs->blockFree(pblk);
+        }
+        iNode = saved;
+        return false;
+    }
+    fs->write(pblk, 0, block.data(), BLOCK_SIZE_BYTE);
+    return true;
+}
+
+bool FileMap::seekTable(uint64_t tableNo, FileIndex &table, bool create) {
+    if (iNode.bno == 0) {
+        if (!create) {
+            return false;
+        }
+        iNode.bno = fs->blockAllocate(metaGoal);
+        if (iNode.bno == 0) {
+            return false;
+        }
+        table = FileIndex{};
+        fs->write(iNode.bno, 0, reinterpret_cast<char *>(&table), sizeof table);
+        *cursor = FileIndexCursor{0, iNode.bno};
+    }
+    //目标在上次访问的索引表之后则从那里继续，否则从i节点指向的第一个索引表开始
+    if (cursor->block == 0 || tableNo < cursor->tableNo) {
+        *cursor = FileIndexCursor{0, iNode.bno};
+    }
+    fs->read(cursor->block, 0, reinterpret_cast<char *>(&table), sizeof table);
+    while (cursor->tableNo < tableNo) {
+        blockno_t next = table.next;
+        if (next == 0) {
+            if (!create) {
+                return false;
+            }
+            //新的索引表链接到链表末尾，新分配的块可能残留旧数据，从空表开始写入
+            next = fs->blockAllocate(metaGoal);
+            if (next == 0) {
+                return false;
+            }
+            table.next = next;
+            fs->write(cursor->block, 0, reinterpret_cast<char *>(&table), sizeof table);
+            table = FileIndex{};
+            fs->write(next, 0, reinterpret_cast<char *>(&table), sizeof table);
+        } else {
+            fs->read(next, 0, reinterpret_cast<char *>(&table), sizeof table);
+        }
+        cursor->block = next;
+        cursor->tableNo++;
+    }
+    return true;
+}
+
+blockno_t FileMap::indexLookup(uint64_t lblk, uint32_t &run) {
+    FileIndex table{};
+    if (!seekTable(lblk / FILE_INDEX_SIZE, table, false)) {
+        return 0;
+    }
+    uint32_t slot = lblk % FILE_INDEX_SIZE;
+    blockno_t pblk = table.index[slot];
+    if (pblk == 0) {
+        return 0;
+    }
+    //同一索引表中物理连续的后继块一并返回
+    run = 1;
+    while (slot + run < FILE_INDEX_SIZE && table.index[slot + run] == pblk + run) {
+        run++;
+    }
+    return pblk;
+}
+
+bool FileMap::indexAppend(uint64_t lblk, blockno_t pblk, uint32_t n) {
+    FileIndex table{};
+    uint64_t loaded = ~0ull;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint64_t tableNo = (lblk + i) / FILE_INDEX_SIZE;
+        if (tableNo != loaded) {
+            if (loaded != ~0ull) {
+                fs->write(cursor->block, 0, reinterpret_cast<char *>(&table), sizeof table);
+            }
+            if (!seekTable(tableNo, table, true)) {
+                return false;
+            }
+            loaded = tableNo;
+        }
+        table.index[(lblk + i) % FILE_INDEX_SIZE] = pblk + i;
+    }
+    fs->write(cursor->block, 0, reinterpret_cast<char *>(&table), sizeof table);
+    return true;
+}
+
+void FileMap::indexCollect(std::vector<blockno_t> &blocks) {
+    blockno_t next = iNode.bno;
+    while (next != 0) {
+        FileIndex table{};
+        fs->read(next, 0, reinterpret_cast<char *>(&table), sizeof table);
+        for (int i = 0; i < FILE_INDEX_SIZE && table.index[i] != 0; ++i) {
+            blocks.push_back(table.index[i]);
+        }
+        //索引表本身
+        blocks.push_back(next);
+        next = table.next;
+    }
+}
+
+ExtentHeader *FileMap::rootHeader() {
+    return reinterpret_cast<ExtentHeader *>(iNode.data);
+}
+
+Extent *FileMap::rootEntries() {
+    return reinterpret_cast<Extent *>(iNode.data + sizeof(ExtentHeader));
+}
+
+namespace {
+    //把逻辑块号分解为各级间接块中的下标，返回间接级数，0为直接块，超出三级间接的范围返回-1
+    int blockMapPath(uint64_t lblk, uint32_t idx[3]) {
+        const uint64_t per = BLOCKMAP_PER_BLOCK;
+        if (lblk < BLOCKMAP_DIRECT) {
+            idx[0] = lblk;
+            return 0;
+        }
+        lblk -= BLOCKMAP_DIRECT;
+        if (lblk < per) {
+            idx[0] = lblk;
+            return 1;
+        }
+        lblk -= per;
+        if (lblk < per * per) {
+            idx[0] = lblk / per;
+            idx[1] = lblk % per;
+            return 2;
+        }
+        lblk -= per * per;
+        if (lblk < per * per * per) {
+            idx[0] = lblk / (per * per);
+            idx[1] = lblk / per % per;
+            idx[2] = lblk % per;
+            return 3;
+        }
+        return -1;
+    }
+
+    //最后一个起始逻辑块不超过lblk的项，没有时返回-1
+    int lastNotAfter(const Extent *e, uint16_t count, uint64_t lblk) {
+        const Extent *it = std::upper_bound(e, e + count, lblk, [](uint64_t v, const Extent &x) {
+            return v < x.logical;
+        });
+        return static_cast<int>(it - e) - 1;
+    }
+}
+
+blockno_t FileMap::extentLookup(uint64_t lblk, uint32_t &run) {
+    const ExtentHeader *h = rootHeader();
+    const Extent *e = rootEntries();
+    ExtentNode node{};
+    //每层二分查找一次，树高通常为0或1
+    while (true) {
+        int i = lastNotAfter(e, h->count, lblk);
+        if (i < 0) {
+            return 0;
+        }
+        if (h->depth == 0) {
+            if (lblk >= static_cast<uint64_t>(e[i].logical) + e[i].length) {
+                return 0;
+            }
+            uint32_t off = lblk - e[i].logical;
+            run = e[i].length - off;
+            return e[i].start + off;
+        }
+        fs->read(e[i].start, 0, reinterpret_cast<char *>(&node), sizeof node);
+        h = &node.header;
+        e = node.entries;
+    }
+}
+
+uint64_t FileMap::extentEnd() {
+    const ExtentHeader *h = rootHeader();
+    const Extent *e = rootEntries();
+    ExtentNode node{};
+    if (h->count == 0) {
+        return 0;
+    }
+    while (h->depth > 0) {
+        fs->read(e[h->count - 1].start, 0, reinterpret_cast<char *>(&node), sizeof node);
+        h = &node.header;
+        e = node.entries;
+    }
+    return static_cast<uint64_t>(e[h->count - 1].logical) + e[h->count - 1].length;
+}
+
+bool FileMap::extentAppend(uint64_t lblk, blockno_t pblk, uint32_t n) {
+    ExtentHeader *root = rootHeader();
+    uint16_t height = root->depth;
+    //读入最右路径上的各层节点，path[k]为第k+1层
+    std::vector<ExtentNode> path(height);
+    std::vector<blockno_t> pathBlock(height);
+    ExtentHeader *h = root;
+    Extent *e = rootEntries();
+    for (uint16_t level = 0; level < height; ++level) {
+        pathBlock[level] = e[h->count - 1].start;
+        fs->read(pathBlock[level], 0, reinterpret_cast<char *>(&path[level]), sizeof(ExtentNode));
+        h = &path[level].header;
+        e = path[level].entries;
+    }
+    if (h->count > 0) {
+        Extent &last = e[h->count - 1];
+        uint64_t end = static_cast<uint64_t>(last.logical) + last.length;
+        if (lblk < end) {
+            return false;
+        }
+        //逻辑与物理都紧接最后一个区段时直接延长，连续分配的写入只修改这一项
+        if (lblk == end && pblk == last.start + last.length && last.length <= UINT32_MAX - n) {
+            last.length += n;
+            if (height > 0) {
+                fs->write(pathBlock[height - 1], 0, reinterpret_cast<char *>(&path[height - 1]), sizeof(ExtentNode));
+            }
+            return true;
+        }
+    }
+
+    //从叶子向上插入：节点未满时直接放入；已满时新建只含这一项的兄弟节点，再把指向它的索引项插入上一层
+    Extent entry{static_cast<uint32_t>(lblk), pblk, n};
+    for (int level = height; level >= 0; --level) {
+        h = level == 0 ? root : &path[level - 1].header;
+        e = level == 0 ? rootEntries() : path[level - 1].entries;
+        uint32_t cap = level == 0 ? EXTENT_PER_INODE : EXTENT_PER_BLOCK;
+        if (h->count < cap) {
+            e[h->count++] = entry;
+            if (level > 0) {
+                fs->write(pathBlock[level - 1], 0, reinterpret_cast<char *>(&path[level - 1]), sizeof(ExtentNode));
+            }
+            return true;
+        }
+        ExtentNode sibling{};
+        sibling.header.depth = h->depth;
+        sibling.header.count = 1;
+        sibling.entries[0] = entry;
+        blockno_t siblingBlock = fs->blockAllocate(metaGoal);
+        if (siblingBlock == 0) {
+            return false;
+        }
+        fs->write(siblingBlock, 0, reinterpret_cast<char *>(&sibling), sizeof sibling);
+        if (level == 0) {
+            //树根已满：根的内容整体移到新块，根变为指向它和新兄弟节点的索引节点，树高加一
+            ExtentNode moved{};
+            moved.header = *root;
+            std::copy(e, e + root->count, moved.entries);
+            blockno_t movedBlock = fs->blockAllocate(metaGoal);
+            if (movedBlock == 0) {
+                fs->blockFree(siblingBlock);
+                return false;
+            }
+            fs->write(movedBlock, 0, reinterpret_cast<char *>(&moved), sizeof moved);
+            root->depth++;
+            root->count = 2;
+            e[0] = Extent{moved.entries[0].logical, movedBlock, 0};
+            e[1] = Extent{entry.logical, siblingBlock, 0};
+            return true;
+        }
+        entry = Extent{entry.logical, siblingBlock, 0};
+    }
+    return false;
+}
+
+void FileMap::extentCollect(const ExtentHeader &h, const Extent *e, std::vector<blockno_t> &blocks) {
+    for (uint16_t i = 0; i < h.count; ++i) {
+        if (h.depth == 0) {
+            for (uint32_t k = 0; k < e[i].length; ++k) {
+                blocks.push_back(e[i].start + k);
+            }
+            continue;
+        }
+        ExtentNode node{};
+        fs->read(e[i].start, 0, reinterpret_cast<char *>(&node), sizeof node);
+        extentCollect(node.header, node.entries, blocks);
+        blocks.push_back(e[i].start);
+    }
+}
+
+BlockMapRoot *FileMap::blockMapRoot() {
+    return reinterpret_cast<BlockMapRoot *>(iNode.data);
+}
+
+blockno_t FileMap::allocateTable() {
+    blockno_t bno = fs->blockAllocate(metaGoal);
+    if (bno != 0) {
+        std::vector<blockno_t> zero(BLOCKMAP_PER_BLOCK, 0);
+        fs->write(bno, 0, reinterpret_cast<char *>(zero.data()), BLOCK_SIZE_BYTE);
+    }
+    return bno;
+}
+
+blockno_t FileMap::blockMapLeaf(int level, const uint32_t *idx, bool create) {
+    blockno_t &top = blockMapRoot()->indirect[level - 1];
+    if (top == 0) {
+        if (!create || (top = allocateTable()) == 0) {
+            return 0;
+        }
+    }
+    //中间各级只读出需要的一个块号
+    blockno_t blk = top;
+    for (int k = 0; k < level - 1; ++k) {
+        blockno_t next = 0;
+        fs->read(blk, idx[k] * sizeof(blockno_t), reinterpret_cast<char *>(&next), sizeof next);
+        if (next == 0) {
+            if (!create || (next = allocateTable()) == 0) {
+                return 0;
+            }
+            fs->write(blk, idx[k] * sizeof(blockno_t), reinterpret_cast<char *>(&next), sizeof next);
+        }
+        blk = next;
+    }
+    return blk;
+}
+
+blockno_t FileMap::blockMapLookup(uint64_t lblk, uint32_t &run) {
+    BlockMapRoot *root = blockMapRoot();
+    if (lblk >= root->mapped) {
+        return 0;
+    }
+    uint32_t idx[3];
+    int level = blockMapPath(lblk, idx);
+    const blockno_t *slots;
+    uint32_t slot = idx[level > 0 ? level - 1 : 0];
+    uint32_t count;
+    blockno_t table[BLOCKMAP_PER_BLOCK];
+    if (level == 0) {
+        slots = root->direct;
+        count = BLOCKMAP_DIRECT;
+    } else {
+        blockno_t leaf = blockMapLeaf(level, idx, false);
+        if (leaf == 0) {
+            return 0;
+        }
+        //末级间接块从目标项读到块尾，同时得到物理连续的后继块
+        count = BLOCKMAP_PER_BLOCK;
+        fs->read(leaf, slot * sizeof(blockno_t), reinterpret_cast<char *>(table + slot), (count - slot) * sizeof(blockno_t));
+        slots = table;
+    }
+    blockno_t pblk = slots[slot];
+    if (pblk == 0) {
+        return 0;
+    }
+    run = 1;
+    while (slot + run < count && lblk + run < root->mapped && slots[slot + run] == pblk + run) {
+        run++;
+    }
+    return pblk;
+}
+
+bool FileMap::blockMapAppend(uint64_t lblk, blockno_t pblk, uint32_t n) {
+    BlockMapRoot *root = blockMapRoot();
+    if (lblk < root->mapped || lblk + n > UINT32_MAX) {
+        return false;
+    }
+    //同一个末级间接块中的块号在内存中修改，离开该间接块时整块写回
+    std::vector<blockno_t> table(BLOCKMAP_PER_BLOCK);
+    blockno_t leaf = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t idx[3];
+        int level = blockMapPath(lblk + i, idx);
+        if (level < 0) {
+            if (leaf != 0) {
+                fs->write(leaf, 0, reinterpret_cast<char *>(table.data()), BLOCK_SIZE_BYTE);
+            }
+            return false;
+        }
+        if (level == 0) {
+            root->direct[idx[0]] = pblk + i;
+            root->mapped = lblk + i + 1;
+            continue;
+        }
+        uint32_t slot = idx[level - 1];
+        //逻辑块连续递增，只有下标回到0或刚进入间接区时才换到另一个末级间接块
+        if (leaf == 0 || slot == 0) {
+            if (leaf != 0) {
+                fs->write(leaf, 0, reinterpret_cast<char *>(table.data()), BLOCK_SIZE_BYTE);
+            }
+            leaf = blockMapLeaf(level, idx, true);
+            if (leaf == 0) {
+                return false;
+            }
+            fs->read(leaf, 0, reinterpret_cast<char *>(table.data()), BLOCK_SIZE_BYTE);
+        }
+        table[slot] = pblk + i;
+        root->mapped = lblk + i + 1;
+    }
+    if (leaf != 0) {
+        fs->write(leaf, 0, reinterpret_cast<char *>(table.data()), BLOCK_SIZE_BYTE);
+    }
+    return true;
+}
+
+void FileMap::blockMapCollect(blockno_t blk, int level, std::vector<blockno_t> &blocks) {
+    if (blk == 0) {
+        return;
+    }
+    std::vector<blockno_t> table(BLOCKMAP_PER_BLOCK);
+    fs->read(blk, 0, reinterpret_cast<char *>(table.data()), BLOCK_SIZE_BYTE);
+    for (blockno_t entry : table) {
+        if (entry == 0) {
+            continue;
+        }
+        if (level == 1) {
+            blocks.push_back(entry);
+        } else {
+            blockMapCollect(entry, level - 1, blocks);
+        }
+    }
+    //间接块本身
+    blocks.push_back(blk);
+}
@@ -0,0 +1,61 @@
+
+
+#ifndef FILESYSTEM_FILEMAP_H
+#define FILESYSTEM_FILEMAP_H
+
+#include <cstdint>
+#include <vector>
+#include "Constraints.h"
+#include "./entity/INode.h"
+#include "./entity/FileIndex.h"
+#include "./entity/Extent.h"
+#include "./entity/BlockMap.h"
+
+class FileSystem;
+
+/*
+ * @brief: 文件的块映射，把文件内的逻辑块号转换为物理块号，按i节点的layout解释映射根；
+ *         映射总是从逻辑块0开始连续，只能在末尾追加；预分配的块可以映射到文件末尾之后。映射根在i节点中，修改后由调用者把i节点写回
+ */
+class FileMap {
+public:
+    FileMap(FileSystem *fs, INode &iNode, FileIndexCursor *cursor = nullptr);     //cursor为INDEX布局的定位缓存，可为空
+    static void init(INode &iNode, FileLayout layout);      //把i节点的映射初始化为指定布局的空映射
+    static uint64_t metadataBound(uint64_t blocks);         //映射blocks个数据块最多需要的元数据块数的估计，预先检查空闲空间时使用
+    blockno_t lookup(uint64_t lblk, uint32_t &run);         //返回逻辑块lblk对应的物理块，run为从该块起物理连续的已映射块数；未映射返回0
+    bool append(uint64_t lblk, blockno_t pblk, uint32_t n); //把[lblk,lblk+n)映射到从pblk开始的连续物理块，lblk不能小于mappedBlocks()；需要的元数据块自行分配，失败返回false
+    uint32_t appendBlocks(uint64_t lblk, blockno_t *blocks, uint32_t n);   //把n个新分配的块排序后按物理连续的段依次追加到lblk处，返回成功映射的块数
+    uint64_t mappedBlocks();                                //已映射的逻辑块数
+    void collect(std::vector<blockno_t> &blocks);           //收集数据块与映射本身占用的元数据块
+    bool expandInline(FileLayout layout, blockno_t goal = 0);   //把内联文件转换为layout布局，原有内容搬到在goal附近新分配的第0块；空间不足时保持不变并返回false
+    blockno_t goal();                                       //追加新块的期望位置：最后一个已映射块之后，还没有映射时为0
+
+private:
+    FileSystem *fs;
+    INode &iNode;
+    FileIndexCursor *cursor;        //INDEX布局的定位缓存，未指定时指向localCursor
+    FileIndexCursor localCursor;
+    blockno_t metaGoal;             //映射元数据块的期望位置，追加时设为本次追加的数据块之后，使元数据靠近数据
+
+    bool seekTable(uint64_t tableNo, FileIndex &table, bool create);    //读出第tableNo个索引表，create为真时链表不够长则新建索引表
+    blockno_t indexLookup(uint64_t lblk, uint32_t &run);
+    bool indexAppend(uint64_t lblk, blockno_t pblk, uint32_t n);
+    void indexCollect(std::vector<blockno_t> &blocks);
+
+    ExtentHeader *rootHeader();     //i节点中的区段树根
+    Extent *rootEntries();
+    blockno_t extentLookup(uint64_t lblk, uint32_t &run);
+    bool extentAppend(uint64_t lblk, blockno_t pblk, uint32_t n);
+    uint64_t extentEnd();           //最后一个区段之后的逻辑块号
+    void extentCollect(const ExtentHeader &h, const Extent *e, std::vector<blockno_t> &blocks);
+
+    BlockMapRoot *blockMapRoot();   //i节点中的多级块映射根
+    blockno_t blockMapLeaf(int level, const uint32_t *idx, bool create);   //沿level级间接块找到存放目标块号的间接块，create为真时补齐缺失的间接块
+    blockno_t blockMapLookup(uint64_t lblk, uint32_t &run);
+    bool blockMapAppend(uint64_t lblk, blockno_t pblk, uint32_t n);
+    void blockMapCollect(blockno_t blk, int level, std::vector<blockno_t> &blocks);
+    blockno_t allocateTable();      //分配一个清零的间接块
+};
+
+
+#endif //FILESYSTEM_FILEMAP_H
@@ -1,23 +1,94 @@
 
 
 #include "FileSystem.h"
+#include "StackAllocator.h"
+#include "BitmapAllocator.h"
+#include "GroupAllocator.h"
+#include "FileMap.h"
+#include "DirectoryFile.h"
 
 FileSystem *FileSystem::instance = nullptr;
 
-FileSystem::FileSystem() {
+namespace {
+    //32位旧格式的i节点，文件大小为32位
+    struct LegacyINode {
+        uint8_t uid;
+        uint8_t flag;
+        uint32_t bno;
+        uint32_t capacity;
+    };
+
+    //带块映射方式之前的64位格式i节点，16字节
+    struct INodeV1 {
+        uint8_t uid;
+        uint8_t flag;
+        uint32_t bno;
+        uint64_t capacity;
+    };
+
+    //32位旧格式的超级块，可用容量为32位
+    struct LegacyFileSystemInfo {
+        uint32_t rootLocation;
+        uint32_t freeBlockNumber;
+        uint32_t freeBlockStackTop;
+        uint16_t freeBlockStackOffset;
+        uint32_t avaliableCapasity;
+        User users[8];
+        uint8_t trustMatrix[8][8];
+        uint8_t flag;
+    };
+}
+
+FileSystem::FileSystem() : dentries(DENTRY_CACHE_ENTRIES) {
     disk = DiskDriver::getInstance();
-    stack = new FreeBlockStack();
+    allocator = nullptr;
+    formatAllocator = AllocatorKind::STACK;
+    reservedBlocks = 0;
+    discardOnFree = false;
+    pendingCount = 0;
+    discardedCount = 0;
+    cache = nullptr;
+    reclaimer = nullptr;
+    fileLayout = FileLayout::EXTENT;
     isOpen = false;
 }
 
 FileSystem::~FileSystem() {
-    if (systemInfo.flag) {
-        disk->seekStart(sizeof capacity + sizeof isUnformatted + sizeof blockSize);
+    //先停止回收线程，没回收完的孤儿留到下次挂载
+    delete reclaimer;
+    reclaimer = nullptr;
+    unmount();
+    DiskDriver::revokeInstance();
+}
+
+void FileSystem::unmount() {
+    //不足一批的已回收块也在卸载前打洞
+    if (allocator != nullptr && pendingCount != 0) {
+        flushDiscard();
+    }
+    if (allocator != nullptr && systemInfo.flag) {
         systemInfo.flag = 0;
-        disk->write(reinterpret_cast<char *>(&systemInfo), sizeof systemInfo);
+        writeHeader();
+        allocator->flush();
     }
-    DiskDriver::revokeInstance();
-    delete stack;
+    //先析构缓存把脏块写回，再关闭磁盘
+    delete cache;
+    cache = nullptr;
+    disk->close();
+    delete allocator;
+    allocator = nullptr;
+    inodeBlocks.clear();
+    isOpen = false;
+}
+
+bool FileSystem::remount(const MountOptions &options) {
+    //回收线程保留，挂载时按磁盘上的孤儿目录重新统计
+    unmount();
+    return mount(options);
+}
+
+const MountOptions &FileSystem::getMountOptions() {
+    return mountOptions;
 }
 
 FileSystem *FileSystem::getInstance() {
@@ -32,26 +103,27 @@ bool FileSystem::format(uint16_t bsize) {
         return false;
     }
 
-    //写入格式化标记、块大小
-    disk->seekStart(sizeof(capacity));
+    //原有的i节点号全部作废，缓存的名字一并丢弃
+    dentries.clear();
+    reservedBlocks = 0;
+
+    //设置格式化标记、块大小，与超级块一起写入磁盘头部
     isUnformatted = 0;
-    disk->write(reinterpret_cast<char *>(&isUnformatted), sizeof isUnformatted);
     blockSize = bsize;
-    disk->write(reinterpret_cast<char *>(&blockSize), sizeof blockSize);
-    // (char*)(&var)
-    systemInfo.flag = 0;
-
-    systemInfo.freeBlockStackTop = 1;                 //空闲块栈顶初始位于磁盘块1
-    uint32_t totalBlock = capacity / blockSize;         //磁盘被划分的块数
-    uint32_t blockStackSize = totalBlock * sizeof(uint32_t) / blockSize;  //空闲块栈所占用的磁盘块个数
-    if (totalBlock * sizeof(uint32_t) % blockSize != 0) {
-        blockStackSize += 1;
+    systemInfo = FileSystemInfo{};
+    //空闲空间管理结构绕过缓存直接批量写入，先丢弃所有缓存
+    if (cache != nullptr) {
+        cache->reset(blockSize);
     }
 
-    systemInfo.rootLocation = blockStackSize + 1;       //根目录位于空闲块栈底的下一个块
-    systemInfo.avaliableCapasity =
-            blockSize * (totalBlock - blockStackSize - 3);       //初始可用块个数=总容量-栈大小-引导超级块-根目录i节点-根目录项
-    systemInfo.freeBlockNumber = totalBlock - blockStackSize - 3;       //空闲块个数=总块数-空闲块栈大小-引导块-根目录项
+    uint32_t totalBlock = capacity / blockSize;         //磁盘被划分的块数
+    delete allocator;
+    allocator = createAllocator(formatAllocator);
+    systemInfo.features = FEATURE_INODE_LAYOUT | FEATURE_INODE_TABLE | FEATURE_DIRENT | FEATURE_DIRENT_MODE |
+                          (formatAllocator == AllocatorKind::BITMAP ? FEATURE_BITMAP_ALLOCATOR : 0) |
+                          (formatAllocator == AllocatorKind::GROUPS ? FEATURE_ALLOC_GROUPS : 0);
+    uint32_t metaBlocks = allocator->layout(totalBlock);  //空闲空间管理结构所占用的磁盘块个数
+    systemInfo.freeBlockNumber = totalBlock - metaBlocks - 1;       //空闲块个数=总块数-管理结构大小-引导块
 
     //初始化用户，用户名默认user1-user8，uid分别为1-8
     char userName[] = "user0";
@@ -73,135 +145,928 @@ bool FileSystem::format(uint16_t bsize) {
         }
     }
 
-    //初始化磁盘中的空闲块栈
-    uint32_t ptr = (blockStackSize + 1) * blockSize;
-    for (uint32_t b = totalBlock - 1; b >= blockStackSize + 3; --b) {
-        ptr -= sizeof(uint32_t);
-        disk->seekStart(ptr);
-        disk->write(reinterpret_cast<char *>(&b), sizeof b);
+    //在磁盘上建立空闲空间管理结构，管理结构之后的块全部空闲
+    allocator->format(totalBlock, metaBlocks + 1);
+
+    //将磁盘头部与超级块信息写入磁盘0号块指定区域
+    writeHeader();
+
+    //读入空闲空间管理结构
+    allocator->load();
+    resetDiscard();
+
+    //建立i节点表，紧跟在管理结构之后连续分配
+    FileMap::init(systemInfo.inodeTable, FileLayout::EXTENT);
+    inodeBlocks.clear();
+    growINodeTable(std::max<uint32_t>(1, totalBlock / INODE_RATIO_BLOCKS / INODES_PER_BLOCK));
+
+    //创建根目录，所有用户都有rwx权限，根目录没有上级目录，..指向自己
+    systemInfo.rootLocation = allocINode();
+    DirectoryFile::create(this, systemInfo.rootLocation, systemInfo.rootLocation, 0, 0x7f);
+    createOrphanDirectory();
+    systemInfo.avaliableCapasity = static_cast<uint64_t>(blockSize) * systemInfo.freeBlockNumber;     //初始可用容量为建立根目录之后的空闲块
+
+    update();
+    pinRoot();
+    startReclaimer();
+
+    return true;
+}
+
+bool FileSystem::mount(const MountOptions &options) {
+    if (!disk->open(options.diskMode)) {
+        return false;
+    }
+    disk->setSyncPolicy(options.syncPolicy);
+    mountOptions = options;
+    dentries.clear();
+    reservedBlocks = 0;
+    discardOnFree = options.discard;
+    formatAllocator = options.allocator;
+    fileLayout = options.layout;
+    //读取磁盘容量与是否格式化的信息
+    char header[DISK_HEADER_SIZE];
+    disk->readAt(0, header, sizeof header);
+    uint32_t legacyCapacity;
+    std::memcpy(&legacyCapacity, header, sizeof legacyCapacity);
+    std::memcpy(&isUnformatted, header + 4, sizeof isUnformatted);
+    std::memcpy(&blockSize, header + 5, sizeof blockSize);
+    isOpen = true;
+    bool isLegacy = legacyCapacity != DISK_CAPACITY_EXTENDED;
+    if (isLegacy) {
+        capacity = legacyCapacity;
+    } else {
+        std::memcpy(&capacity, header + 7, sizeof capacity);
+    }
+    //映射模式下映射区本身就是缓存，不再叠加块缓存
+    delete cache;
+    cache = nullptr;
+    if (options.diskMode != DiskMode::MAPPED && options.cacheBlocks > 0) {
+        cache = new BufferCache(disk, isUnformatted ? BLOCK_SIZE_BYTE : blockSize, options.cacheBlocks, options.writeBack);
+    }
+    //未格式化，挂载失败
+    if (isUnformatted) {
+        return false;
+    }
+    //32位旧格式的磁盘先原地升级为64位格式
+    if (isLegacy) {
+        upgradeLegacy();
+    } else {
+        disk->readAt(DISK_HEADER_SIZE, reinterpret_cast<char *>(&systemInfo), sizeof systemInfo);
+    }
+    delete allocator;
+    if (systemInfo.features & FEATURE_ALLOC_GROUPS) {
+        allocator = createAllocator(AllocatorKind::GROUPS);
+    } else {
+        allocator = createAllocator((systemInfo.features & FEATURE_BITMAP_ALLOCATOR) ? AllocatorKind::BITMAP : AllocatorKind::STACK);
     }
+    allocator->load();
+    resetDiscard();
+    //16字节的旧i节点原地升级为带块映射方式的格式，已有文件保持索引表布局
+    if (!(systemInfo.features & FEATURE_INODE_LAYOUT)) {
+        upgradeINodes(false);
+    }
+    //每个i节点独占一块的磁盘迁移为i节点表格式
+    if (systemInfo.features & FEATURE_INODE_TABLE) {
+        loadINodeTable();
+    } else if (!migrateINodeTable()) {
+        sync();
+        return false;
+    }
+    //定长目录项的目录转换为变长目录项
+    if (!(systemInfo.features & FEATURE_DIRENT)) {
+        if (!migrateDirents()) {
+            sync();
+            return false;
+        }
+    } else if (!(systemInfo.features & FEATURE_DIRENT_MODE)) {
+        fillDirentModes();
+    }
+    //建立孤儿目录，上次卸载时没回收完的孤儿由回收线程继续回收
+    if (!(systemInfo.features & FEATURE_ORPHANS)) {
+        createOrphanDirectory();
+        update();
+    }
+    pinRoot();
+    startReclaimer();
+    return true;
+}
+
+void FileSystem::upgradeLegacy() {
+    LegacyFileSystemInfo legacyInfo{};
+    disk->readAt(LEGACY_DISK_HEADER_SIZE, reinterpret_cast<char *>(&legacyInfo), sizeof legacyInfo);
+    systemInfo = FileSystemInfo{};
+    systemInfo.rootLocation = legacyInfo.rootLocation;
+    systemInfo.freeBlockNumber = legacyInfo.freeBlockNumber;
+    systemInfo.freeBlockStackTop = legacyInfo.freeBlockStackTop;
+    systemInfo.freeBlockStackOffset = legacyInfo.freeBlockStackOffset;
+    systemInfo.avaliableCapasity = legacyInfo.avaliableCapasity;
+    std::memcpy(systemInfo.users, legacyInfo.users, sizeof systemInfo.users);
+    std::memcpy(systemInfo.trustMatrix, legacyInfo.trustMatrix, sizeof systemInfo.trustMatrix);
+    systemInfo.flag = 0;
 
-    //确定空闲块栈顶的偏移量
-    disk->seekStart(blockSize * 1);
-    bool findStackTop = false;
-    auto &i = systemInfo.freeBlockStackTop;
-    auto &j = systemInfo.freeBlockStackOffset;
-    for (i = 1; i <= blockStackSize; ++i) {
-        for (j = 0; j < stack->getMaxSize(); ++j) {
-            uint32_t t;
-            disk->read(reinterpret_cast<char *>(&t), sizeof t);
-            if (t != 0) {
-                findStackTop = true;
-                break;
+    //从根目录开始遍历，把每个i节点改写为64位文件大小的格式
+    upgradeINodes(true);
+    std::cout << "legacy 32-bit disk upgraded to 64-bit format" << std::endl;
+}
+
+void FileSystem::upgradeINodes(bool legacy) {
+    std::set<blockno_t> visited;
+    upgradeINode(systemInfo.rootLocation, legacy, visited);
+    systemInfo.features |= FEATURE_INODE_LAYOUT;
+    writeHeader();
+    std::cout << "inodes upgraded to " << INODE_SIZE << "-byte format (" << visited.size() << " inodes)" << std::endl;
+}
+
+void FileSystem::upgradeINode(blockno_t inodeDisk, bool legacy, std::set<blockno_t> &visited) {
+    if (inodeDisk == 0 || !visited.insert(inodeDisk).second) {
+        return;
+    }
+    INode iNode{};
+    if (legacy) {
+        LegacyINode old{};
+        read(inodeDisk, 0, reinterpret_cast<char *>(&old), sizeof old);
+        iNode.uid = old.uid;
+        iNode.flag = old.flag;
+        iNode.bno = old.bno;
+        iNode.capacity = old.capacity;
+    } else {
+        INodeV1 old{};
+        read(inodeDisk, 0, reinterpret_cast<char *>(&old), sizeof old);
+        iNode.uid = old.uid;
+        iNode.flag = old.flag;
+        iNode.bno = old.bno;
+        iNode.capacity = old.capacity;
+    }
+    //旧i节点之后的字节可能是残留数据，映射根全部清零，已有文件与目录保持索引表布局
+    iNode.layout = FileLayout::INDEX;
+    iNode.links = 1;
+    std::memset(iNode.data, 0, sizeof iNode.data);
+    write(inodeDisk, 0, reinterpret_cast<char *>(&iNode), sizeof iNode);
+    //目录则继续升级其下所有目录项指向的i节点
+    if ((iNode.flag & 0xC0) == 0x40) {
+        Directory dir{};
+        read(iNode.bno, 0, reinterpret_cast<char *>(&dir), sizeof dir);
+        for (int i = 0; i < DIRECTORY_NUMS && dir.item[i].inodeIndex != 0; ++i) {
+            if (strcmp(dir.item[i].name, ".") != 0 && strcmp(dir.item[i].name, "..") != 0) {
+                upgradeINode(dir.item[i].inodeIndex, legacy, visited);
             }
         }
-        if (findStackTop) {
+    }
+}
+
+bool FileSystem::locateINode(inodeno_t ino, blockno_t &bno, uint16_t &offset) {
+    if (ino == 0 || ino > systemInfo.inodeCount) {
+        return false;
+    }
+    bno = inodeBlocks[(ino - 1) / INODES_PER_BLOCK];
+    offset = (ino - 1) % INODES_PER_BLOCK * INODE_SIZE;
+    return true;
+}
+
+bool FileSystem::readINode(inodeno_t ino, INode &iNode) {
+    blockno_t bno;
+    uint16_t offset;
+    if (!locateINode(ino, bno, offset)) {
+        return false;
+    }
+    read(bno, offset, reinterpret_cast<char *>(&iNode), sizeof iNode);
+    return true;
+}
+
+void FileSystem::writeINode(inodeno_t ino, const INode &iNode) {
+    blockno_t bno;
+    uint16_t offset;
+    if (locateINode(ino, bno, offset)) {
+        write(bno, offset, reinterpret_cast<const char *>(&iNode), sizeof iNode);
+    }
+}
+
+void FileSystem::readINodes(const std::vector<inodeno_t> &inos, std::vector<INode> &iNodes) {
+    //需要的i节点表块去重排序，磁盘上相邻的块合并为一次连续读取，每块只读一次
+    std::vector<uint32_t> tableBlocks;
+    for (inodeno_t ino : inos) {
+        if (ino != 0 && ino <= systemInfo.inodeCount) {
+            tableBlocks.push_back((ino - 1) / INODES_PER_BLOCK);
+        }
+    }
+    std::sort(tableBlocks.begin(), tableBlocks.end());
+    tableBlocks.erase(std::unique(tableBlocks.begin(), tableBlocks.end()), tableBlocks.end());
+    std::vector<char> buf(tableBlocks.size() * BLOCK_SIZE_BYTE);
+    for (size_t i = 0; i < tableBlocks.size();) {
+        size_t n = 1;
+        while (i + n < tableBlocks.size() && tableBlocks[i + n] == tableBlocks[i] + n &&
+               inodeBlocks[tableBlocks[i + n]] == inodeBlocks[tableBlocks[i]] + n) {
+            n++;
+        }
+        readRun(inodeBlocks[tableBlocks[i]], n, buf.data() + i * BLOCK_SIZE_BYTE);
+        i += n;
+    }
+    iNodes.assign(inos.size(), INode{});
+    for (size_t k = 0; k < inos.size(); ++k) {
+        if (inos[k] == 0 || inos[k] > systemInfo.inodeCount) {
+            continue;
+        }
+        uint32_t t = (inos[k] - 1) / INODES_PER_BLOCK;
+        size_t i = std::lower_bound(tableBlocks.begin(), tableBlocks.end(), t) - tableBlocks.begin();
+        std::memcpy(&iNodes[k], buf.data() + i * BLOCK_SIZE_BYTE + (inos[k] - 1) % INODES_PER_BLOCK * INODE_SIZE,
+                    sizeof(INode));
+    }
+}
+
+const INode *FileSystem::viewINode(inodeno_t ino, INode &fallback) {
+    blockno_t bno;
+    uint16_t offset;
+    if (!locateINode(ino, bno, offset)) {
+        return nullptr;
+    }
+    const char *p = disk->view(blockOffset(bno) + offset, sizeof(INode));
+    if (p != nullptr) {
+        return reinterpret_cast<const INode *>(p);
+    }
+    read(bno, offset, reinterpret_cast<char *>(&fallback), sizeof fallback);
+    return &fallback;
+}
+
+inodeno_t FileSystem::allocINode() {
+    if (systemInfo.freeINodeNumber == 0 && growINodeTable(INODE_TABLE_GROW_BLOCKS) == 0) {
+        return 0;
+    }
+    //从上次分配的记录所在块开始逐块查找空闲记录，连续创建的文件得到相邻的i节点号，目录扫描时一次读入
+    INode records[INODES_PER_BLOCK];
+    uint32_t tableBlocks = inodeBlocks.size();
+    uint32_t first = systemInfo.inodeHint / INODES_PER_BLOCK % tableBlocks;
+    for (uint32_t k = 0; k < tableBlocks; ++k) {
+        uint32_t blk = (first + k) % tableBlocks;
+        read(inodeBlocks[blk], 0, reinterpret_cast<char *>(records), sizeof records);
+        for (uint32_t i = 0; i < INODES_PER_BLOCK; ++i) {
+            if (records[i].links != 0) {
+                continue;
+            }
+            inodeno_t ino = blk * INODES_PER_BLOCK + i + 1;
+            INode iNode{};
+            iNode.links = 1;
+            writeINode(ino, iNode);
+            systemInfo.freeINodeNumber--;
+            systemInfo.inodeHint = ino - 1;
+            systemInfo.flag = 1;
+            return ino;
+        }
+    }
+    return 0;
+}
+
+void FileSystem::freeINode(inodeno_t ino) {
+    INode iNode{};
+    if (!readINode(ino, iNode) || iNode.links == 0) {
+        return;
+    }
+    writeINode(ino, INode{});
+    systemInfo.freeINodeNumber++;
+    systemInfo.flag = 1;
+}
+
+void FileSystem::loadINodeTable() {
+    inodeBlocks.clear();
+    FileMap tableMap(this, systemInfo.inodeTable);
+    uint64_t mapped = tableMap.mappedBlocks();
+    for (uint64_t lblk = 0; lblk < mapped;) {
+        uint32_t run;
+        blockno_t pblk = tableMap.lookup(lblk, run);
+        if (pblk == 0) {
             break;
         }
+        for (uint32_t k = 0; k < run; ++k) {
+            inodeBlocks.push_back(pblk + k);
+        }
+        lblk += run;
     }
+}
+
+uint32_t FileSystem::growINodeTable(uint32_t blocks) {
+    std::vector<blockno_t> fresh(blocks);
+    uint32_t got = blockAllocateN(blocks, fresh.data(), inodeBlocks.empty() ? 0 : inodeBlocks.back() + 1);
+    //新的表块全部清零，所有记录都是空闲的
+    std::vector<char> zero(static_cast<size_t>(BLOCK_SIZE_BYTE), 0);
+    for (uint32_t i = 0; i < got; ++i) {
+        write(fresh[i], 0, zero.data(), BLOCK_SIZE_BYTE);
+    }
+    FileMap tableMap(this, systemInfo.inodeTable);
+    uint32_t done = tableMap.appendBlocks(inodeBlocks.size(), fresh.data(), got);
+    blockFreeN(fresh.data() + done, got - done);
+    inodeBlocks.insert(inodeBlocks.end(), fresh.begin(), fresh.begin() + done);
+    systemInfo.inodeCount += done * INODES_PER_BLOCK;
+    systemInfo.freeINodeNumber += done * INODES_PER_BLOCK;
+    systemInfo.inodeTable.capacity = static_cast<uint64_t>(inodeBlocks.size()) * BLOCK_SIZE_BYTE;
+    systemInfo.flag = 1;
+    return done;
+}
 
-    //创建根目录，配置根目录i节点和目录列表的信息
-    INode rootINode{};
-    Directory dir{};
-    rootINode.uid = 0;    //0表示系统
-    rootINode.bno = systemInfo.rootLocation + 1;    //根目录所在磁盘块为i节点所在磁盘块下一位
-    rootINode.flag = 0x7f;         //01111111，目录，所有用户都有rwx权限
-    dir.item[0].inodeIndex = systemInfo.rootLocation;
-    strcpy(dir.item[0].name, ".");       //当前目录指向自己，根目录没有上级目录
-    dir.item[1].inodeIndex = systemInfo.rootLocation;
-    strcpy(dir.item[1].name, "..");       //根目录没有上级目录，所以指向自己
-    dir.item[2].inodeIndex = 0;
-    disk->seekStart(systemInfo.rootLocation * blockSize);
-    disk->write(reinterpret_cast<char *>(&rootINode), sizeof(rootINode));
-    disk->seekStart(rootINode.bno * blockSize);
-    disk->write(reinterpret_cast<char *>(&dir), sizeof(dir));
-
-    //将超级块信息写入磁盘0号块指定区域
-    disk->seekStart(sizeof(capacity) + sizeof(isUnformatted) + sizeof(blockSize));
-    disk->write(reinterpret_cast<char *>(&systemInfo), sizeof(systemInfo));
-
-    //写入空闲块栈
-    auto blocks = stack->getBlocks();
-    disk->seekStart(systemInfo.freeBlockStackTop * blockSize);
-    disk->read(reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack->getMaxSize());
-    stack->setStackTop(systemInfo.freeBlockStackOffset);
+bool FileSystem::migrateINodeTable() {
+    //先只读地统计从根目录可达的i节点，空闲块放不下全部i节点时不做任何修改
+    std::set<blockno_t> reachable;
+    countLegacyINodes(systemInfo.rootLocation, reachable);
+    uint32_t needed = (reachable.size() + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+    if (systemInfo.freeBlockNumber < needed) {
+        std::cout << "inode table migration failed: no space left on disk (" << needed << " blocks needed, "
+                  << systemInfo.freeBlockNumber << " free), disk left unchanged" << std::endl;
+        return false;
+    }
+
+    //i节点表按格式化时的比例建立且至少放得下全部i节点，之后不够时allocINode会自动扩展
+    INode savedTable = systemInfo.inodeTable;
+    uint32_t savedCount = systemInfo.inodeCount;
+    uint32_t savedFree = systemInfo.freeINodeNumber;
+    uint32_t savedHint = systemInfo.inodeHint;
+    FileMap::init(systemInfo.inodeTable, FileLayout::EXTENT);
+    systemInfo.inodeTable.links = 1;
+    systemInfo.inodeTable.capacity = 0;
+    systemInfo.inodeCount = 0;
+    systemInfo.freeINodeNumber = 0;
+    systemInfo.inodeHint = 0;
+    inodeBlocks.clear();
+    uint32_t totalBlock = capacity / blockSize;
+    growINodeTable(std::max(needed, std::min(std::max<uint32_t>(1, totalBlock / INODE_RATIO_BLOCKS / INODES_PER_BLOCK),
+                                             systemInfo.freeBlockNumber / 2)));
 
+    //从根目录开始把每个i节点搬入新分配的i节点表，改写后的目录块先留在内存中
+    std::map<blockno_t, inodeno_t> moved;
+    std::map<blockno_t, Directory> rewrites;
+    inodeno_t root = inodeBlocks.size() < needed ? 0 : migrateINode(systemInfo.rootLocation, 0, moved, rewrites);
+    if (root == 0) {
+        //到目前为止只写过新分配的块，归还i节点表占用的块后磁盘仍是迁移前的格式
+        std::vector<blockno_t> table;
+        FileMap(this, systemInfo.inodeTable).collect(table);
+        blockFreeN(table.data(), table.size());
+        systemInfo.inodeTable = savedTable;
+        systemInfo.inodeCount = savedCount;
+        systemInfo.freeINodeNumber = savedFree;
+        systemInfo.inodeHint = savedHint;
+        inodeBlocks.clear();
+        systemInfo.flag = 1;
+        std::cout << "inode table migration failed: no space left on disk, disk left unchanged" << std::endl;
+        return false;
+    }
+
+    //全部i节点都已搬入后才改写旧目录块，旧的i节点块统一回收
+    for (auto &item : rewrites) {
+        write(item.first, 0, reinterpret_cast<char *>(&item.second), sizeof item.second);
+    }
+    systemInfo.rootLocation = root;
+    std::vector<blockno_t> oldBlocks;
+    for (auto &item : moved) {
+        oldBlocks.push_back(item.first);
+    }
+    blockFreeN(oldBlocks.data(), oldBlocks.size());
+    systemInfo.features |= FEATURE_INODE_TABLE;
+    systemInfo.flag = 1;
+    update();
+    std::cout << "inodes migrated to inode table (" << moved.size() << " inodes, "
+              << oldBlocks.size() << " blocks freed)" << std::endl;
     return true;
 }
 
-bool FileSystem::mount() {
-    if (!disk->open()) {
-        return false;
+void FileSystem::countLegacyINodes(blockno_t inodeDisk, std::set<blockno_t> &reachable) {
+    if (inodeDisk == 0 || !reachable.insert(inodeDisk).second) {
+        return;
     }
-    //读取磁盘容量与是否格式化的信息
-    disk->seekStart(0);
-    disk->read(reinterpret_cast<char *>(&capacity), sizeof(capacity));
-    disk->read(reinterpret_cast<char *>(&isUnformatted), sizeof(isUnformatted));
-    isOpen = true;
-    //如果是格式化过的磁盘，读入信息，否则未格式化，挂载失败
-    if (!isUnformatted) {
-        disk->read(reinterpret_cast<char *>(&blockSize), sizeof blockSize);
-        disk->read(reinterpret_cast<char *>(&systemInfo), sizeof systemInfo);
-        auto blocks = stack->getBlocks();
-        disk->seekStart(systemInfo.freeBlockStackTop * blockSize);
-        disk->read(reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack->getMaxSize());
-        stack->setStackTop(systemInfo.freeBlockStackOffset);
-        disk->seekStart(0);
-        return true;
-    }else{
+    INode iNode{};
+    read(inodeDisk, 0, reinterpret_cast<char *>(&iNode), sizeof iNode);
+    if ((iNode.flag & 0xC0) == 0x40) {
+        Directory dir{};
+        read(iNode.bno, 0, reinterpret_cast<char *>(&dir), sizeof dir);
+        for (int i = 0; i < DIRECTORY_NUMS && dir.item[i].inodeIndex != 0; ++i) {
+            if (strcmp(dir.item[i].name, ".") != 0 && strcmp(dir.item[i].name, "..") != 0) {
+                countLegacyINodes(dir.item[i].inodeIndex, reachable);
+            }
+        }
+    }
+}
+
+inodeno_t FileSystem::migrateINode(blockno_t inodeDisk, inodeno_t parent, std::map<blockno_t, inodeno_t> &moved,
+                                   std::map<blockno_t, Directory> &rewrites) {
+    auto it = moved.find(inodeDisk);
+    if (it != moved.end()) {
+        return it->second;
+    }
+    INode iNode{};
+    read(inodeDisk, 0, reinterpret_cast<char *>(&iNode), sizeof iNode);
+    inodeno_t ino = allocINode();
+    if (ino == 0) {
+        return 0;
+    }
+    moved[inodeDisk] = ino;
+    iNode.links = 1;
+    //目录的.指向自己，..指向上级，其余目录项改写为子项的新i节点号，改写结果由调用者统一写回
+    if ((iNode.flag & 0xC0) == 0x40) {
+        Directory dir{};
+        read(iNode.bno, 0, reinterpret_cast<char *>(&dir), sizeof dir);
+        for (int i = 0; i < DIRECTORY_NUMS && dir.item[i].inodeIndex != 0; ++i) {
+            if (strcmp(dir.item[i].name, ".") == 0) {
+                dir.item[i].inodeIndex = ino;
+            } else if (strcmp(dir.item[i].name, "..") == 0) {
+                dir.item[i].inodeIndex = parent != 0 ? parent : ino;
+            } else {
+                inodeno_t child = migrateINode(dir.item[i].inodeIndex, ino, moved, rewrites);
+                if (child == 0) {
+                    return 0;
+                }
+                dir.item[i].inodeIndex = child;
+            }
+        }
+        rewrites[iNode.bno] = dir;
+    }
+    writeINode(ino, iNode);
+    return ino;
+}
+
+bool FileSystem::migrateDirents() {
+    //从根目录开始逐个读出旧格式的目录项，子项的文件类型取自其i节点，全部读完后再整体重写为变长目录项
+    std::vector<std::pair<inodeno_t, std::vector<Dirent>>> dirs;
+    std::vector<inodeno_t> pending{systemInfo.rootLocation};
+    std::set<inodeno_t> visited;
+    while (!pending.empty()) {
+        inodeno_t dir = pending.back();
+        pending.pop_back();
+        if (!visited.insert(dir).second) {
+            continue;
+        }
+        INode iNode{};
+        readINode(dir, iNode);
+        //单块的旧目录以第一个空目录项结束，多块目录中inodeIndex为0的项是空位
+        bool legacy = iNode.layout == FileLayout::INDEX;
+        FileMap fileMap(this, iNode);
+        uint64_t n = legacy ? 1 : fileMap.mappedBlocks();
+        std::vector<Dirent> entries;
+        for (uint64_t b = 0; b < n; ++b) {
+            uint32_t run;
+            Directory block{};
+            read(legacy ? iNode.bno : fileMap.lookup(b, run), 0, reinterpret_cast<char *>(&block), sizeof block);
+            for (int i = 0; i < DIRECTORY_NUMS; ++i) {
+                const DirectoryItem &item = block.item[i];
+                if (item.inodeIndex == 0) {
+                    if (legacy) {
+                        break;
+                    }
+                    continue;
+                }
+                INode child{};
+                readINode(item.inodeIndex, child);
+                Dirent entry{item.inodeIndex, DirectoryFile::typeOf(child.flag), static_cast<uint8_t>(child.flag & 0x3F),
+                             std::string(item.name, strnlen(item.name, sizeof item.name))};
+                if (entry.fileType == FileType::DIRECTORY && entry.name != "." && entry.name != "..") {
+                    pending.push_back(entry.inodeIndex);
+                }
+                entries.push_back(entry);
+            }
+        }
+        dirs.emplace_back(dir, std::move(entries));
+    }
+    if (!DirectoryFile::convert(this, dirs)) {
+        std::cout << "directory conversion failed: no space left on disk, directories left unchanged" << std::endl;
         return false;
     }
+    systemInfo.features |= FEATURE_DIRENT | FEATURE_DIRENT_MODE;
+    systemInfo.flag = 1;
+    update();
+    std::cout << "directories converted to variable-length entries (" << visited.size() << " directories)" << std::endl;
+    return true;
+}
+
+void FileSystem::createOrphanDirectory() {
+    //孤儿目录不挂在任何目录下，..指向根目录；建立失败时删除操作同步回收
+    systemInfo.orphanDirectory = allocINode();
+    if (systemInfo.orphanDirectory != 0 &&
+        !DirectoryFile::create(this, systemInfo.orphanDirectory, systemInfo.rootLocation, 0, 0x40)) {
+        freeINode(systemInfo.orphanDirectory);
+        systemInfo.orphanDirectory = 0;
+    }
+    if (systemInfo.orphanDirectory != 0) {
+        systemInfo.features |= FEATURE_ORPHANS;
+    }
+    systemInfo.flag = 1;
+}
+
+void FileSystem::startReclaimer() {
+    if (reclaimer == nullptr) {
+        reclaimer = new Reclaimer(this, lock);
+    } else {
+        reclaimer->rescan();
+    }
+}
+
+void FileSystem::orphan(const Dirent &item) {
+    //以i节点号为名字挂到孤儿目录下交给回收线程，孤儿目录放不下时就地同步回收
+    DirectoryFile orphans(this, systemInfo.orphanDirectory);
+    if (orphans.isDirectory() &&
+        orphans.add(std::to_string(item.inodeIndex), item.inodeIndex, item.fileType, item.mode)) {
+        reclaimer->notify();
+        return;
+    }
+    uint64_t freed = 0;
+    reclaimer->reclaim(item.inodeIndex, item.fileType, UINT64_MAX, freed);
+}
+
+inodeno_t FileSystem::getOrphanDirectory() {
+    return systemInfo.orphanDirectory;
+}
+
+uint32_t FileSystem::getOrphanCount() {
+    return reclaimer == nullptr ? 0 : reclaimer->getPending();
+}
+
+uint64_t FileSystem::getReclaimedBlocks() {
+    return reclaimer == nullptr ? 0 : reclaimer->getReclaimed();
 }
 
-uint32_t FileSystem::blockAllocate() {
-    bool isStackEmpty = stack->empty();
-    if (isStackEmpty) {
-        auto blocks = stack->getBlocks();
-        systemInfo.freeBlockStackTop++;
-        systemInfo.freeBlockStackOffset = 0;
-        disk->seekStart(systemInfo.freeBlockStackTop * blockSize);
-        disk->read(reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack->getMaxSize());
-        stack->setStackTop(systemInfo.freeBlockStackOffset);
+std::mutex &FileSystem::getLock() {
+    return lock;
+}
+
+void FileSystem::fillDirentModes() {
+    //只记录了文件类型的变长目录项，逐项从子项的i节点补上权限摘要
+    std::vector<inodeno_t> pending{systemInfo.rootLocation};
+    std::set<inodeno_t> visited;
+    while (!pending.empty()) {
+        inodeno_t dir = pending.back();
+        pending.pop_back();
+        if (!visited.insert(dir).second) {
+            continue;
+        }
+        DirectoryFile directory(this, dir);
+        std::vector<std::pair<uint32_t, inodeno_t>> children;
+        directory.forEach([&](uint32_t pos, const Dirent &item) {
+            children.emplace_back(pos, item.inodeIndex);
+            if (item.fileType == FileType::DIRECTORY && item.name != "." && item.name != "..") {
+                pending.push_back(item.inodeIndex);
+            }
+            return true;
+        });
+        for (auto &child : children) {
+            INode iNode{};
+            readINode(child.second, iNode);
+            directory.setMode(child.first, iNode.flag & 0x3F);
+        }
     }
-    uint32_t ret = stack->getBlock();
-    systemInfo.freeBlockStackOffset++;
+    systemInfo.features |= FEATURE_DIRENT_MODE;
     systemInfo.flag = 1;
-    systemInfo.freeBlockNumber--;
+    update();
+    std::cout << "directory entries filled with permission bits (" << visited.size() << " directories)" << std::endl;
+}
+
+void FileSystem::pinRoot() {
+    if (cache == nullptr) {
+        return;
+    }
+    //根目录在每次路径解析时都会被访问，常驻缓存
+    blockno_t bno;
+    uint16_t offset;
+    if (!locateINode(systemInfo.rootLocation, bno, offset)) {
+        return;
+    }
+    cache->pin(bno);
+    cache->pin(DirectoryFile(this, systemInfo.rootLocation).blockAt(0));
+}
+
+void FileSystem::writeHeader() {
+    //扩展标记(4)+未格式化标记(1)+块大小(2)+64位容量(8)+超级块，一次写入
+    char header[DISK_HEADER_SIZE + sizeof(FileSystemInfo)];
+    uint32_t extended = DISK_CAPACITY_EXTENDED;
+    std::memcpy(header, &extended, sizeof extended);
+    std::memcpy(header + 4, &isUnformatted, sizeof isUnformatted);
+    std::memcpy(header + 5, &blockSize, sizeof blockSize);
+    std::memcpy(header + 7, &capacity, sizeof capacity);
+    std::memcpy(header + DISK_HEADER_SIZE, &systemInfo, sizeof systemInfo);
+    //经由块缓存写入，回写模式下频繁的超级块更新被合并
+    write(0, 0, header, sizeof header);
+}
+
+uint64_t FileSystem::blockOffset(blockno_t bno) {
+    return static_cast<uint64_t>(bno) * blockSize;
+}
+
+BlockAllocator *FileSystem::createAllocator(AllocatorKind kind) {
+    if (kind == AllocatorKind::BITMAP) {
+        return new BitmapAllocator(this, systemInfo, blockSize, capacity / blockSize);
+    }
+    if (kind == AllocatorKind::GROUPS) {
+        return new GroupAllocator(this, systemInfo, blockSize, capacity / blockSize);
+    }
+    return new StackAllocator(this, systemInfo, blockSize, capacity / blockSize);
+}
+
+//空闲块计数与修改标记原子更新，分配组管理器下不同线程可以同时分配与回收不同组中的块
+blockno_t FileSystem::blockAllocate(blockno_t goal) {
+    if (__atomic_load_n(&systemInfo.freeBlockNumber, __ATOMIC_RELAXED) <= reservedBlocks) {
+        return 0;
+    }
+    blockno_t ret = allocator->allocate(goal);
+    if (ret != 0) {
+        __atomic_store_n(&systemInfo.flag, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&systemInfo.freeBlockNumber, 1, __ATOMIC_RELAXED);
+        cancelDiscard(&ret, 1);
+    }
     return ret;
 }
 
-void FileSystem::blockFree(uint32_t bno) {
-    bool isStackFull = stack->full();
-    if (isStackFull) {
-        auto blocks = stack->getBlocks();
-        disk->seekStart(systemInfo.freeBlockStackTop * blockSize);
-        disk->write(reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack->getMaxSize());
-        systemInfo.freeBlockStackTop--;
-        systemInfo.freeBlockStackOffset = stack->getMaxSize();
-        stack->setStackTop(systemInfo.freeBlockStackOffset);
+void FileSystem::blockFree(blockno_t bno) {
+    if (!allocator->free(bno)) {
+        return;
+    }
+    __atomic_fetch_add(&systemInfo.freeBlockNumber, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&systemInfo.flag, 1, __ATOMIC_RELAXED);
+    queueDiscard(&bno, 1);
+}
+
+uint32_t FileSystem::blockAllocateN(uint32_t count, blockno_t *out, blockno_t goal) {
+    //预留给延迟分配的块不参与分配
+    uint32_t free = __atomic_load_n(&systemInfo.freeBlockNumber, __ATOMIC_RELAXED);
+    count = std::min(count, free - std::min(free, reservedBlocks));
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t n = allocator->allocateN(count, out, goal);
+    if (n != 0) {
+        __atomic_store_n(&systemInfo.flag, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&systemInfo.freeBlockNumber, n, __ATOMIC_RELAXED);
+        cancelDiscard(out, n);
+    }
+    return n;
+}
+
+void FileSystem::blockFreeN(const blockno_t *bnos, uint32_t count) {
+    uint32_t n = allocator->freeN(bnos, count);
+    if (n != 0) {
+        __atomic_fetch_add(&systemInfo.freeBlockNumber, n, __ATOMIC_RELAXED);
+        __atomic_store_n(&systemInfo.flag, 1, __ATOMIC_RELAXED);
+        queueDiscard(bnos, count);
+    }
+}
+
+bool FileSystem::compactFree() {
+    if (!allocator->compact()) {
+        return false;
     }
-    stack->revokeBlock(bno);
-    systemInfo.freeBlockNumber++;
     systemInfo.flag = 1;
+    return true;
 }
 
-void FileSystem::read(uint32_t bno, uint16_t offset, char *buf, uint16_t sz) {
-    uint32_t base = bno * blockSize;
-    disk->seekStart(base + offset);
-    disk->read(buf, sz);
+blockno_t FileSystem::directoryGoal() {
+    return allocator->spreadGoal();
 }
 
-void FileSystem::write(uint32_t bno, uint16_t offset, const char *buf, uint16_t sz) {
-    uint32_t base = bno * blockSize;
-    disk->seekStart(base + offset);
-    disk->write(buf, sz);
+bool FileSystem::reserveBlocks(uint32_t count) {
+    if (systemInfo.freeBlockNumber < reservedBlocks || systemInfo.freeBlockNumber - reservedBlocks < count) {
+        return false;
+    }
+    reservedBlocks += count;
+    return true;
+}
+
+void FileSystem::unreserveBlocks(uint32_t count) {
+    reservedBlocks -= std::min(count, reservedBlocks);
+}
+
+uint32_t FileSystem::getReservedBlocks() {
+    return reservedBlocks;
+}
+
+void FileSystem::resetDiscard() {
+    std::lock_guard<std::mutex> guard(discardLock);
+    size_t words = (capacity / blockSize + 63) / 64;
+    pendingDiscard.assign(words, 0);
+    discarded.assign(words, 0);
+    pendingCount = 0;
+    discardedCount = 0;
+}
+
+//位图的单个字用原子操作修改，分配组管理器下回收与写入可能来自不同线程
+void FileSystem::queueDiscard(const blockno_t *bnos, uint32_t count) {
+    if (!discardOnFree) {
+        return;
+    }
+    uint32_t added = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (bnos[i] == 0 || bnos[i] / 64 >= pendingDiscard.size()) {
+            continue;
+        }
+        uint64_t bit = 1ull << (bnos[i] % 64);
+        if (!(__atomic_fetch_or(&pendingDiscard[bnos[i] / 64], bit, __ATOMIC_RELAXED) & bit)) {
+            added++;
+        }
+    }
+    if (__atomic_add_fetch(&pendingCount, added, __ATOMIC_RELAXED) >= DISCARD_BATCH_BLOCKS) {
+        flushDiscard();
+    }
 }
 
-bool FileSystem::createDisk(uint32_t sz) {
-    bool ok = disk->init(sz);
+void FileSystem::cancelDiscard(const blockno_t *bnos, uint32_t count) {
+    if (__atomic_load_n(&pendingCount, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    //持有discardLock，正在打洞的批次要么已经清除了这些块，要么在它们被清除之后才扫描
+    std::lock_guard<std::mutex> guard(discardLock);
+    uint32_t removed = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (bnos[i] / 64 >= pendingDiscard.size()) {
+            continue;
+        }
+        uint64_t bit = 1ull << (bnos[i] % 64);
+        if (__atomic_fetch_and(&pendingDiscard[bnos[i] / 64], ~bit, __ATOMIC_RELAXED) & bit) {
+            removed++;
+        }
+    }
+    __atomic_sub_fetch(&pendingCount, removed, __ATOMIC_RELAXED);
+}
+
+uint32_t FileSystem::flushDiscard() {
+    std::lock_guard<std::mutex> guard(discardLock);
+    uint32_t ranges = 0;
+    uint32_t n = punch(pendingDiscard, ranges);
+    __atomic_store_n(&pendingCount, 0, __ATOMIC_RELAXED);
+    return n;
+}
+
+uint32_t FileSystem::trim(uint32_t &ranges) {
+    std::lock_guard<std::mutex> guard(discardLock);
+    //所有空闲块中跳过已经打过洞的，等待打洞的块都是空闲块，随之一并打洞
+    std::vector<uint64_t> bits(discarded.size(), 0);
+    allocator->collectFree(bits);
+    for (size_t w = 0; w < bits.size(); ++w) {
+        bits[w] &= ~__atomic_load_n(&discarded[w], __ATOMIC_RELAXED);
+        __atomic_store_n(&pendingDiscard[w], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&pendingCount, 0, __ATOMIC_RELAXED);
+    return punch(bits, ranges);
+}
+
+uint32_t FileSystem::punch(std::vector<uint64_t> &bits, uint32_t &ranges) {
+    uint32_t total = 0;
+    uint64_t limit = bits.size() * 64;
+    uint64_t pos = 0;
+    ranges = 0;
+    while (pos < limit) {
+        //整个字为0时一次跳过64块
+        uint64_t word = __atomic_load_n(&bits[pos / 64], __ATOMIC_RELAXED) >> (pos % 64);
+        if (word == 0) {
+            pos = (pos / 64 + 1) * 64;
+            continue;
+        }
+        pos += __builtin_ctzll(word);
+        uint64_t start = pos;
+        while (pos < limit && (bits[pos / 64] & (1ull << (pos % 64)))) {
+            pos++;
+        }
+        uint32_t n = static_cast<uint32_t>(pos - start);
+        //先丢弃缓存中的块，回写线程不会再把旧数据写回洞中
+        if (cache != nullptr) {
+            cache->discard(start, n);
+        }
+        if (!disk->discard(blockOffset(start), static_cast<uint64_t>(n) * blockSize)) {
+            break;
+        }
+        for (uint64_t b = start; b < pos; ++b) {
+            __atomic_fetch_or(&discarded[b / 64], 1ull << (b % 64), __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&discardedCount, n, __ATOMIC_RELAXED);
+        total += n;
+        ranges++;
+    }
+    std::fill(bits.begin(), bits.end(), 0);
+    return total;
+}
+
+bool FileSystem::isDiscarded(blockno_t bno) {
+    return __atomic_load_n(&discardedCount, __ATOMIC_RELAXED) != 0 && bno / 64 < discarded.size() &&
+           (__atomic_load_n(&discarded[bno / 64], __ATOMIC_RELAXED) & (1ull << (bno % 64)));
+}
+
+void FileSystem::clearDiscarded(blockno_t bno, uint32_t n) {
+    if (__atomic_load_n(&discardedCount, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+    uint32_t removed = 0;
+    for (uint64_t b = bno; b < static_cast<uint64_t>(bno) + n && b / 64 < discarded.size(); ++b) {
+        uint64_t bit = 1ull << (b % 64);
+        if (__atomic_fetch_and(&discarded[b / 64], ~bit, __ATOMIC_RELAXED) & bit) {
+            removed++;
+        }
+    }
+    __atomic_sub_fetch(&discardedCount, removed, __ATOMIC_RELAXED);
+}
+
+uint32_t FileSystem::getPendingDiscard() {
+    return pendingCount;
+}
+
+uint32_t FileSystem::getDiscardedBlocks() {
+    return discardedCount;
+}
+
+uint64_t FileSystem::getFootprint() {
+    return disk->footprint();
+}
+
+void FileSystem::read(blockno_t bno, uint16_t offset, char *buf, uint16_t sz) {
+    //打过洞的块内容为全0，不访问磁盘
+    if (isDiscarded(bno)) {
+        std::memset(buf, 0, sz);
+        return;
+    }
+    if (cache != nullptr) {
+        cache->read(bno, offset, buf, sz);
+        return;
+    }
+    disk->readAt(blockOffset(bno) + offset, buf, sz);
+}
+
+void FileSystem::write(blockno_t bno, uint16_t offset, const char *buf, uint16_t sz) {
+    if (isDiscarded(bno)) {
+        clearDiscarded(bno, 1);
+        if (cache != nullptr && sz < blockSize) {
+            //洞中的块内容为全0，拼成整块写入缓存，不必先从磁盘读入旧数据
+            std::vector<char> block(blockSize, 0);
+            std::memcpy(block.data() + offset, buf, sz);
+            cache->write(bno, 0, block.data(), blockSize);
+            return;
+        }
+    }
+    if (cache != nullptr) {
+        cache->write(bno, offset, buf, sz);
+        return;
+    }
+    disk->writeAt(blockOffset(bno) + offset, buf, sz);
+}
+
+void FileSystem::prefetch(const std::vector<blockno_t> &bnos) {
+    //映射模式下由内核负责预读；打过洞的块读取时不访问磁盘，不需要预读
+    if (cache == nullptr) {
+        return;
+    }
+    if (discardedCount == 0) {
+        cache->prefetch(bnos);
+        return;
+    }
+    std::vector<blockno_t> wanted;
+    for (blockno_t bno : bnos) {
+        if (!isDiscarded(bno)) {
+            wanted.push_back(bno);
+        }
+    }
+    cache->prefetch(wanted);
+}
+
+void FileSystem::readRun(blockno_t bno, uint32_t n, char *buf) {
+    if (discardedCount != 0) {
+        //打过洞的块填0，其余连续的块仍合并读取
+        uint32_t i = 0;
+        while (i < n) {
+            uint32_t j = i;
+            bool hole = isDiscarded(bno + i);
+            while (j < n && isDiscarded(bno + j) == hole) {
+                j++;
+            }
+            if (hole) {
+                std::memset(buf + static_cast<size_t>(i) * blockSize, 0, static_cast<size_t>(j - i) * blockSize);
+            } else if (cache != nullptr) {
+                cache->readRun(bno + i, j - i, buf + static_cast<size_t>(i) * blockSize);
+            } else {
+                disk->readAt(blockOffset(bno + i), buf + static_cast<size_t>(i) * blockSize, (j - i) * blockSize);
+            }
+            i = j;
+        }
+        return;
+    }
+    if (cache != nullptr) {
+        cache->readRun(bno, n, buf);
+        return;
+    }
+    disk->readAt(blockOffset(bno), buf, n * blockSize);
+}
+
+void FileSystem::writeRun(blockno_t bno, uint32_t n, const char *buf) {
+    clearDiscarded(bno, n);
+    if (cache != nullptr) {
+        cache->writeRun(bno, n, buf);
+        return;
+    }
+    disk->writeAt(blockOffset(bno), buf, n * blockSize);
+}
+
+bool FileSystem::createDisk(uint64_t sz, bool preallocate) {
+    bool ok = disk->init(sz, preallocate);
     return ok;
 }
 
+void FileSystem::readBlocks(blockno_t bno, uint32_t n, char *buf) {
+    disk->readAt(blockOffset(bno), buf, n * blockSize);
+}
+
+void FileSystem::writeBlocks(blockno_t bno, uint32_t n, const char *buf) {
+    clearDiscarded(bno, n);
+    disk->writeAt(blockOffset(bno), buf, n * blockSize);
+}
+
 void FileSystem::readNext(char *buf, uint16_t sz) {
     disk->read(buf, sz);
 }
@@ -210,9 +1075,12 @@ void FileSystem::writeNext(char *buf, uint16_t sz) {
     disk->write(buf, sz);
 }
 
-void FileSystem::locale(uint32_t bno, uint16_t offset) {
-    uint32_t base = bno * blockSize;
-    disk->seekStart(base + offset);
+void FileSystem::locale(blockno_t bno, uint16_t offset) {
+    disk->seekStart(blockOffset(bno) + offset);
+}
+
+bool FileSystem::isFormatted() {
+    return isOpen && isUnformatted == 0;
 }
 
 void FileSystem::revokeInstance() {
@@ -224,21 +1092,73 @@ void FileSystem::update() {
     if (systemInfo.flag == 1) {
         systemInfo.flag = 0;
         //写入基础信息
-        disk->seekStart(sizeof(capacity));
-        disk->write(reinterpret_cast<char *>(&isUnformatted), sizeof isUnformatted);
-        disk->write(reinterpret_cast<char *>(&blockSize), sizeof blockSize);
-        disk->write(reinterpret_cast<char *>(&systemInfo), sizeof(systemInfo));
-        //写入空闲块栈信息
-        auto blocks = stack->getBlocks();
-        disk->seekStart(systemInfo.freeBlockStackTop * blockSize);
-        disk->write(reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack->getMaxSize());
+        writeHeader();
+        //写入空闲空间管理结构
+        allocator->flush();
+    }
+    disk->commit();
+}
+
+void FileSystem::sync() {
+    if (pendingCount != 0) {
+        flushDiscard();
+    }
+    update();
+    if (cache != nullptr) {
+        cache->flush();
     }
+    disk->sync();
 }
 
-uint32_t FileSystem::getRootLocation() {
+void FileSystem::onFileClose() {
+    if (cache != nullptr && cache->getDurability() == Durability::ON_CLOSE) {
+        sync();
+    }
+}
+
+const DiskStat &FileSystem::getDiskStat() {
+    return disk->getStat();
+}
+
+void FileSystem::resetDiskStat() {
+    disk->resetStat();
+    if (cache != nullptr) {
+        cache->resetStat();
+    }
+    dentries.resetStat();
+}
+
+CacheStat FileSystem::getCacheStat() {
+    if (cache == nullptr) {
+        return CacheStat{};
+    }
+    return cache->getStat();
+}
+
+DentryCache *FileSystem::getDentryCache() {
+    return &dentries;
+}
+
+uint32_t FileSystem::getCacheCapacity() {
+    return cache == nullptr ? 0 : cache->getCapacity();
+}
+
+uint32_t FileSystem::getCacheDirty() {
+    return cache == nullptr ? 0 : cache->getDirtyCount();
+}
+
+inodeno_t FileSystem::getRootINode() {
     return systemInfo.rootLocation;
 }
 
+FileLayout FileSystem::getFileLayout() {
+    return fileLayout;
+}
+
+uint32_t FileSystem::getFreeBlockNumber() {
+    return systemInfo.freeBlockNumber;
+}
+
 uint8_t FileSystem::userVerify(std::string &userName, std::string &password) {
     uint8_t verify = 0;
     for (uint8_t i = 0; i < 8; ++i) {
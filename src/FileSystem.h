@@ -6,11 +6,33 @@
 #include <iostream>
 #include <cstdint>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <set>
+#include <map>
+#include <mutex>
 #include "DiskDriver.h"
+#include "BufferCache.h"
+#include "BlockAllocator.h"
+#include "DentryCache.h"
+#include "Reclaimer.h"
 #include "./entity/FileSystemInfo.h"
 #include "./entity/INode.h"
 #include "./entity/Directory.h"
-#include "./entity/FreeBlockStack.h"
+
+/*
+ * @brief 挂载选项，在挂载时选择磁盘后端等运行参数
+ */
+struct MountOptions {
+    DiskMode diskMode = DiskMode::POSITIONAL;       //磁盘后端
+    SyncPolicy syncPolicy = SyncPolicy::ON_UPDATE;  //MAPPED后端的脏页写回策略
+    uint32_t cacheBlocks = 1024;                    //块缓存容量（块数），0表示不使用缓存；MAPPED后端直接使用映射，不经过块缓存
+    WriteBackPolicy writeBack;                      //块缓存的持久化模式与回写参数
+    AllocatorKind allocator = AllocatorKind::STACK; //格式化时使用的空闲空间管理方式，挂载已有磁盘时以超级块记录的为准
+    FileLayout layout = FileLayout::EXTENT;         //新建文件先内联在i节点中，超出后转换成的块映射方式；已有文件保持各自的方式
+    bool delayedAllocation = false;                 //延迟分配：写入文件末尾之后的数据先在内存中积攒并预留空间，写出时才一次选定物理块
+    bool discard = false;                           //回收的块积攒到DISCARD_BATCH_BLOCKS个后在磁盘文件上打洞，归还宿主机的存储空间
+};
 
 /*
  * @brief 基本文件系统，实现对于文件的管理
@@ -20,18 +42,53 @@ class FileSystem {
 public:
     static FileSystem *getInstance();
     static void revokeInstance();
-    bool createDisk(uint32_t sz);       //创建一个指定大小的磁盘，单位为Byte
+    bool createDisk(uint64_t sz, bool preallocate = false);   //创建一个指定大小的磁盘，单位为Byte，preallocate为真时预分配空间而不是稀疏文件
     bool format(uint16_t bsize);        //指定块大小，进行格式化，单位Byte
-    bool mount();                       //尝试挂载硬盘，若挂载失败则需要格式化
+    bool mount(const MountOptions &options = MountOptions());   //以指定挂载选项尝试挂载硬盘，若挂载失败且未格式化则需要格式化
+    void unmount();                     //写回超级块、空闲空间管理结构与缓存中的脏块后关闭磁盘，回收线程保留；调用者持有文件系统锁
+    bool remount(const MountOptions &options);  //卸载后以新的挂载选项重新挂载同一磁盘，调用者保证没有打开的文件
+    const MountOptions &getMountOptions();      //最近一次挂载使用的挂载选项
+    bool isFormatted();                 //磁盘已打开且已格式化；此时挂载失败说明旧格式升级因空间不足没有完成，磁盘保持未升级部分的原样
 
-    uint32_t blockAllocate();           //分配空闲磁盘块
-    void blockFree(uint32_t bno);       //回收磁盘块
+    blockno_t blockAllocate(blockno_t goal = 0);    //分配空闲磁盘块，尽量靠近goal（0表示不指定），磁盘已满时返回0
+    void blockFree(blockno_t bno);      //回收磁盘块
+    uint32_t blockAllocateN(uint32_t count, blockno_t *out, blockno_t goal = 0);    //批量分配至多count个空闲块，尽量从goal开始连续分配，返回实际分配的块数，调用者最后统一update一次
+    void blockFreeN(const blockno_t *bnos, uint32_t count);     //批量回收磁盘块，调用者最后统一update一次
+    bool compactFree();                 //整理空闲空间的管理结构，使之后的分配尽量得到连续的块，返回是否做了整理
+    blockno_t directoryGoal();          //新目录第一块的期望位置，分配组管理时为空闲块最多的组，其余方式不指定
+    bool reserveBlocks(uint32_t count);     //为延迟分配预留count个空闲块，不足时返回false；预留的块只在内存中记账，其他分配不会占用
+    void unreserveBlocks(uint32_t count);   //取消预留，分配预留的块之前先取消
+    uint32_t getReservedBlocks();           //已预留的块数
+    uint32_t flushDiscard();                //把积攒的已回收块立即打洞，返回打洞的块数
+    uint32_t trim(uint32_t &ranges);        //对所有尚未打洞的空闲块打洞，返回打洞的块数，ranges为打洞的段数
+    uint32_t getPendingDiscard();           //已回收、等待打洞的块数
+    uint32_t getDiscardedBlocks();          //已打洞且之后没有写入过的块数
+    uint64_t getFootprint();                //磁盘文件在宿主机上实际占用的字节数
 
-    void read(uint32_t bno, uint16_t offset, char *buf, uint16_t sz);    //从磁盘块bno偏移offset开始读sz字节到缓冲区buf
-    void write(uint32_t bno, uint16_t offset, const char *buf, uint16_t sz);   //从磁盘块bno偏移offset开始覆盖写入缓冲区buf开始sz字节
+    void read(blockno_t bno, uint16_t offset, char *buf, uint16_t sz);    //从磁盘块bno偏移offset开始读sz字节到缓冲区buf
+    void write(blockno_t bno, uint16_t offset, const char *buf, uint16_t sz);   //从磁盘块bno偏移offset开始覆盖写入缓冲区buf开始sz字节
+    void readRun(blockno_t bno, uint32_t n, char *buf);             //连续读取从bno开始的n个整块，未缓存的部分合并为一次磁盘读
+    void writeRun(blockno_t bno, uint32_t n, const char *buf);      //连续覆盖写入从bno开始的n个整块
+    void readBlocks(blockno_t bno, uint32_t n, char *buf);          //绕过块缓存连续读取从bno开始的n个整块，仅用于挂载时读入管理结构
+    void writeBlocks(blockno_t bno, uint32_t n, const char *buf);   //绕过块缓存连续写入从bno开始的n个整块，仅用于格式化
     void readNext(char *buf, uint16_t sz);      //从当前位置继续读取数据
     void writeNext(char *buf, uint16_t sz);     //从当前位置继续写入数据
-    void locale(uint32_t bno, uint16_t offset);     //将读写头移动到bno磁盘块的offset偏移
+    void locale(blockno_t bno, uint16_t offset);    //将读写头移动到bno磁盘块的offset偏移
+    void prefetch(const std::vector<blockno_t> &bnos);    //异步预读磁盘块到块缓存，未启用缓存时不做任何事
+    template<class T>
+    const T *view(blockno_t bno, T &fallback);      //获取bno磁盘块开头的只读视图，映射模式下不拷贝，否则读入fallback
+
+    bool readINode(inodeno_t ino, INode &iNode);            //读取ino号i节点，i节点号无效时返回false
+    void writeINode(inodeno_t ino, const INode &iNode);     //写入ino号i节点
+    void readINodes(const std::vector<inodeno_t> &inos, std::vector<INode> &iNodes);   //批量读取inos中的i节点，所在的i节点表块每块只读一次，无效的i节点号得到清零的记录
+    const INode *viewINode(inodeno_t ino, INode &fallback); //获取ino号i节点的只读视图，映射模式下不拷贝，否则读入fallback；i节点号无效时返回nullptr
+    inodeno_t allocINode();             //分配一个空闲i节点，记录清零且links为1；i节点表已满且无法扩展时返回0，调用者最后统一update一次
+    void freeINode(inodeno_t ino);      //回收i节点，记录清零
+    void orphan(const Dirent &item);    //把已从目录中删除的目录项指向的i节点交给回收线程，调用者持有文件系统锁
+    inodeno_t getOrphanDirectory();     //孤儿目录的i节点号，0表示没有
+    uint32_t getOrphanCount();          //等待回收的孤儿数
+    uint64_t getReclaimedBlocks();      //回收线程累计归还的块数
+    std::mutex &getLock();              //文件系统锁，Shell执行每条命令与回收线程回收每一批时持有
 
     uint8_t userVerify(std::string &userName, std::string &password);     //用户身份认证,若认证成功返回非0的uid，否则返回0
     bool grantTrustUser(std::string currentUser, std::string targetUser);  //添加信任用户组
@@ -39,23 +96,82 @@ public:
     uint8_t verifyTrustUser(uint8_t currentUserUid,uint8_t targetUserUid);  //查询对于current来说target是否为信任用户，1为信任0为不信任
     void getUser(uint8_t uid, User *user);         //根据uid读取用户信息
 
-    uint32_t getRootLocation();         //读取根目录所在磁盘块
+    inodeno_t getRootINode();           //根目录的i节点号
+    FileLayout getFileLayout();         //内联文件超出i节点后转换成的块映射方式
+    uint32_t getFreeBlockNumber();      //空闲块个数
     void update();                      //更新信息
+    void sync();                        //提交元数据并把缓存中的脏块全部写回、落盘
+    void onFileClose();                 //文件关闭时调用，ON_CLOSE持久化模式下执行sync
+    const DiskStat &getDiskStat();      //读取磁盘读写统计
+    void resetDiskStat();               //清空磁盘读写统计与缓存统计
+    CacheStat getCacheStat();           //读取块缓存统计，未启用缓存时全为0
+    DentryCache *getDentryCache();      //目录项缓存
+    uint32_t getCacheCapacity();        //块缓存容量（块数），未启用缓存时为0
+    uint32_t getCacheDirty();           //块缓存中尚未写回的脏块数
 
     ~FileSystem();
 
 private:
     static FileSystem *instance;
     DiskDriver *disk;           //虚拟磁盘对象
-    uint32_t capacity;          //读取到的磁盘容量
+    uint64_t capacity;          //读取到的磁盘容量
     int8_t isUnformatted;       //未格式化标记，-1未格式化，0已经格式化
     uint16_t blockSize;         //块大小
     bool isOpen;                //磁盘是否打开标记
+    MountOptions mountOptions;  //最近一次挂载使用的挂载选项
     FileSystemInfo systemInfo;  //文件系统超级块
-    FreeBlockStack *stack;      //空闲块栈，使用指针是为了防止写入硬盘时占用空间
+    BlockAllocator *allocator;  //空闲空间管理器，格式化或挂载后才存在
+    AllocatorKind formatAllocator;  //下一次格式化时使用的空闲空间管理方式
+    uint32_t reservedBlocks;    //延迟分配预留的空闲块数
+    bool discardOnFree;         //回收块时积攒起来批量打洞
+    std::vector<uint64_t> pendingDiscard;   //已回收、尚未打洞的块，每位对应一个块，重新分配时清除
+    uint32_t pendingCount;      //pendingDiscard中置位的块数
+    std::vector<uint64_t> discarded;        //已打洞且之后没有写入过的块，读取时直接得到全0而不访问磁盘
+    uint32_t discardedCount;    //discarded中置位的块数，为0时读写不检查位图
+    std::mutex discardLock;     //批量打洞与取消等待打洞的块互斥，避免刚分配出去的块被打洞
+    BufferCache *cache;         //块缓存，为nullptr时直接读写磁盘
+    DentryCache dentries;       //目录项缓存，按名字查找时先查这里
+    Reclaimer *reclaimer;       //后台回收线程，格式化或挂载后才存在
+    std::mutex lock;            //文件系统锁
+    FileLayout fileLayout;      //内联文件超出i节点后转换成的块映射方式
+    std::vector<blockno_t> inodeBlocks;     //i节点表各块所在的磁盘块，由i节点表的块映射展开，定位i节点不需要读映射
     FileSystem();
+    uint64_t blockOffset(blockno_t bno);        //磁盘块bno起始处的64位字节偏移
+    BlockAllocator *createAllocator(AllocatorKind kind);   //按当前块大小与容量创建空闲空间管理器
+    void writeHeader();                         //将磁盘头部（64位格式）与超级块一次写入0号块
+    void pinRoot();                             //将根目录i节点与根目录项所在块钉在缓存中
+    void upgradeLegacy();                       //将32位旧格式的磁盘原地升级为64位格式
+    void upgradeINodes(bool legacy);            //将所有i节点原地改写为带块映射方式的INODE_SIZE字节格式，legacy为真时旧i节点为32位格式
+    void upgradeINode(blockno_t inodeDisk, bool legacy, std::set<blockno_t> &visited);   //升级inodeDisk处的i节点，目录则递归升级其子项
+    bool locateINode(inodeno_t ino, blockno_t &bno, uint16_t &offset);     //ino号i节点所在的磁盘块与块内偏移，i节点号无效时返回false
+    void loadINodeTable();                      //展开i节点表的块映射
+    uint32_t growINodeTable(uint32_t blocks);   //为i节点表追加至多blocks个清零的块，返回实际追加的块数
+    bool migrateINodeTable();                   //将每个i节点独占一块的磁盘迁移为i节点表格式，空间不足时磁盘保持原样并返回false
+    void countLegacyINodes(blockno_t inodeDisk, std::set<blockno_t> &reachable);   //只读地收集从inodeDisk可达的每块一个的旧i节点
+    inodeno_t migrateINode(blockno_t inodeDisk, inodeno_t parent, std::map<blockno_t, inodeno_t> &moved,
+                           std::map<blockno_t, Directory> &rewrites);   //把inodeDisk处的i节点搬入i节点表，目录则递归搬移子项，改写后的目录块记入rewrites；返回新的i节点号，失败返回0
+    bool migrateDirents();                      //把所有定长目录项的目录转换为变长目录项，空间不足时全部目录保持原样并返回false
+    void fillDirentModes();                     //为只记录了文件类型的变长目录项补上权限摘要
+    void createOrphanDirectory();               //建立孤儿目录并记入超级块，失败时超级块中为0
+    void startReclaimer();                      //启动回收线程，已经启动时重新统计孤儿数
+    void resetDiscard();                        //按磁盘总块数重建打洞用的位图，格式化与挂载时调用
+    void queueDiscard(const blockno_t *bnos, uint32_t count);   //记下已回收的块，积攒到DISCARD_BATCH_BLOCKS个时打洞
+    void cancelDiscard(const blockno_t *bnos, uint32_t count);  //块被重新分配，不再等待打洞
+    uint32_t punch(std::vector<uint64_t> &bits, uint32_t &ranges);  //按bits中连续置位的段打洞并清空bits，返回打洞的块数；调用者持有discardLock
+    bool isDiscarded(blockno_t bno);            //bno是否已打洞且之后没有写入过
+    void clearDiscarded(blockno_t bno, uint32_t n);     //[bno,bno+n)被写入，不再是洞
 
 };
 
 
+template<class T>
+const T *FileSystem::view(blockno_t bno, T &fallback) {
+    const char *p = disk->view(blockOffset(bno), sizeof(T));
+    if (p != nullptr) {
+        return reinterpret_cast<const T *>(p);
+    }
+    read(bno, 0, reinterpret_cast<char *>(&fallback), sizeof(T));
+    return &fallback;
+}
+
 #endif //FILESYSTEM_FILESYSTEM_H
@@ -0,0 +1,372 @@
+
+
+#include "GroupAllocator.h"
+#include "FileSystem.h"
+
+GroupAllocator::GroupAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks)
+        : fs(fs), info(info), blockSize(blockSize), totalBlocks(totalBlocks), lastGroup(0) {
+    groupCount = (totalBlocks + ALLOC_GROUP_BLOCKS - 1) / ALLOC_GROUP_BLOCKS;
+    descriptorBlocks = (groupCount * sizeof(GroupDescriptor) + blockSize - 1) / blockSize;
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        groups.emplace_back(new Group);
+        groups[g]->words.assign(ALLOC_GROUP_BLOCKS / 64, 0);
+        groups[g]->freeBlocks = 0;
+        groups[g]->hint = 0;
+        groups[g]->dirty = false;
+    }
+}
+
+uint32_t GroupAllocator::layout(uint32_t total) {
+    uint64_t count = (total + ALLOC_GROUP_BLOCKS - 1) / ALLOC_GROUP_BLOCKS;
+    uint64_t descriptors = (count * sizeof(GroupDescriptor) + blockSize - 1) / blockSize;
+    uint64_t bitmaps = (count * (ALLOC_GROUP_BLOCKS / 8) + blockSize - 1) / blockSize;
+    return descriptors + bitmaps;
+}
+
+void GroupAllocator::format(uint32_t total, blockno_t firstFree) {
+    //每组先全部空闲，再把引导块与管理结构、超出磁盘的位置为占用，管理结构都在第0组开头
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        Group &group = *groups[g];
+        std::fill(group.words.begin(), group.words.end(), 0);
+        group.freeBlocks = ALLOC_GROUP_BLOCKS;
+        group.hint = 0;
+        uint64_t end = static_cast<uint64_t>(g + 1) * ALLOC_GROUP_BLOCKS;
+        if (end > total) {
+            uint32_t valid = total - g * ALLOC_GROUP_BLOCKS;
+            setRange(group, valid, ALLOC_GROUP_BLOCKS - valid, true);
+        }
+    }
+    for (blockno_t b = 0; b < firstFree; b += ALLOC_GROUP_BLOCKS) {
+        uint32_t g = groupOf(b);
+        setRange(*groups[g], 0, std::min<uint32_t>(ALLOC_GROUP_BLOCKS, firstFree - b), true);
+        groups[g]->hint = std::min<uint32_t>(ALLOC_GROUP_BLOCKS, firstFree - b) % ALLOC_GROUP_BLOCKS;
+    }
+
+    //描述符表与位图各拼成整块后按批顺序写入，绕过块缓存
+    std::vector<char> descriptors(static_cast<size_t>(descriptorBlocks) * blockSize, 0);
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        GroupDescriptor d{groups[g]->freeBlocks.load()};
+        std::memcpy(descriptors.data() + g * sizeof d, &d, sizeof d);
+    }
+    fs->writeBlocks(1, descriptorBlocks, descriptors.data());
+    uint32_t bitmapBlocks = layout(total) - descriptorBlocks;
+    std::vector<char> bitmaps(static_cast<size_t>(bitmapBlocks) * blockSize, 0);
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        std::memcpy(bitmaps.data() + static_cast<size_t>(g) * (ALLOC_GROUP_BLOCKS / 8), groups[g]->words.data(),
+                    ALLOC_GROUP_BLOCKS / 8);
+        groups[g]->dirty = false;
+    }
+    const uint32_t batch = 64;
+    for (uint32_t k = 0; k < bitmapBlocks; k += batch) {
+        uint32_t n = std::min(batch, bitmapBlocks - k);
+        fs->writeBlocks(1 + descriptorBlocks + k, n, bitmaps.data() + static_cast<size_t>(k) * blockSize);
+    }
+    lastGroup = groupOf(firstFree < total ? firstFree : 0);
+}
+
+void GroupAllocator::load() {
+    std::vector<char> descriptors(static_cast<size_t>(descriptorBlocks) * blockSize);
+    fs->readBlocks(1, descriptorBlocks, descriptors.data());
+    uint32_t bitmapBlocks = layout(totalBlocks) - descriptorBlocks;
+    std::vector<char> bitmaps(static_cast<size_t>(bitmapBlocks) * blockSize);
+    const uint32_t batch = 64;
+    for (uint32_t k = 0; k < bitmapBlocks; k += batch) {
+        uint32_t n = std::min(batch, bitmapBlocks - k);
+        fs->readBlocks(1 + descriptorBlocks + k, n, bitmaps.data() + static_cast<size_t>(k) * blockSize);
+    }
+    uint64_t sum = 0;
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        Group &group = *groups[g];
+        std::memcpy(group.words.data(), bitmaps.data() + static_cast<size_t>(g) * (ALLOC_GROUP_BLOCKS / 8),
+                    ALLOC_GROUP_BLOCKS / 8);
+        GroupDescriptor d{};
+        std::memcpy(&d, descriptors.data() + g * sizeof d, sizeof d);
+        group.freeBlocks = d.freeBlocks;
+        group.hint = 0;
+        group.dirty = false;
+        sum += d.freeBlocks;
+    }
+    //描述符与超级块的空闲块数不一致时（上次没有正常卸载），按位图重新统计各组的空闲块数，
+    //并以位图为准改正超级块里的总空闲块数，标记超级块待写回
+    if (sum != info.freeBlockNumber) {
+        sum = 0;
+        for (uint32_t g = 0; g < groupCount; ++g) {
+            Group &group = *groups[g];
+            uint32_t used = 0;
+            for (uint64_t w : group.words) {
+                used += __builtin_popcountll(w);
+            }
+            group.freeBlocks = ALLOC_GROUP_BLOCKS - used;
+            group.dirty = true;
+            sum += group.freeBlocks;
+        }
+        info.freeBlockNumber = sum;
+        info.flag = 1;
+    }
+    lastGroup = 0;
+}
+
+blockno_t GroupAllocator::allocate(blockno_t goal) {
+    bool near = goal != 0 && goal < totalBlocks;
+    uint32_t first = near ? groupOf(goal) : lastGroup.load();
+    for (uint32_t i = 0; i < groupCount; ++i) {
+        uint32_t g = (first + i) % groupCount;
+        Group &group = *groups[g];
+        //不加锁先看计数，跳过已满的组
+        if (group.freeBlocks.load() == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(group.lock);
+        //goal所在的组从goal开始，其余组从各自上次分配的位置之后开始，到组末尾后回到组开头
+        uint32_t start = near && i == 0 ? goal - g * ALLOC_GROUP_BLOCKS : group.hint;
+        uint32_t len;
+        uint32_t pos = findRun(group, start, 1, len);
+        if (pos == NOT_FOUND) {
+            pos = findRun(group, 0, 1, len);
+        }
+        if (pos == NOT_FOUND) {
+            continue;
+        }
+        setRange(group, pos, 1, true);
+        group.hint = pos + 1;
+        setLast(g);
+        return g * ALLOC_GROUP_BLOCKS + pos;
+    }
+    return 0;
+}
+
+bool GroupAllocator::free(blockno_t bno) {
+    if (bno == 0 || bno >= totalBlocks) {
+        return false;
+    }
+    Group &group = *groups[groupOf(bno)];
+    uint32_t off = bno % ALLOC_GROUP_BLOCKS;
+    std::lock_guard<std::mutex> guard(group.lock);
+    if (!(group.words[off / 64] & (1ull << (off % 64)))) {
+        return false;
+    }
+    setRange(group, off, 1, false);
+    return true;
+}
+
+uint32_t GroupAllocator::allocateN(uint32_t count, blockno_t *out, blockno_t goal) {
+    if (count == 0) {
+        return 0;
+    }
+    bool near = goal != 0 && goal < totalBlocks;
+    uint32_t first = near ? groupOf(goal) : lastGroup.load();
+    //先找一个放得下整批的组，整批物理连续
+    for (uint32_t i = 0; i < groupCount && count <= ALLOC_GROUP_BLOCKS; ++i) {
+        uint32_t g = (first + i) % groupCount;
+        Group &group = *groups[g];
+        if (group.freeBlocks.load() < count) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(group.lock);
+        uint32_t start = near && i == 0 ? goal - g * ALLOC_GROUP_BLOCKS : group.hint;
+        uint32_t len;
+        uint32_t pos = findRun(group, start, count, len);
+        if (pos == NOT_FOUND) {
+            pos = findRun(group, 0, count, len);
+        }
+        if (pos == NOT_FOUND) {
+            continue;
+        }
+        setRange(group, pos, count, true);
+        group.hint = pos + count;
+        setLast(g);
+        for (uint32_t k = 0; k < count; ++k) {
+            out[k] = g * ALLOC_GROUP_BLOCKS + pos + k;
+        }
+        return count;
+    }
+    //没有足够长的空闲段：从goal所在的组开始逐组取出空闲段，尽量少跨组
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < groupCount && n < count; ++i) {
+        uint32_t g = (first + i) % groupCount;
+        Group &group = *groups[g];
+        if (group.freeBlocks.load() == 0) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(group.lock);
+        uint32_t start = near && i == 0 ? goal - g * ALLOC_GROUP_BLOCKS : group.hint;
+        bool wrapped = false;
+        while (n < count) {
+            uint32_t len;
+            uint32_t pos = findRun(group, start, 0, len);
+            if (pos == NOT_FOUND) {
+                if (wrapped) {
+                    break;
+                }
+                wrapped = true;
+                start = 0;
+                continue;
+            }
+            uint32_t take = std::min(len, count - n);
+            setRange(group, pos, take, true);
+            for (uint32_t k = 0; k < take; ++k) {
+                out[n + k] = g * ALLOC_GROUP_BLOCKS + pos + k;
+            }
+            n += take;
+            start = pos + take;
+            group.hint = start;
+        }
+        setLast(g);
+    }
+    return n;
+}
+
+uint32_t GroupAllocator::freeN(const blockno_t *bnos, uint32_t count) {
+    std::vector<blockno_t> sorted(bnos, bnos + count);
+    std::sort(sorted.begin(), sorted.end());
+    uint32_t freed = 0;
+    size_t i = 0;
+    while (i < sorted.size()) {
+        if (sorted[i] == 0 || sorted[i] >= totalBlocks) {
+            i++;
+            continue;
+        }
+        uint32_t g = groupOf(sorted[i]);
+        uint64_t end = std::min<uint64_t>(static_cast<uint64_t>(g + 1) * ALLOC_GROUP_BLOCKS, totalBlocks);
+        Group &group = *groups[g];
+        std::lock_guard<std::mutex> guard(group.lock);
+        //本组的块按连续段回收，只回收确实已被占用的块，重复的块号跳过
+        while (i < sorted.size() && sorted[i] < end) {
+            uint32_t off = sorted[i] % ALLOC_GROUP_BLOCKS;
+            if (!(group.words[off / 64] & (1ull << (off % 64)))) {
+                i++;
+                continue;
+            }
+            size_t j = i + 1;
+            while (j < sorted.size() && sorted[j] < end && sorted[j] == sorted[j - 1] + 1 &&
+                   (group.words[(off + j - i) / 64] & (1ull << ((off + j - i) % 64)))) {
+                j++;
+            }
+            setRange(group, off, j - i, false);
+            freed += j - i;
+            i = j;
+        }
+    }
+    return freed;
+}
+
+void GroupAllocator::flush() {
+    //修改过的组写回各自的位图，再写回这些组的描述符所在的块
+    std::vector<char> descriptors(blockSize);
+    uint32_t perBlock = blockSize / sizeof(GroupDescriptor);
+    for (uint32_t k = 0; k < descriptorBlocks; ++k) {
+        bool changed = false;
+        for (uint32_t g = k * perBlock; g < std::min(groupCount, (k + 1) * perBlock); ++g) {
+            Group &group = *groups[g];
+            std::lock_guard<std::mutex> guard(group.lock);
+            GroupDescriptor d{group.freeBlocks.load()};
+            std::memcpy(descriptors.data() + (g - k * perBlock) * sizeof d, &d, sizeof d);
+            if (group.dirty) {
+                uint16_t offset;
+                blockno_t bno = bitmapBlock(g, offset);
+                fs->write(bno, offset, reinterpret_cast<char *>(group.words.data()), ALLOC_GROUP_BLOCKS / 8);
+                group.dirty = false;
+                changed = true;
+            }
+        }
+        if (changed) {
+            uint32_t used = std::min(groupCount - k * perBlock, perBlock) * sizeof(GroupDescriptor);
+            fs->write(1 + k, 0, descriptors.data(), used);
+        }
+    }
+}
+
+void GroupAllocator::collectFree(std::vector<uint64_t> &bits) {
+    const size_t wordsPerGroup = ALLOC_GROUP_BLOCKS / 64;
+    for (uint32_t g = 0; g < groupCount; ++g) {
+        Group &group = *groups[g];
+        std::lock_guard<std::mutex> guard(group.lock);
+        for (size_t w = 0; w < wordsPerGroup && g * wordsPerGroup + w < bits.size(); ++w) {
+            bits[g * wordsPerGroup + w] |= ~group.words[w];
+        }
+    }
+}
+
+AllocatorKind GroupAllocator::kind() {
+    return AllocatorKind::GROUPS;
+}
+
+blockno_t GroupAllocator::spreadGoal() {
+    uint32_t best = 0;
+    for (uint32_t g = 1; g < groupCount; ++g) {
+        if (groups[g]->freeBlocks.load() > groups[best]->freeBlocks.load()) {
+            best = g;
+        }
+    }
+    //第0组的起点是0号块，0表示不指定，改为1号块
+    return std::max<blockno_t>(1, best * ALLOC_GROUP_BLOCKS);
+}
+
+void GroupAllocator::setLast(uint32_t g) {
+    if (lastGroup.load(std::memory_order_relaxed) != g) {
+        lastGroup.store(g, std::memory_order_relaxed);
+    }
+}
+
+uint32_t GroupAllocator::groupOf(blockno_t bno) {
+    return bno / ALLOC_GROUP_BLOCKS;
+}
+
+blockno_t GroupAllocator::bitmapBlock(uint32_t g, uint16_t &offset) {
+    uint64_t byte = static_cast<uint64_t>(g) * (ALLOC_GROUP_BLOCKS / 8);
+    offset = byte % blockSize;
+    return 1 + descriptorBlocks + byte / blockSize;
+}
+
+uint32_t GroupAllocator::findRun(Group &group, uint32_t start, uint32_t n, uint32_t &len) {
+    uint32_t runStart = start;
+    uint32_t runLen = 0;
+    uint32_t pos = start;
+    //与位图管理器相同，每一步消耗一个字内连续的全0段或全1段
+    while (pos < ALLOC_GROUP_BLOCKS) {
+        uint32_t bit = pos % 64;
+        uint64_t w = group.words[pos / 64] >> bit;
+        if (w & 1) {
+            if (runLen != 0 && n == 0) {
+                break;
+            }
+            uint64_t inv = ~w;
+            pos += inv == 0 ? 64 - bit : __builtin_ctzll(inv);
+            runLen = 0;
+            continue;
+        }
+        uint32_t gap = w == 0 ? 64 - bit : __builtin_ctzll(w);
+        if (runLen == 0) {
+            runStart = pos;
+        }
+        runLen += gap;
+        pos += gap;
+        if (n != 0 && runLen >= n) {
+            len = n;
+            return runStart;
+        }
+    }
+    if (n == 0 && runLen != 0) {
+        len = runLen;
+        return runStart;
+    }
+    return NOT_FOUND;
+}
+
+void GroupAllocator::setRange(Group &group, uint32_t start, uint32_t n, bool used) {
+    uint32_t pos = start;
+    uint32_t end = start + n;
+    int64_t delta = 0;
+    while (pos < end) {
+        uint32_t wi = pos / 64;
+        uint32_t bit = pos % 64;
+        uint32_t len = std::min(64 - bit, end - pos);
+        uint64_t mask = (len == 64 ? ~0ull : (1ull << len) - 1) << bit;
+        uint64_t before = group.words[wi];
+        group.words[wi] = used ? before | mask : before & ~mask;
+        delta += __builtin_popcountll(group.words[wi]) - __builtin_popcountll(before);
+        pos += len;
+    }
+    group.freeBlocks -= static_cast<uint32_t>(delta);
+    group.dirty = true;
+}
@@ -0,0 +1,67 @@
+
+
+#ifndef FILESYSTEM_GROUPALLOCATOR_H
+#define FILESYSTEM_GROUPALLOCATOR_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BlockAllocator.h"
+
+/*
+ * @brief: 分配组在磁盘上的描述符，记录该组的空闲块数
+ */
+struct GroupDescriptor {
+    uint32_t freeBlocks;
+};
+
+/*
+ * @brief: 分配组空闲空间管理器，磁盘按ALLOC_GROUP_BLOCKS块划分为若干分配组，每组有自己的位图、空闲块计数与锁；
+ *         管理结构从1号块开始依次为描述符表与各组位图，每组位图占ALLOC_GROUP_BLOCKS/8字节。
+ *         分配时先在goal所在的组中查找，组满后才依次尝试后面的组；不同组的分配与回收只锁各自的组，可以在不同线程中同时进行。
+ *         挂载时读入全部位图常驻内存，分配与回收不访问磁盘，修改过的位图与描述符在flush时写回
+ */
+class GroupAllocator : public BlockAllocator {
+public:
+    GroupAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks);
+    uint32_t layout(uint32_t totalBlocks) override;
+    void format(uint32_t totalBlocks, blockno_t firstFree) override;
+    void load() override;
+    blockno_t allocate(blockno_t goal) override;       //在goal所在的组中从goal开始查找，未指定时从上次分配的组开始
+    bool free(blockno_t bno) override;
+    void flush() override;
+    void collectFree(std::vector<uint64_t> &bits) override;     //逐组加锁复制位图
+    AllocatorKind kind() override;
+    uint32_t allocateN(uint32_t count, blockno_t *out, blockno_t goal) override;    //优先在一个组中分配一段连续的块，找不到时从goal所在的组开始逐组分配其中的空闲段
+    uint32_t freeN(const blockno_t *bnos, uint32_t count) override; //排序后按组回收，每组只加锁一次
+    blockno_t spreadGoal() override;        //空闲块最多的组的起点
+
+private:
+    static const uint32_t NOT_FOUND = ~0u;
+    //一个分配组：位图只覆盖本组的块，位偏移为块号减去组的起点；各组的锁与计数分处不同缓存行，不同线程互不干扰
+    struct alignas(64) Group {
+        std::mutex lock;
+        std::vector<uint64_t> words;        //本组位图，末尾超出磁盘的位置为1
+        std::atomic<uint32_t> freeBlocks;   //本组空闲块数，查找时不加锁读取以跳过已满的组
+        uint32_t hint;                      //下一次在本组中查找的起点
+        bool dirty;                         //位图或空闲块数被修改
+    };
+    FileSystem *fs;                 //读写磁盘块
+    FileSystemInfo &info;           //超级块
+    uint16_t blockSize;             //块大小
+    uint32_t totalBlocks;           //磁盘总块数
+    uint32_t groupCount;            //分配组数
+    uint32_t descriptorBlocks;      //描述符表占用的块数
+    std::vector<std::unique_ptr<Group>> groups;
+    std::atomic<uint32_t> lastGroup;    //上次分配所在的组，没有goal时从这里开始
+
+    uint32_t groupOf(blockno_t bno);    //块所在的组
+    blockno_t bitmapBlock(uint32_t g, uint16_t &offset);       //第g组位图所在的磁盘块与块内偏移
+    void setLast(uint32_t g);           //记录上次分配所在的组，没有变化时不写，避免各线程争用同一缓存行
+    uint32_t findRun(Group &group, uint32_t start, uint32_t n, uint32_t &len);   //在组内从start向后查找至少n个连续空闲位，返回起点，len为该段实际长度（不超过n）；n为0时返回第一个空闲段
+    void setRange(Group &group, uint32_t start, uint32_t n, bool used);        //将组内[start,start+n)置为占用或空闲
+};
+
+
+#endif //FILESYSTEM_GROUPALLOCATOR_H
@@ -0,0 +1,140 @@
+
+
+#include "Reclaimer.h"
+#include <chrono>
+#include <vector>
+#include <string>
+#include "FileSystem.h"
+#include "FileMap.h"
+#include "DirectoryFile.h"
+
+Reclaimer::Reclaimer(FileSystem *fs, std::mutex &lock)
+        : fs(fs), lock(lock), stopping(false), pending(0), reclaimed(0) {
+    rescan();
+    worker = std::thread(&Reclaimer::workerMain, this);
+}
+
+Reclaimer::~Reclaimer() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wakeup.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+void Reclaimer::notify() {
+    pending++;
+    wakeup.notify_one();
+}
+
+void Reclaimer::rescan() {
+    pending = 0;
+    DirectoryFile(fs, fs->getOrphanDirectory()).forEach([this](uint32_t, const Dirent &item) {
+        if (item.name != "." && item.name != "..") {
+            pending++;
+        }
+        return true;
+    });
+}
+
+bool Reclaimer::reclaim(inodeno_t ino, FileType type, uint64_t limit, uint64_t &freed) {
+    INode iNode{};
+    if (!fs->readINode(ino, iNode) || iNode.links == 0) {
+        //已经回收过
+        return true;
+    }
+    std::vector<blockno_t> blocks;
+    if (type != FileType::DIRECTORY) {
+        FileMap(fs, iNode).collect(blocks);
+        fs->blockFreeN(blocks.data(), blocks.size());
+        fs->freeINode(ino);
+        freed += blocks.size();
+        reclaimed += blocks.size();
+        return true;
+    }
+
+    //目录先回收子项，整个目录在本批内回收完时不必逐项删除目录项
+    DirectoryFile dir(fs, ino);
+    std::vector<std::string> done;
+    bool finished = true;
+    dir.forEach([&](uint32_t, const Dirent &item) {
+        if (item.name == "." || item.name == "..") {
+            return true;
+        }
+        if (freed >= limit || !reclaim(item.inodeIndex, item.fileType, limit, freed)) {
+            finished = false;
+            return false;
+        }
+        done.push_back(item.name);
+        return true;
+    });
+    if (!finished) {
+        //本批没回收完，已回收的子项从目录中删除，下一批从剩下的子项继续
+        for (const std::string &name : done) {
+            int64_t pos = dir.find(name);
+            if (pos != -1) {
+                dir.remove(pos);
+            }
+        }
+        return false;
+    }
+    dir.collect(blocks);
+    fs->blockFreeN(blocks.data(), blocks.size());
+    fs->freeINode(ino);
+    freed += blocks.size();
+    reclaimed += blocks.size();
+    return true;
+}
+
+uint32_t Reclaimer::getPending() {
+    return pending;
+}
+
+uint64_t Reclaimer::getReclaimed() {
+    return reclaimed;
+}
+
+void Reclaimer::step() {
+    DirectoryFile orphans(fs, fs->getOrphanDirectory());
+    uint64_t freed = 0;
+    while (freed < RECLAIM_BATCH_BLOCKS) {
+        Dirent victim{};
+        int64_t pos = -1;
+        orphans.forEach([&](uint32_t p, const Dirent &item) {
+            if (item.name == "." || item.name == "..") {
+                return true;
+            }
+            victim = item;
+            pos = p;
+            return false;
+        });
+        if (pos == -1) {
+            pending = 0;
+            break;
+        }
+        if (!reclaim(victim.inodeIndex, victim.fileType, RECLAIM_BATCH_BLOCKS, freed)) {
+            break;
+        }
+        orphans.remove(pos);
+        pending--;
+    }
+    fs->update();
+}
+
+void Reclaimer::workerMain() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        if (pending == 0) {
+            wakeup.wait(guard);
+            continue;
+        }
+        step();
+        //批间放开锁并让出1ms，等待中的前台命令先执行
+        guard.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        guard.lock();
+    }
+}
@@ -0,0 +1,44 @@
+
+
+#ifndef FILESYSTEM_RECLAIMER_H
+#define FILESYSTEM_RECLAIMER_H
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "Constraints.h"
+#include "./entity/Dirent.h"
+
+class FileSystem;
+
+/*
+ * @brief: 后台回收线程，逐个回收孤儿目录下的i节点：文件归还全部数据块与映射块，目录先回收其下的子项再归还自身；
+ *         回收完的i节点才从孤儿目录中删除，卸载时没有回收完的孤儿在下次挂载时继续回收。
+ *         每批回收约RECLAIM_BATCH_BLOCKS个块，批内持有文件系统锁，批间放开锁让前台命令执行；空闲块数只在块真正归还时增加
+ */
+class Reclaimer {
+public:
+    Reclaimer(FileSystem *fs, std::mutex &lock);    //统计孤儿目录下待回收的i节点数并启动回收线程，此时还没有其他线程访问文件系统
+    ~Reclaimer();                   //等当前一批回收完后停止回收线程
+    void notify();                  //孤儿目录下加入了一个i节点，唤醒回收线程；调用者持有文件系统锁
+    void rescan();                  //重新统计待回收的i节点数，格式化后使用；调用者持有文件系统锁
+    bool reclaim(inodeno_t ino, FileType type, uint64_t limit, uint64_t &freed);    //回收ino及其子项，累计释放的块数freed达到limit时停下并返回false；调用者持有文件系统锁
+    uint32_t getPending();          //待回收的i节点数
+    uint64_t getReclaimed();        //累计回收的块数
+
+private:
+    FileSystem *fs;
+    std::mutex &lock;               //文件系统锁，Shell执行每条命令时也持有
+    std::condition_variable wakeup; //唤醒回收线程
+    std::thread worker;             //回收线程
+    bool stopping;                  //回收线程退出标记
+    uint32_t pending;               //孤儿目录下待回收的i节点数
+    uint64_t reclaimed;             //累计回收的块数
+
+    void step();                    //回收一批孤儿
+    void workerMain();              //回收线程主循环
+};
+
+
+#endif //FILESYSTEM_RECLAIMER_H
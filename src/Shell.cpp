@@ -16,7 +16,10 @@ void Shell::running_shell()
             std::getchar();
             nowPath.clear();
         }
-        userInterface->updateDirNow();
+        {
+            std::lock_guard<std::mutex> guard(userInterface->getLock());
+            userInterface->updateDirNow();
+        }
         outPutPrefix();
         std::getline(std::cin, input);
         cmd.clear();
@@ -25,6 +28,8 @@ void Shell::running_shell()
         {
             cmd.push_back(word);
         }
+        // 执行命令期间持有文件系统锁，后台回收线程只在两条命令之间回收
+        std::lock_guard<std::mutex> guard(userInterface->getLock());
         std::string cmd_1 = cmd[0];
         if (cmd_1 == "cd")
         {
@@ -104,6 +109,66 @@ void Shell::running_shell()
         {
             cmd_seek();
         }
+        else if (cmd_1 == "iostat")
+        {
+            cmd_iostat();
+            continue;
+        }
+        else if (cmd_1 == "sync")
+        {
+            cmd_sync();
+            continue;
+        }
+        else if (cmd_1 == "bench")
+        {
+            cmd_bench();
+            continue;
+        }
+        else if (cmd_1 == "dirbench")
+        {
+            cmd_dirbench();
+            continue;
+        }
+        else if (cmd_1 == "fallocate")
+        {
+            cmd_fallocate();
+            continue;
+        }
+        else if (cmd_1 == "allocbench")
+        {
+            cmd_allocbench();
+            continue;
+        }
+        else if (cmd_1 == "iobench")
+        {
+            cmd_iobench();
+            continue;
+        }
+        else if (cmd_1 == "diskbench")
+        {
+            cmd_diskbench();
+            continue;
+        }
+        else if (cmd_1 == "fillbench")
+        {
+            cmd_fillbench();
+            continue;
+        }
+        else if (cmd_1 == "allocatorbench")
+        {
+            cmd_allocatorbench();
+            continue;
+        }
+        else if (cmd_1 == "fstrim")
+        {
+            cmd_fstrim();
+            continue;
+        }
+        else if (cmd_1 == "defrag")
+        {
+            cmd_defrag();
+            continue;
+        }
         else
         {
             std::cout << "undefined command!" << std::endl;
@@ -118,7 +183,7 @@ void Shell::running_shell()
     cout << "Bye!" << endl;
 }
 
-Shell::Shell()
+Shell::Shell(const MountOptions &options) : mountOptions(options)
 {
     userInterface = UserInterface::getInstance();
     user.uid = 0;
@@ -197,15 +262,18 @@ void Shell::setCmd(const std::vector<std::string> &cmd)
 
 void Shell::cmd_ls()
 {
-    if (cmd.size() == 1)
+    // ls [-l] [path]，-l 时显示权限、链接数、所有者和大小
+    bool detail = cmd.size() > 1 && cmd[1] == "-l";
+    size_t arg = detail ? 2 : 1;
+    if (cmd.size() <= arg)
     {
-        userInterface->ls();
+        userInterface->ls(detail);
         return;
     }
-    std::string cmd_src = cmd[1];
+    std::string cmd_src = cmd[arg];
     // std::vector<std::string> src = splitWithStl(cmd_src,"/");
     vector<string> src = split_path(cmd_src);
-    userInterface->ls(src);
+    userInterface->ls(src, detail);
 }
 
 void Shell::cmd_mkdir()
@@ -282,7 +350,7 @@ void Shell::init()
     cout << "               +-------------------------------------+" << endl;
     cout << "               |    Simple FileSystem Simulation     |" << endl;
     cout << "               +-------------------------------------+" << endl;
-    userInterface->initialize();
+    userInterface->initialize(mountOptions);
 }
 
 void Shell::cmd_login()
@@ -545,7 +613,7 @@ void Shell::cmd_seek()
     string option = cmd[2];
     std::stringstream sio;
     sio << cmd[3];
-    uint32_t offset;
+    uint64_t offset;
     sio >> offset;
     int op = -1;
     if (option == "-b")
@@ -564,7 +632,281 @@ void Shell::cmd_seek()
     userInterface->setCursor(op, src, offset);
 }
 
+void Shell::cmd_iostat()
+{
+    bool reset = false;
+    if (cmd.size() == 2)
+    {
+        if (cmd[1] != "-r")
+        {
+            cout << "iostat: unknown option: \'" << cmd[1] << "\'" << endl;
+            return;
+        }
+        reset = true;
+    }
+    else if (cmd.size() != 1)
+    {
+        cout << "iostat: too much operand" << endl;
+        return;
+    }
+    userInterface->iostat(reset);
+}
+
+void Shell::cmd_sync()
+{
+    if (cmd.size() != 1)
+    {
+        cout << "sync: too much operand" << endl;
+        return;
+    }
+    userInterface->sync();
+}
+
+void Shell::cmd_fstrim()
+{
+    if (cmd.size() != 1)
+    {
+        cout << "fstrim: too much operand" << endl;
+        return;
+    }
+    userInterface->fstrim();
+}
+
+void Shell::cmd_defrag()
+{
+    // defrag [-n] [-r MB/s] [path]，默认整理整个卷；-n 只报告碎片情况，-r 限制每秒搬移的数据量
+    bool dryRun = false;
+    uint32_t rate = 0;
+    string path = "/";
+    bool hasPath = false;
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        if (cmd[i] == "-n")
+        {
+            dryRun = true;
+        }
+        else if (cmd[i] == "-r")
+        {
+            std::stringstream sio;
+            if (i + 1 < cmd.size())
+            {
+                sio << cmd[++i];
+            }
+            if (!(sio >> rate))
+            {
+                cout << "defrag: invalid rate" << endl;
+                return;
+            }
+        }
+        else if (!hasPath)
+        {
+            path = cmd[i];
+            hasPath = true;
+        }
+        else
+        {
+            cout << "defrag: too much operand" << endl;
+            return;
+        }
+    }
+    userInterface->defrag(split_path(path), rate, dryRun);
+}
+
 Shell::~Shell()
 {
     userInterface->revokeInstance();
 }
+
+void Shell::cmd_bench()
+{
+    if (cmd.size() > 3)
+    {
+        cout << "bench: too much operand" << endl;
+        return;
+    }
+    // bench [index|extent|blockmap|all] [ops]，默认测试全部块映射方式各1000次
+    vector<FileLayout> layouts = {FileLayout::INDEX, FileLayout::EXTENT, FileLayout::BLOCKMAP};
+    if (cmd.size() >= 2 && cmd[1] != "all")
+    {
+        if (cmd[1] == "index")
+            layouts = {FileLayout::INDEX};
+        else if (cmd[1] == "extent")
+            layouts = {FileLayout::EXTENT};
+        else if (cmd[1] == "blockmap")
+            layouts = {FileLayout::BLOCKMAP};
+        else
+        {
+            cout << "bench: unknown layout: \'" << cmd[1] << "\'" << endl;
+            return;
+        }
+    }
+    uint32_t ops = 1000;
+    if (cmd.size() == 3)
+    {
+        std::stringstream sio;
+        sio << cmd[2];
+        if (!(sio >> ops) || ops == 0)
+        {
+            cout << "bench: invalid ops: \'" << cmd[2] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->bench(layouts, ops);
+}
+
+void Shell::cmd_dirbench()
+{
+    if (cmd.size() > 4)
+    {
+        cout << "dirbench: too much operand" << endl;
+        return;
+    }
+    // dirbench [entries] [ops] [dirs]，默认在一个目录中创建100000个文件并随机查找、删除各1000次
+    const char *names[3] = {"entries", "ops", "dirs"};
+    uint32_t args[3] = {100000, 1000, 1};
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        std::stringstream sio;
+        sio << cmd[i];
+        if (!(sio >> args[i - 1]) || args[i - 1] == 0)
+        {
+            cout << "dirbench: invalid " << names[i - 1] << ": \'" << cmd[i] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->dirbench(args[0], args[1], args[2]);
+}
+
+void Shell::cmd_fallocate()
+{
+    // fallocate <path> <bytes>，为文件预分配覆盖前bytes字节的数据块
+    if (cmd.size() != 3)
+    {
+        cout << "fallocate: missing operand" << endl;
+        return;
+    }
+    vector<string> src = split_path(cmd[1]);
+    std::stringstream sio;
+    sio << cmd[2];
+    uint64_t length;
+    if (src.empty() || !(sio >> length))
+    {
+        cout << "fallocate: invalid operand" << endl;
+        return;
+    }
+    userInterface->fallocate(src, length);
+}
+
+void Shell::cmd_allocbench()
+{
+    if (cmd.size() > 3)
+    {
+        cout << "allocbench: too much operand" << endl;
+        return;
+    }
+    // allocbench [files] [MB]，默认4个文件各16MB；测试文件需同时打开，不超过打开表的容量
+    const char *names[2] = {"files", "size"};
+    uint32_t args[2] = {4, 16};
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        std::stringstream sio;
+        sio << cmd[i];
+        if (!(sio >> args[i - 1]) || args[i - 1] == 0 || (i == 1 && args[0] > FILE_OPEN_MAX_NUM))
+        {
+            cout << "allocbench: invalid " << names[i - 1] << ": \'" << cmd[i] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->allocbench(args[0], args[1]);
+}
+
+void Shell::cmd_iobench()
+{
+    if (cmd.size() > 3)
+    {
+        cout << "iobench: too much operand" << endl;
+        return;
+    }
+    // iobench [files] [rounds]，默认64个文件各10轮
+    const char *names[2] = {"files", "rounds"};
+    uint32_t args[2] = {64, 10};
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        std::stringstream sio;
+        sio << cmd[i];
+        if (!(sio >> args[i - 1]) || args[i - 1] == 0)
+        {
+            cout << "iobench: invalid " << names[i - 1] << ": \'" << cmd[i] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->iobench(args[0], args[1]);
+}
+
+void Shell::cmd_diskbench()
+{
+    // diskbench [MB]...，默认测试64MB、1GB和4GB
+    std::vector<uint64_t> sizes;
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        std::stringstream sio;
+        sio << cmd[i];
+        uint64_t size;
+        if (!(sio >> size) || size == 0)
+        {
+            cout << "diskbench: invalid size: \'" << cmd[i] << "\'" << endl;
+            return;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty())
+    {
+        sizes = {64, 1024, 4096};
+    }
+    userInterface->diskbench(sizes);
+}
+
+void Shell::cmd_fillbench()
+{
+    if (cmd.size() > 2)
+    {
+        cout << "fillbench: too much operand" << endl;
+        return;
+    }
+    // fillbench [GB]，默认写满16GB的稀疏磁盘
+    uint32_t size = 16;
+    if (cmd.size() == 2)
+    {
+        std::stringstream sio;
+        sio << cmd[1];
+        if (!(sio >> size) || size == 0)
+        {
+            cout << "fillbench: invalid size: \'" << cmd[1] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->fillbench(size);
+}
+
+void Shell::cmd_allocatorbench()
+{
+    if (cmd.size() > 3)
+    {
+        cout << "allocatorbench: too much operand" << endl;
+        return;
+    }
+    // allocatorbench [files] [MB]，默认4个文件各16MB；测试文件需同时打开，不超过打开表的容量
+    const char *names[2] = {"files", "size"};
+    uint32_t args[2] = {4, 16};
+    for (size_t i = 1; i < cmd.size(); i++)
+    {
+        std::stringstream sio;
+        sio << cmd[i];
+        if (!(sio >> args[i - 1]) || args[i - 1] == 0 || (i == 1 && args[0] > FILE_OPEN_MAX_NUM))
+        {
+            cout << "allocatorbench: invalid " << names[i - 1] << ": \'" << cmd[i] << "\'" << endl;
+            return;
+        }
+    }
+    userInterface->allocatorbench(args[0], args[1]);
+}
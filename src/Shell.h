@@ -27,8 +27,9 @@ private:
     bool isExit;            //是否退出标记
     UserInterface* userInterface;
     std::vector<std::string> nowPath;//当前从根目录开始的路径
+    MountOptions mountOptions;  //挂载选项
 public:
-    Shell();
+    explicit Shell(const MountOptions &options = MountOptions());
     //根据part分割str
     vector<string> split_path(string& path);
     //界面主程序
@@ -66,6 +67,18 @@ public:
     void cmd_write();       //写入
     void cmd_seek();        //文件指针修改
     void cmd_zedit();       //简单文本编辑器
+    void cmd_iostat();      //磁盘读写统计
+    void cmd_sync();        //脏块写回
+    void cmd_bench();       //随机定位读取基准测试
+    void cmd_dirbench();    //大目录创建、查找与列出基准测试
+    void cmd_fallocate();   //文件预分配
+    void cmd_allocbench();  //同时写入多个文件的碎片与顺序读取基准测试
+    void cmd_iobench();     //各磁盘后端的系统调用数与吞吐基准测试
+    void cmd_diskbench();   //磁盘创建与格式化耗时基准测试
+    void cmd_fillbench();   //写满大容量稀疏磁盘的吞吐基准测试
+    void cmd_allocatorbench(); //各空闲空间管理方式的分配、回收耗时与文件连续性基准测试
+    void cmd_fstrim();      //对空闲块在磁盘文件上打洞
+    void cmd_defrag();      //碎片整理
 
 
     const std::vector<std::string> &getCmd() const;
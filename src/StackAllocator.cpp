@@ -0,0 +1,166 @@
+
+
+#include "StackAllocator.h"
+#include "FileSystem.h"
+
+StackAllocator::StackAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks)
+        : fs(fs), info(info), blockSize(blockSize), totalBlocks(totalBlocks) {
+}
+
+uint32_t StackAllocator::layout(uint32_t totalBlocks) {
+    uint64_t bytes = static_cast<uint64_t>(totalBlocks) * sizeof(blockno_t);
+    return (bytes + blockSize - 1) / blockSize;
+}
+
+void StackAllocator::format(uint32_t totalBlocks, blockno_t firstFree) {
+    //空闲块号从栈区末尾向前依次存放，栈区开头多出的槽位为0，栈顶即第一个非0槽位，可以直接算出
+    uint32_t stackSize = layout(totalBlocks);
+    uint32_t maxSize = stack.getMaxSize();
+    uint32_t freeBlocks = totalBlocks - firstFree;                  //栈中空闲块个数
+    uint32_t firstSlot = stackSize * maxSize - freeBlocks;          //第一个非0槽位
+    info.freeBlockStackTop = 1 + firstSlot / maxSize;
+    info.freeBlockStackOffset = firstSlot % maxSize;
+
+    //在内存中按整页构造栈，每次顺序写入多个栈页
+    const uint32_t batchPages = 64;
+    std::vector<blockno_t> pages(batchPages * maxSize);
+    for (uint32_t page = 0; page < stackSize; page += batchPages) {
+        uint32_t n = std::min(batchPages, stackSize - page);
+        for (uint32_t k = 0; k < n * maxSize; ++k) {
+            uint32_t slot = page * maxSize + k;
+            pages[k] = slot < firstSlot ? 0 : firstFree + (slot - firstSlot);
+        }
+        fs->writeBlocks(page + 1, n, reinterpret_cast<char *>(pages.data()));
+    }
+}
+
+void StackAllocator::load() {
+    loadTop();
+}
+
+blockno_t StackAllocator::allocate(blockno_t) {
+    if (info.freeBlockNumber == 0) {
+        return 0;
+    }
+    return pop();
+}
+
+uint32_t StackAllocator::allocateN(uint32_t count, blockno_t *out, blockno_t) {
+    //空闲块个数由FileSystem在整批分配后统一扣减，这里先按剩余空闲块数截断，避免越过栈底
+    uint32_t n = std::min(count, info.freeBlockNumber);
+    for (uint32_t i = 0; i < n; ++i) {
+        out[i] = pop();
+    }
+    return n;
+}
+
+bool StackAllocator::free(blockno_t bno) {
+    if (bno == 0) {
+        return false;
+    }
+    if (stack.full()) {
+        storeTop();
+        info.freeBlockStackTop--;
+        info.freeBlockStackOffset = stack.getMaxSize();
+        stack.setStackTop(info.freeBlockStackOffset);
+    }
+    stack.revokeBlock(bno);
+    info.freeBlockStackOffset--;
+    return true;
+}
+
+void StackAllocator::flush() {
+    storeTop();
+}
+
+void StackAllocator::collectFree(std::vector<uint64_t> &bits) {
+    //栈顶之后的槽位都是空闲块号，栈顶所在页可能还没写回，取内存中的
+    uint32_t maxSize = stack.getMaxSize();
+    auto mark = [&bits](const blockno_t *slots, uint32_t n) {
+        for (uint32_t i = 0; i < n; ++i) {
+            if (slots[i] != 0 && slots[i] / 64 < bits.size()) {
+                bits[slots[i] / 64] |= 1ull << (slots[i] % 64);
+            }
+        }
+    };
+    mark(stack.getBlocks() + info.freeBlockStackOffset, maxSize - info.freeBlockStackOffset);
+    uint32_t stackSize = layout(totalBlocks);
+    const uint32_t batch = 64;
+    std::vector<blockno_t> pages(batch * maxSize);
+    for (uint32_t page = info.freeBlockStackTop + 1; page <= stackSize; page += batch) {
+        uint32_t n = std::min(batch, stackSize + 1 - page);
+        fs->readRun(page, n, reinterpret_cast<char *>(pages.data()));
+        mark(pages.data(), n * maxSize);
+    }
+}
+
+bool StackAllocator::compact() {
+    std::vector<uint64_t> bits((totalBlocks + 63) / 64, 0);
+    collectFree(bits);
+    //空闲块划分为连续段，长的段先出栈，一次分配尽量落在同一段中
+    std::vector<std::pair<blockno_t, uint32_t>> runs;
+    for (uint64_t b = 0; b < totalBlocks; ++b) {
+        if (!(bits[b / 64] & (1ull << (b % 64)))) {
+            continue;
+        }
+        if (!runs.empty() && runs.back().first + runs.back().second == b) {
+            runs.back().second++;
+        } else {
+            runs.emplace_back(b, 1);
+        }
+    }
+    std::stable_sort(runs.begin(), runs.end(), [](const std::pair<blockno_t, uint32_t> &a, const std::pair<blockno_t, uint32_t> &b) {
+        return a.second > b.second;
+    });
+    std::vector<blockno_t> free;
+    for (auto &run : runs) {
+        for (uint32_t i = 0; i < run.second; ++i) {
+            free.push_back(run.first + i);
+        }
+    }
+    //栈顶之后的槽位数应与空闲块数相同，不一致时不整理
+    uint32_t maxSize = stack.getMaxSize();
+    uint32_t stackSize = layout(totalBlocks);
+    uint64_t firstSlot = static_cast<uint64_t>(info.freeBlockStackTop - 1) * maxSize + info.freeBlockStackOffset;
+    if (firstSlot + free.size() != static_cast<uint64_t>(stackSize) * maxSize) {
+        return false;
+    }
+    //栈顶所在页在内存中改写，其余栈页按批写回
+    std::copy(free.begin(), free.begin() + (maxSize - info.freeBlockStackOffset),
+              stack.getBlocks() + info.freeBlockStackOffset);
+    storeTop();
+    const uint32_t batch = 64;
+    size_t next = maxSize - info.freeBlockStackOffset;
+    for (uint32_t page = info.freeBlockStackTop + 1; page <= stackSize; page += batch) {
+        uint32_t n = std::min(batch, stackSize + 1 - page);
+        fs->writeRun(page, n, reinterpret_cast<const char *>(free.data() + next));
+        next += static_cast<size_t>(n) * maxSize;
+    }
+    return true;
+}
+
+AllocatorKind StackAllocator::kind() {
+    return AllocatorKind::STACK;
+}
+
+blockno_t StackAllocator::pop() {
+    if (stack.empty()) {
+        info.freeBlockStackTop++;
+        info.freeBlockStackOffset = 0;
+        loadTop();
+    }
+    blockno_t ret = stack.getBlock();
+    info.freeBlockStackOffset++;
+    return ret;
+}
+
+void StackAllocator::loadTop() {
+    auto blocks = stack.getBlocks();
+    fs->read(info.freeBlockStackTop, 0, reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack.getMaxSize());
+    stack.setStackTop(info.freeBlockStackOffset);
+}
+
+void StackAllocator::storeTop() {
+    auto blocks = stack.getBlocks();
+    fs->write(info.freeBlockStackTop, 0, reinterpret_cast<char *>(blocks), sizeof(blocks[0]) * stack.getMaxSize());
+}
@@ -0,0 +1,38 @@
+
+
+#ifndef FILESYSTEM_STACKALLOCATOR_H
+#define FILESYSTEM_STACKALLOCATOR_H
+
+#include "BlockAllocator.h"
+#include "./entity/FreeBlockStack.h"
+
+/*
+ * @brief: 空闲块栈管理器，栈按页存放在磁盘上，内存中只保留栈顶所在的一页
+ */
+class StackAllocator : public BlockAllocator {
+public:
+    StackAllocator(FileSystem *fs, FileSystemInfo &info, uint16_t blockSize, uint32_t totalBlocks);
+    uint32_t layout(uint32_t totalBlocks) override;
+    void format(uint32_t totalBlocks, blockno_t firstFree) override;
+    void load() override;
+    blockno_t allocate(blockno_t goal) override;       //只能出栈，忽略goal
+    bool free(blockno_t bno) override;
+    void flush() override;
+    void collectFree(std::vector<uint64_t> &bits) override;     //栈顶所在页取内存中的，其余栈页从磁盘读入
+    AllocatorKind kind() override;
+    uint32_t allocateN(uint32_t count, blockno_t *out, blockno_t goal) override;    //连续出栈，跨页时才换入下一页
+    bool compact() override;    //栈中的空闲块按连续段重新排列，长的段在前，出栈时依次得到连续的块
+
+private:
+    FileSystem *fs;             //读写磁盘块
+    FileSystemInfo &info;       //超级块，记录栈顶所在页与页内偏移
+    uint16_t blockSize;         //块大小
+    uint32_t totalBlocks;       //磁盘总块数，决定栈区的页数
+    FreeBlockStack stack;       //栈顶所在的栈页
+    blockno_t pop();            //弹出一个空闲块，当前页空时换入下一页
+    void loadTop();             //读入栈顶所在的栈页
+    void storeTop();            //写回栈顶所在的栈页
+};
+
+
+#endif //FILESYSTEM_STACKALLOCATOR_H
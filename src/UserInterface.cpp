@@ -16,6 +16,7 @@ UserInterface *UserInterface::getInstance()
 UserInterface::UserInterface()
 {
     fileSystem = FileSystem::getInstance();
+    delayedAllocation = false;
 }
 
 UserInterface::~UserInterface()
@@ -29,11 +30,17 @@ void UserInterface::revokeInstance()
     instance = nullptr;
 }
 
-void UserInterface::initialize()
+void UserInterface::initialize(const MountOptions &options)
 {
     // 如果挂载失败,先格式化
-    if (!fileSystem->mount())
+    if (!fileSystem->mount(options))
     {
+        // 已格式化的磁盘挂载失败是升级没能进行,磁盘保持原样,不能格式化覆盖已有数据
+        if (fileSystem->isFormatted())
+        {
+            std::cout << "mount failed: not enough free space to upgrade the disk format" << std::endl;
+            std::exit(1);
+        }
         std::cout << "mount failed!" << std::endl
                   << "begin format!" << std::endl;
         // 如果格式化失败,创建新磁盘
@@ -41,50 +48,44 @@ void UserInterface::initialize()
         {
             std::cout << "format failed because there is no disk.\nStart creating a disk, please input disk size(MB):"
                       << std::flush;
-            uint32_t disk_size;
+            uint64_t disk_size;
             std::cin >> disk_size;
-            fileSystem->createDisk(disk_size * 1024 * 1024);
-            std::cout << "disk create success!" << std::endl;
-            fileSystem->mount();
+            std::cout << "preallocate disk space?(y/n):" << std::flush;
+            std::string preallocate;
+            std::cin >> preallocate;
+            auto start = std::chrono::steady_clock::now();
+            if (!fileSystem->createDisk(disk_size * 1024 * 1024, preallocate == "y"))
+            {
+                std::cout << "disk create failed!" << std::endl;
+                std::exit(1);
+            }
+            auto cost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            std::cout << "disk create success! (" << cost.count() << " ms)" << std::endl;
+            fileSystem->mount(options);
             fileSystem->format(BLOCK_SIZE / 8);
         }
         std::cout << "format success!" << std::endl;
     }
-    // 读入根节点所在磁盘块
-    uint32_t root_disk = fileSystem->getRootLocation();
-    // 根节点
-    INode rootInode{};
-    // 从根节点所在磁盘块读入根节点信息
-    fileSystem->read(root_disk, 0, reinterpret_cast<char *>(&rootInode), sizeof(rootInode));
-    // 将根目录信息写入当前目录
-    fileSystem->read(rootInode.bno, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    nowDiretoryDisk = rootInode.bno;
+    // 当前目录设置为根目录
+    nowDirectory = fileSystem->getRootINode();
+    delayedAllocation = options.delayedAllocation;
     for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
     {
         fileOpenTable[i].fileNumber = 0;
         fileOpenTable[i].cursor = 0;
+        fileOpenTable[i].delayed.clear();
     }
 }
 
 void UserInterface::mkdir(uint8_t uid, std::string directoryName)
 {
-    int directoryIndex = -1;
-    // 遍历所有目录项,找到空闲目录项
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
-    {
-        if (directory.item[i].inodeIndex == 0)
-        {
-            directoryIndex = i;
-            break;
-        }
-    }
-    // 目录项满了
-    if (directoryIndex == -1)
+    // 名字过长时目录项放不下，直接拒绝
+    if (!DirectoryFile::validName(directoryName))
     {
-        std::cout << "directory full!" << std::endl;
+        std::cout << "mkdir:" << YELLOW << "cannot " << RESET << "create directory '" << directoryName << "':"
+                  << "File name too long" << std::endl;
         return;
     }
-
     // 重复文件检测
     if (duplicateDetection(directoryName))
     {
@@ -93,83 +94,107 @@ void UserInterface::mkdir(uint8_t uid, std::string directoryName)
         return;
     }
 
-    // 给新目录的i结点分配空闲磁盘块
-    uint32_t directoryInodeDisk = fileSystem->blockAllocate();
-    // 给新目录的目录项信息分配空闲磁盘块
-    uint32_t directoryDisk = fileSystem->blockAllocate();
-    Directory newDirectory{};
-    // 目录的第一项为本目录的信息
-    newDirectory.item[0].inodeIndex = directoryInodeDisk;
-    // 设置本目录./
-    strcpy(newDirectory.item[0].name, ".");
-    // 目录的第二项为上级目录的信息
-    newDirectory.item[1].inodeIndex = directory.item[0].inodeIndex;
-    // 设置上级目录../
-    strcpy(newDirectory.item[1].name, "..");
-    // 设置结束标记
-    newDirectory.item[2].inodeIndex = 0;
-    // 将目录项信息写入磁盘
-    fileSystem->write(directoryDisk, 0, reinterpret_cast<char *>(&newDirectory), sizeof(newDirectory));
-
-    // 新目录i节点
-    INode directoryInode{};
-
-    directoryInode.bno = directoryDisk;
-    directoryInode.flag = 0x7f; // 01 111 111b
-    directoryInode.uid = uid;
-    fileSystem->write(directoryInodeDisk, 0, reinterpret_cast<char *>(&directoryInode), sizeof(directoryInode));
-
-    // 更新当前目录目录项
-    strcpy(directory.item[directoryIndex].name, directoryName.c_str());
-    directory.item[directoryIndex].inodeIndex = directoryInodeDisk;
-
-    // 将更新后的当前目录信息写入磁盘
-    fileSystem->write(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
+    // 从i节点表分配新目录的i结点，再建立只含.和..的第一个目录块
+    inodeno_t directoryInodeIndex = fileSystem->allocINode();
+    if (directoryInodeIndex == 0)
+    {
+        std::cout << "mkdir: no space left on disk" << std::endl;
+        return;
+    }
+    if (!DirectoryFile::create(fileSystem, directoryInodeIndex, nowDirectory, uid, 0x7f)) // 01 111 111b
+    {
+        fileSystem->freeINode(directoryInodeIndex);
+        std::cout << "mkdir: no space left on disk" << std::endl;
+        return;
+    }
+
+    // 在当前目录中加入目录项，优先复用已删除的空位，全部写满时目录自动扩展一块
+    if (!DirectoryFile(fileSystem, nowDirectory).add(directoryName, directoryInodeIndex, FileType::DIRECTORY, 0x3f))
+    {
+        // 空间不足，归还新目录占用的块和i结点
+        std::vector<blockno_t> blocks;
+        collectDirectoryBlocks(directoryInodeIndex, blocks);
+        fileSystem->blockFreeN(blocks.data(), blocks.size());
+        std::cout << "mkdir: no space left on disk" << std::endl;
+    }
 
     // 更新已分配磁盘块
     fileSystem->update();
 }
 
-void UserInterface::ls()
+void UserInterface::ls(bool detail)
 {
-    // 遍历目录项数组，目录项总数上限为 DIRECTORY_NUMS
-    for (int i = 0; i < DIRECTORY_NUMS && directory.item[i].inodeIndex != 0; i++)
+    listDirectory(nowDirectory, detail);
+}
+
+void UserInterface::listDirectory(inodeno_t dir, bool detail)
+{
+    if (detail)
+    {
+        listDetail(dir);
+        return;
+    }
+    // 按顺序遍历目录各块中的所有目录项
+    DirectoryFile(fileSystem, dir).forEach([this](uint32_t, const Dirent &item)
     {
-        // 如果当前目录项对应的 inodeIndex 可访问（judge 返回 true 表示可访问或高亮显示）
-        if (judge(directory.item[i].inodeIndex))
+        // 目录项中记录的文件类型是目录时用蓝色高亮显示，不需要读取 i 结点
+        if (item.fileType == FileType::DIRECTORY)
         {
             // 打印文件/目录名，并用蓝色高亮显示，后面加一个制表符
-            std::cout << BLUE << directory.item[i].name << RESET << "\t";
+            std::cout << BLUE << item.name << RESET << "\t";
         }
         else
         {
             // 普通打印文件/目录名，不做高亮，后面加一个制表符
-            std::cout << directory.item[i].name << "\t";
+            std::cout << item.name << "\t";
         }
-    }
+        return true;
+    });
     // 输出换行，表示 ls 列表结束
     std::cout << std::endl;
 }
 
-void UserInterface::touch(uint8_t uid, std::string fileName)
+void UserInterface::listDetail(inodeno_t dir)
 {
-    int directoryIndex = -1;
-    // 遍历所有目录项,找到空闲目录项
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
+    // 先读出全部目录项，再按 i 节点号批量读取 i 结点，每个 i 节点表块只读一次
+    std::vector<Dirent> items;
+    DirectoryFile(fileSystem, dir).forEach([&items](uint32_t, const Dirent &item)
     {
-        if (directory.item[i].inodeIndex == 0)
-        {
-            directoryIndex = i;
-            break;
-        }
+        items.push_back(item);
+        return true;
+    });
+    std::vector<inodeno_t> inos;
+    for (const Dirent &item : items)
+        inos.push_back(item.inodeIndex);
+    std::vector<INode> iNodes;
+    fileSystem->readINodes(inos, iNodes);
+
+    // 每行依次为类型与权限(信赖者rwx、其余用户rwx)、链接数、所有者uid、文件大小、名字
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        const INode &iNode = iNodes[i];
+        std::string mode = items[i].fileType == FileType::DIRECTORY ? "d" : items[i].fileType == FileType::SYMLINK ? "l" : "-";
+        const char *rwx = "rwx";
+        for (int bit = 5; bit >= 0; --bit)
+            mode += (iNode.flag >> bit & 1) ? rwx[2 - bit % 3] : '-';
+        std::cout << mode << "\t" << static_cast<int>(iNode.links) << "\t" << static_cast<int>(iNode.uid) << "\t"
+                  << iNode.capacity << "\t";
+        if (items[i].fileType == FileType::DIRECTORY)
+            std::cout << BLUE << items[i].name << RESET << std::endl;
+        else
+            std::cout << items[i].name << std::endl;
     }
-    // 目录项满了
-    if (directoryIndex == -1)
+}
+
+void UserInterface::touch(uint8_t uid, std::string fileName)
+{
+    // 名字过长时目录项放不下，直接拒绝
+    if (!DirectoryFile::validName(fileName))
     {
-        std::cout << "directory full!" << std::endl;
+        std::cout << "touch:" << YELLOW << "cannot " << RESET << "create file '" << fileName << "':"
+                  << "File name too long" << std::endl;
         return;
     }
-
     // 重复文件检测
     if (duplicateDetection(fileName))
     {
@@ -177,488 +202,361 @@ void UserInterface::touch(uint8_t uid, std::string fileName)
                   << std::endl;
         return;
     }
-    // 给文件索引表分配空闲磁盘块
-    uint32_t fileIndexDisk = fileSystem->blockAllocate();
+    // 从i节点表分配i结点；新文件的内容内联在i结点中，不占用数据块，超出后在写入时转换为挂载选项指定的布局
+    inodeno_t fileInodeIndex = fileSystem->allocINode();
+    if (fileInodeIndex == 0)
+    {
+        std::cout << "touch: no space left on disk" << std::endl;
+        return;
+    }
     // 新文件i节点
     INode fileInode{};
-    // 给新文件的i结点分配空闲磁盘块
-    uint32_t fileInodeDisk = fileSystem->blockAllocate();
-    fileInode.bno = fileIndexDisk;
+    FileMap::init(fileInode, FileLayout::INLINE);
     fileInode.flag = 0x3f; // 00 111 111b
     fileInode.uid = uid;
+    fileInode.links = 1;
     // 把i结点写入磁盘
-    fileSystem->write(fileInodeDisk, 0, reinterpret_cast<char *>(&fileInode), sizeof(fileInode));
-    // 更新目录项信息
-    strcpy(directory.item[directoryIndex].name, fileName.c_str());
-    directory.item[directoryIndex].inodeIndex = fileInodeDisk;
-
-    // 将更新后的当前目录信息写入磁盘
-    fileSystem->write(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    FileIndex fileIndex{};   //文件索引表
-    // 给文件分配空闲磁盘块
-    uint32_t fileDisk = fileSystem->blockAllocate();
-    fileIndex.index[0] = fileDisk;
-    fileIndex.index[1] = 0;
-    fileIndex.next = 0;
-
-    // 把文件索引表写入磁盘
-    fileSystem->write(fileIndexDisk, 0, reinterpret_cast<char *>(&fileIndex), sizeof(fileIndex));
+    fileSystem->writeINode(fileInodeIndex, fileInode);
+
+    // 在当前目录中加入目录项，优先复用已删除的空位，全部写满时目录自动扩展一块
+    if (!DirectoryFile(fileSystem, nowDirectory).add(fileName, fileInodeIndex, FileType::REGULAR, fileInode.flag & 0x3f))
+    {
+        fileSystem->freeINode(fileInodeIndex);
+        std::cout << "touch: no space left on disk" << std::endl;
+    }
 
     fileSystem->update();
 }
 
 bool UserInterface::duplicateDetection(std::string name)
 {
-    // 初始化目录项索引变量为 -1，表示暂时未找到重名项
-    int dirLocation = -1;
-
-    // 遍历当前目录的所有目录项，最大项数由 DIRECTORY_NUMS 决定
-    for (int i = 0; i < DIRECTORY_NUMS; ++i)
-    {
-        // 如果当前目录项的 inodeIndex 为 0，说明到达空闲或结束位置，跳出循环
-        if (directory.item[i].inodeIndex == 0)
-        {
-            break;
-        }
-        // 将目录项的名字与传入的 name 做字符串比较
-        // strcmp 返回 0 表示两者相同
-        if (std::strcmp(directory.item[i].name, name.c_str()) == 0)
-        {
-            // 找到重名项，将索引记录在 dirLocation 中并跳出循环
-            dirLocation = i;
-            break;
-        }
-    }
-
-    // 如果 dirLocation 仍为 -1，说明未找到重名文件/目录，返回 false；否则返回 true
-    if (dirLocation == -1)
-    {
-        return false;
-    }
-    else
-    {
-        return true;
-    }
+    // 经目录项缓存在当前目录中查找同名目录项，找到即为重名
+    Dirent item{};
+    return DirectoryFile::lookup(fileSystem, nowDirectory, name, item);
 }
 
 bool UserInterface::cd(std::string directoryName)
 {
-    int dirLocation = -1;
-
-    // 遍历当前目录项数组，寻找与 directoryName 同名且可访问的目录项
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
-    {
-        // 如果 inodeIndex 为 0，表示该位置没有更多有效目录项，退出遍历
-        if (directory.item[i].inodeIndex == 0)
-        {
-            break;
-        }
-        // 比较目录项名称与传入的 directoryName，同时调用 judge() 确认该目录项是可访问的目录
-        if (std::strcmp(directory.item[i].name, directoryName.c_str()) == 0 &&
-            judge(directory.item[i].inodeIndex))
-        {
-            // 找到匹配的目录项，记录其索引并跳出循环
-            dirLocation = i;
-            break;
-        }
-    }
-
-    // 如果没有找到有效的同名目录项，输出错误提示并返回 false
-    if (dirLocation == -1)
+    // 在当前目录中查找与 directoryName 同名的目录项，由目录项中记录的文件类型确认它是目录
+    Dirent item{};
+    if (!DirectoryFile::lookup(fileSystem, nowDirectory, directoryName, item) || item.fileType != FileType::DIRECTORY)
     {
+        // 如果没有找到有效的同名目录项，输出错误提示并返回 false
         std::cout << "cd: " << directoryName << ": No such directory" << std::endl;
         return false;
     }
 
-    // 获取要进入目录对应的 inode 索引（磁盘上该目录的 i-node 号）
-    uint32_t directoryInodeDisk = directory.item[dirLocation].inodeIndex;
-
-    // 从磁盘读取该目录的 INode 信息到 iNode 结构体
-    INode iNode{};
-    fileSystem->read(directoryInodeDisk, 0, reinterpret_cast<char *>(&iNode), sizeof(iNode));
-
-    // 将当前目录磁盘块号更新为 iNode.bno（该目录在磁盘上存放的首数据块）
-    nowDiretoryDisk = iNode.bno;
-
-    // 从磁盘读取新的目录结构（directory 结构体）到内存
-    fileSystem->read(iNode.bno, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-
+    // 将当前目录切换为该目录的 i-node
+    nowDirectory = item.inodeIndex;
     return true;
 }
 
-bool UserInterface::judge(uint32_t disk)
-{
-    INode iNode{};
-    fileSystem->read(disk, 0, reinterpret_cast<char *>(&iNode), sizeof(iNode));
-    if ((iNode.flag & 0xC0) == 0x40)
-    { // 是目录，01,xxx,xxx & 11,000,000 == 01,000,000
-        return true;
-    }
-    else if ((iNode.flag & 0xC0) == 0)
-    { // 是文件，00,xxx,xxx & 11,000,000 == 0
-        return false;
-    }
-    return false;
-}
-
 void UserInterface::rm(uint8_t uid, std::string fileName)
 {
-    int fileLocation = -1;
-    // 遍历当前目录的目录项数组，查找名称匹配且不可再进入（即是文件而非目录）的项目
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
-    {
-        // 如果遇到 inodeIndex 为 0，说明后面没有更多有效项目，停止遍历
-        if (directory.item[i].inodeIndex == 0)
-        {
-            break;
-        }
-        // strcmp 比较目录项名称与给定 fileName，并用 judge() 判断该 inode 代表的不是目录
-        if (strcmp(directory.item[i].name, fileName.c_str()) == 0 && !judge(directory.item[i].inodeIndex))
-        {
-            // 找到匹配的文件项，将索引记下并退出循环
-            fileLocation = i;
-            break;
-        }
-    }
+    // 在当前目录中查找名称匹配且不是目录的目录项
+    DirectoryFile dir(fileSystem, nowDirectory);
+    Dirent item{};
+    int64_t fileLocation = dir.find(fileName, &item);
 
-    // 如果遍历结束仍未找到对应文件，输出错误提示并返回
-    if (fileLocation == -1)
+    // 如果未找到对应文件，输出错误提示并返回
+    if (fileLocation == -1 || item.fileType == FileType::DIRECTORY)
     {
         std::cout << "rm: " << YELLOW << "cannot" << RESET << " remove '" << fileName << "': "
                   << "No such file" << std::endl;
         return;
     }
 
-    // 找到文件对应的 INode，准备释放其所有占用的磁盘空间
-    INode fileIndexInode{};
-    fileSystem->read(
-        directory.item[fileLocation].inodeIndex, // 传入找到的 inode 索引
-        0,
-        reinterpret_cast<char *>(&fileIndexInode), // 将磁盘上的 INode 数据读到 fileIndexInode
-        sizeof(fileIndexInode));
-
-    // 循环释放该文件的所有数据块或索引块，直到 fileIndexBlockFree 返回 0 表示没有下一个索引块
-    uint32_t next = fileIndexBlockFree(fileIndexInode.bno);
-    while (next != 0)
-        next = fileIndexBlockFree(next);
-
-    // 释放保存文件索引表的 INode 本身
-    fileSystem->blockFree(directory.item[fileLocation].inodeIndex);
-
-    // 从目录中移除该文件项：将后续目录项依次前移覆盖当前位置，以保持目录项数组连续
-    wholeDirItemsMove(fileLocation);
+    // 文件仍在打开表中时不能删除，否则回收后关闭或写回会用旧 i 结点覆盖已被复用的 i 结点和块
+    if (findOpened(item.inodeIndex) != nullptr)
+    {
+        std::cout << "rm: " << YELLOW << "cannot" << RESET << " remove '" << fileName << "': "
+                  << "File is open" << std::endl;
+        return;
+    }
 
-    // 将修改后的目录结构写回到当前目录所在的磁盘块
-    fileSystem->write(
-        nowDiretoryDisk, // 当前目录所在磁盘块号
-        0,
-        reinterpret_cast<char *>(&directory), // 目录结构的新内容
-        sizeof(directory));
+    // 从目录中移除该文件项，文件的 i 结点挂到孤儿目录下，占用的块由后台回收线程分批归还
+    dir.remove(fileLocation);
+    fileSystem->orphan(item);
 
     // 更新超级块等元信息，将本次删除操作的修改写回磁盘
     fileSystem->update();
 }
 
-uint32_t UserInterface::fileIndexBlockFree(uint32_t disk)
+void UserInterface::collectFileBlocks(inodeno_t ino, std::vector<blockno_t> &blocks)
 {
-    // 读取磁盘上位于 'disk' 块号的 FileIndex 结构
-    FileIndex fileIndex{};
-    fileSystem->read(
-        disk,                                 // 要读取的磁盘块号
-        0,                                    // 块内偏移为 0（从块头开始）
-        reinterpret_cast<char *>(&fileIndex), // 将数据读入 fileIndex 结构
-        sizeof(fileIndex));                   // 读取整个 FileIndex 大小
-
-    // 遍历 fileIndex.index 数组，直到遇到 0 或遍历完 FILE_INDEX_SIZE 项
-    for (int i = 0; i < FILE_INDEX_SIZE && fileIndex.index[i] != 0; i++)
-    {
-        // 回收该文件数据块：fileIndex.index[i] 存储了一个数据块号
-        fileSystem->blockFree(fileIndex.index[i]);
-        // 将索引置 0，表示该数据块已经释放
-        fileIndex.index[i] = 0;
-    }
-
-    // 保留下一块索引块的块号，以便递归释放
-    uint32_t next = fileIndex.next;
-
-    // 释放当前的索引块本身
-    fileSystem->blockFree(disk);
+    INode iNode{};
+    fileSystem->readINode(ino, iNode);
+    // 按文件的块映射收集所有数据块和映射元数据块
+    FileMap fileMap(fileSystem, iNode);
+    fileMap.collect(blocks);
+    // 文件的 i 结点本身直接归还 i 节点表
+    fileSystem->freeINode(ino);
+}
 
-    // 返回下一个索引块的块号（如果为 0，则表示没有后续索引块）
-    return next;
+void UserInterface::collectDirectoryBlocks(inodeno_t ino, std::vector<blockno_t> &blocks)
+{
+    DirectoryFile dir(fileSystem, ino);
+    // 文件收集其全部块，子目录递归收集，跳过指向自身和上级的 . 与 ..
+    dir.forEach([&](uint32_t, const Dirent &item)
+    {
+        if (item.name == "." || item.name == "..")
+            return true;
+        if (item.fileType == FileType::DIRECTORY)
+            collectDirectoryBlocks(item.inodeIndex, blocks);
+        else
+            collectFileBlocks(item.inodeIndex, blocks);
+        return true;
+    });
+    // 所有目录块及其块映射，目录的 i 结点本身直接归还 i 节点表
+    dir.collect(blocks);
+    fileSystem->freeINode(ino);
 }
 
-void UserInterface::rmdir(uint8_t uid, std::string dirName)
+bool UserInterface::anyOpened()
 {
-    // 先查找对应目录
-    int dirLocation = -1;
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
-    {
-        if (directory.item[i].inodeIndex == 0)
-            break;
-        if (strcmp(directory.item[i].name, dirName.c_str()) == 0 && judge(directory.item[i].inodeIndex))
-        {
-            dirLocation = i;
-            break;
-        }
-    }
-    if (dirLocation == -1)
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
     {
-        std::cout << "rmdir: " << RED << "failed" << RESET << " to remove '" << dirName << "': " << RED << "No" << RESET
-                  << " such directory" << std::endl;
-        return;
+        if (fileOpenTable[i].fileNumber != 0)
+            return true;
     }
-    // 保存当前目录所在磁盘块
-    uint32_t nowDisk = nowDiretoryDisk;
-    // 进入指定目录
-    INode dirInode1{};
-    fileSystem->read(directory.item[dirLocation].inodeIndex, 0, reinterpret_cast<char *>(&dirInode1),
-                     sizeof(dirInode1));
-    fileSystem->read(dirInode1.bno, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    nowDiretoryDisk = dirInode1.bno;
+    return false;
+}
 
-    // 一个目录的目录项如果只有前两项或者前一项(根目录),那么该层目录递归结束
-    if (directory.item[1].inodeIndex == 0 || directory.item[2].inodeIndex == 0)
-    {
-        // 回收本层目录所有磁盘块
-        fileSystem->blockFree(nowDiretoryDisk);
-        //        return;
-    }
-    else
+bool UserInterface::hasOpened(inodeno_t dir)
+{
+    // 打开表为空时不用遍历子树；open 也接受目录，目录本身和各级子目录同样要检查
+    if (!anyOpened())
+        return false;
+    if (findOpened(dir) != nullptr)
+        return true;
+    bool opened = false;
+    DirectoryFile(fileSystem, dir).forEach([&](uint32_t, const Dirent &item)
     {
-        // 还有其他项
-        // 如果是文件,就使用rm接口;如果是目录,就递归调用rmdir
-        for (int i = 0; i < DIRECTORY_NUMS; i++)
-        {
-            if (directory.item[i].inodeIndex == 0)
-                break;
-            // 文件
-            if (!judge(directory.item[i].inodeIndex))
-                rm(uid, directory.item[i].name);
-            // 目录
-            else if (strcmp(directory.item[i].name, ".") != 0 && strcmp(directory.item[i].name, "..") != 0)
-            {
-                // 保存当前目录
-                uint32_t nowDiretoryDisk1 = nowDiretoryDisk;
-                INode dirInode{};
-                fileSystem->read(directory.item[i].inodeIndex, 0, reinterpret_cast<char *>(&dirInode),
-                                 sizeof(dirInode));
-                // 进入下一目录
-                fileSystem->read(dirInode.bno, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-                nowDiretoryDisk = dirInode.bno;
-                // 回收该i结点
-                fileSystem->blockFree(directory.item[i].inodeIndex);
-                directory.item[i].inodeIndex = 0;
-                // 递归删除
-                rmdir(uid, directory.item[i].name);
-                // 递归返回时重置当前目录
-                fileSystem->read(nowDiretoryDisk1, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-                nowDiretoryDisk = nowDiretoryDisk1;
-            }
-        }
-    }
-
-    // 回收指定目录的i结点所在磁盘块
-    fileSystem->blockFree(directory.item[dirLocation].inodeIndex);
-    directory.item[dirLocation].inodeIndex = 0;
-    // 重置当前目录
-    fileSystem->read(nowDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    nowDiretoryDisk = nowDisk;
-    // 更新目录项
-    wholeDirItemsMove(dirLocation);
-    // 将新的目录项写入磁盘
-    fileSystem->write(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    fileSystem->update();
+        if (item.name == "." || item.name == "..")
+            return true;
+        if (item.fileType == FileType::DIRECTORY)
+            opened = hasOpened(item.inodeIndex);
+        else
+            opened = findOpened(item.inodeIndex) != nullptr;
+        return !opened;
+    });
+    return opened;
 }
 
-void UserInterface::wholeDirItemsMove(int itemLocation)
+bool UserInterface::rmdir(uint8_t uid, std::string dirName)
 {
-    // 如果恰好是最后一项
-    if (itemLocation == DIRECTORY_NUMS - 1)
+    // 先查找对应目录，. 与 .. 不能删除
+    DirectoryFile dir(fileSystem, nowDirectory);
+    Dirent item{};
+    int64_t dirLocation = dir.find(dirName, &item);
+    if (dirLocation == -1 || item.fileType != FileType::DIRECTORY || dirName == "." || dirName == "..")
     {
-        directory.item[itemLocation].inodeIndex = 0;
-        return;
+        std::cout << "rmdir: " << RED << "failed" << RESET << " to remove '" << dirName << "': " << RED << "No" << RESET
+                  << " such directory" << std::endl;
+        return false;
     }
-    // 目录项整体前移
-    for (int i = itemLocation; i < DIRECTORY_NUMS; i++)
+    // 子树中还有打开的文件时不能删除，先关闭这些文件
+    if (hasOpened(item.inodeIndex))
     {
-        if (directory.item[i].inodeIndex == 0)
-            break;
-        strcpy(directory.item[i].name, directory.item[i + 1].name);
-        directory.item[i].inodeIndex = directory.item[i + 1].inodeIndex;
+        std::cout << "rmdir: " << RED << "failed" << RESET << " to remove '" << dirName << "': "
+                  << "Directory is open or contains open files" << std::endl;
+        return false;
     }
+    // 从目录中移除该目录项后立即返回，整棵子树挂到孤儿目录下由后台回收线程分批回收
+    dir.remove(dirLocation);
+    fileSystem->orphan(item);
+    fileSystem->update();
+    return true;
 }
 
+
+
 void UserInterface::mv(std::vector<std::string> src, std::vector<std::string> des)
 {
-    /*查找源文件或者目录的i结点*/
+    /*查找源文件或者目录的目录项*/
 
-    // 被移动的文件或者目录的i结点所在磁盘块号
-    uint32_t srcInodeIndex = 0;
-    Directory tmpDirSrc{};
-    uint32_t tmpDirDiskSrc;
-    int srcIndex;
-    // 查找源文件所在的目录所在的磁盘块号以及对应目录项编号
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    if (!DirectoryFile::validName(src.back()))
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
+        std::cout << "mv: " << RED << "failed" << RESET << ":File name too long" << std::endl;
         return;
     }
-    tmpDirDiskSrc = findRes.first;
-    fileSystem->read(tmpDirDiskSrc, 0, reinterpret_cast<char *>(&tmpDirSrc), sizeof(tmpDirSrc));
-    srcIndex = findRes.second;
-    srcInodeIndex = tmpDirSrc.item[srcIndex].inodeIndex;
-    if (srcInodeIndex == 0)
+    // 查找源文件所在的目录的i结点号以及对应目录项编号
+    auto findRes = findDisk(src);
+    Dirent srcItem{};
+    if (findRes.first == 0 || !DirectoryFile(fileSystem, findRes.first).get(findRes.second, srcItem) ||
+        srcItem.name == "." || srcItem.name == "..")
     {
         std::cout << "mv: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
         return;
     }
 
     /*查找目的目录*/
-    // 查找目的目录所在的目录所在的磁盘块号以及对应目录项编号
-    auto findResDes = findDisk(des);
-    Directory tmpDir{};
-    uint32_t tmpDirDisk = findResDes.first;
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-    uint32_t desInodeIndex = tmpDir.item[findResDes.second].inodeIndex;
+    inodeno_t desInodeIndex = findDirectory(des);
     if (desInodeIndex == 0)
     {
         std::cout << "mv: " << RED << "failed" << RESET << ":cannot find des" << std::endl;
         return;
     }
-    INode desInode{};
-    fileSystem->read(desInodeIndex, 0, reinterpret_cast<char *>(&desInode), sizeof(desInode));
-    tmpDirDisk = desInode.bno;
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-    // 在目标目录查找空目录项
-    int location = -1;
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
+    DirectoryFile desDir(fileSystem, desInodeIndex);
+    if (desDir.find(srcItem.name) != -1)
     {
-        if (tmpDir.item[i].inodeIndex == 0)
-        {
-            location = i;
-            break;
-        }
+        std::cout << "mv: " << RED << "failed" << RESET << ":des file exists" << std::endl;
+        return;
     }
-    if (location == -1)
+    // 先在目的目录中加入目录项，再从源目录中移除
+    if (!desDir.add(srcItem.name, srcItem.inodeIndex, srcItem.fileType, srcItem.mode))
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":des directory full" << std::endl;
+        std::cout << "mv: no space left on disk" << std::endl;
         return;
     }
-
-    // 保存当前目录,设置当前目录为被移动的文件所在的目录
-    std::swap(directory, tmpDirSrc);
-    std::swap(nowDiretoryDisk, tmpDirDiskSrc);
-    // 更新被移动的文件所在的目录
-    wholeDirItemsMove(srcIndex);
-    // 将新的目录项写入磁盘
-    fileSystem->write(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    fileSystem->update();
-    //    std::swap(directory, tmpDirSrc);
-    std::swap(nowDiretoryDisk, tmpDirDiskSrc);
-    fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
-    strcpy(tmpDir.item[location].name, src.back().c_str());
-    tmpDir.item[location].inodeIndex = srcInodeIndex;
-    fileSystem->write(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
+    DirectoryFile(fileSystem, findRes.first).remove(findRes.second);
+    // 被移动的是目录时，其 .. 改为指向新的上级目录
+    if (srcItem.fileType == FileType::DIRECTORY)
+    {
+        DirectoryFile moved(fileSystem, srcItem.inodeIndex);
+        int64_t parentLocation = moved.find("..");
+        if (parentLocation != -1)
+            moved.setINode(parentLocation, desInodeIndex);
+    }
     fileSystem->update();
 }
 
-std::pair<uint32_t, int> UserInterface::findDisk(std::vector<std::string> src)
+std::pair<inodeno_t, uint32_t> UserInterface::findDisk(std::vector<std::string> src)
 {
     // 获取名
     std::string srcName = src.back();
-    src.pop_back();
-    uint32_t tmpDirectoryDisk = nowDiretoryDisk;
-    bool ok = true;      // 能否找到目录
-    std::string dirName; // 输出错误信息用
-    // 在此次直接调用cd函数来寻找
-    for (std::string &item : src)
+    inodeno_t dir;
+    if (!walk(src, src.size() - 1, dir))
     {
-        if (item == "")
+        return std::make_pair(0, 0);
+    }
+    int64_t location = 0;
+    if (srcName != "")
+    {
+        // 找到对应目录项的位置，先用目录项缓存排除不存在的名字
+        Dirent item{};
+        location = DirectoryFile::lookup(fileSystem, dir, srcName, item) ? DirectoryFile(fileSystem, dir).find(srcName) : -1;
+        if (location == -1)
         {
-            // 空，直接寻找根目录
-            goToRoot();
+            std::cout << RED << "failed " << RESET << "'" << srcName << "' No such directory or file" << std::endl;
+            return std::make_pair(0, 0);
         }
-        else if (item == "..")
+    }
+    else
+    {
+        // 根目录自身，第0项 . 指向根目录
+        dir = fileSystem->getRootINode();
+    }
+    return std::make_pair(dir, static_cast<uint32_t>(location));
+}
+
+bool UserInterface::walk(const std::vector<std::string> &src, size_t count, inodeno_t &dir)
+{
+    // 从当前目录出发逐级经目录项缓存查找前 count 个目录，只在局部变量中推进，不切换当前目录
+    dir = nowDirectory;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (src[i] == "")
         {
-            // 上级
-            ok = cd(item);
+            // 空，直接寻找根目录
+            dir = fileSystem->getRootINode();
+            continue;
         }
-        else if (item == ".")
+        if (src[i] == ".")
         {
             // 当前
             continue;
         }
-        else
-        {
-            ok = cd(item);
-        }
-        if (!ok)
+        // 下级目录或上级目录 ..，都按目录项查找
+        Dirent item{};
+        if (!DirectoryFile::lookup(fileSystem, dir, src[i], item) || item.fileType != FileType::DIRECTORY)
         {
-            dirName = item; // 记录哪一步出错了
-            break;
+            std::cout << RED << "failed: " << RESET << "'" << src[i] << "' No such directory" << std::endl;
+            return false;
         }
+        dir = item.inodeIndex;
     }
-    if (!ok)
+    return true;
+}
+
+blockno_t UserInterface::homeOf(const std::vector<std::string> &src)
+{
+    inodeno_t dir;
+    if (src.empty() || !walk(src, src.size() - 1, dir))
     {
-        std::cout << RED << "failed: " << RESET << "'" << dirName << "' No such directory" << std::endl;
-        // 还原现场
-        nowDiretoryDisk = tmpDirectoryDisk;
-        fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof directory);
-        return std::make_pair(-1, -1);
+        return 0;
     }
-    int location = -1;
-    if (srcName != "")
+    return DirectoryFile(fileSystem, dir).blockAt(0);
+}
+
+bool UserInterface::findItem(std::vector<std::string> src, Dirent &item)
+{
+    // 最后一级也经目录项缓存查找，只需要目录项内容而不需要其位置
+    inodeno_t dir;
+    if (!walk(src, src.size() - 1, dir))
     {
-        // 找到对应i结点
-        for (int i = 0; i < DIRECTORY_NUMS; i++)
-        {
-            if (directory.item[i].inodeIndex == 0)
-                break;
-            if (strcmp(directory.item[i].name, srcName.c_str()) == 0)
-            {
-                location = i;
-                break;
-            }
-        }
-        if (location == -1)
-        {
-            std::cout << RED << "failed " << RESET << "'" << srcName << "' No such directory or file" << std::endl;
-            // 还原现场
-            nowDiretoryDisk = tmpDirectoryDisk;
-            fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof directory);
-            return std::make_pair(-1, -1);
-        }
+        return false;
     }
-    else
+    if (src.back() == "")
     {
-        goToRoot();
-        location = 0;
+        // 根目录自身
+        item = Dirent{fileSystem->getRootINode(), FileType::DIRECTORY, 0, "."};
+        return true;
+    }
+    if (!DirectoryFile::lookup(fileSystem, dir, src.back(), item))
+    {
+        std::cout << RED << "failed " << RESET << "'" << src.back() << "' No such directory or file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inodeno_t UserInterface::findINode(std::vector<std::string> src)
+{
+    Dirent item{};
+    if (!findItem(std::move(src), item))
+    {
+        return 0;
+    }
+    return item.inodeIndex;
+}
+
+inodeno_t UserInterface::findDirectory(std::vector<std::string> src)
+{
+    // 由目录项中记录的文件类型判断是否为目录，不读取其 i 结点
+    Dirent item{};
+    if (!findItem(std::move(src), item) || item.fileType != FileType::DIRECTORY)
+    {
+        return 0;
     }
-    // 记录下需要返回的数据
-    std::pair<uint32_t, int> ret = std::make_pair(nowDiretoryDisk, location);
-    // 还原现场
-    nowDiretoryDisk = tmpDirectoryDisk;
-    fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof directory);
-    return ret;
+    return item.inodeIndex;
 }
 
 void UserInterface::rename(std::vector<std::string> src, std::string newName)
 {
+    if (!DirectoryFile::validName(src.back()) || !DirectoryFile::validName(newName))
+    {
+        std::cout << "rename: " << RED << "failed" << RESET << ":File name too long" << std::endl;
+        return;
+    }
     auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    if (findRes.first == 0)
     {
         std::cout << "rename: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
         return;
     }
-    // 找到需要被改名的文件或者目录所在的目录,和其对应的目录项编号
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-    int dirLocation = findRes.second;
-    strcpy(tmpDir.item[dirLocation].name, newName.c_str());
-    fileSystem->write(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
+    // 找到需要被改名的文件或者目录所在的目录,只改写其对应的目录项;新名字放不下原记录时目录项换到新位置
+    DirectoryFile dir(fileSystem, findRes.first);
+    if (dir.find(newName) != -1)
+    {
+        std::cout << "rename: " << RED << "failed" << RESET << ":'" << newName << "' exists" << std::endl;
+        return;
+    }
+    if (!dir.rename(findRes.second, newName))
+    {
+        std::cout << "rename: no space left on disk" << std::endl;
+    }
+    fileSystem->update();
 }
 
 uint8_t UserInterface::userVerify(std::string &username, std::string &password)
@@ -675,27 +573,20 @@ void UserInterface::format()
 {
     // 调用底层文件系统的 format 方法，传入块数量（BLOCK_SIZE/8 表示每个块能存放的 INode 数量或类似含义）
     fileSystem->format(BLOCK_SIZE / 8);
+    // 格式化后原来的文件都不存在了，清空整个打开表；预留也被清空，延迟分配尚未写出的数据一并丢弃。
+    // 否则之后的 close、logout 会把格式化前的 i 结点写进新的 i 节点表
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
+    {
+        fileOpenTable[i].fileNumber = 0;
+        fileOpenTable[i].cursor = 0;
+        fileOpenTable[i].delayed.clear();
+    }
 
     // 更新超级块等元数据，将格式化操作写回磁盘
     fileSystem->update();
 
-    // 读取根目录的 INode（超级块里的 rootLocation 指定了根目录 INode 所在位置）
-    INode iNode{};
-    fileSystem->read(
-        fileSystem->getRootLocation(),    // 根目录 INode 在磁盘上的块号
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 将读取结果写入 iNode 结构
-        sizeof(iNode));                   // 读取整个 INode 大小
-
-    // 将当前目录指针设置为根目录 INode 所指向的数据块（目录内容所在磁盘块）
-    nowDiretoryDisk = iNode.bno;
-
-    // 从磁盘读取根目录的数据到 directory 结构中，以便后续 ls、cd 等操作使用
-    fileSystem->read(
-        nowDiretoryDisk,                      // 根目录内容所在磁盘块号
-        0,                                    // 块内偏移 0
-        reinterpret_cast<char *>(&directory), // 将读取结果写入 directory 结构
-        sizeof(directory));                   // 读取整个目录结构大小
+    // 将当前目录设置为根目录（超级块里的 rootLocation 记录了根目录的 i-node 号），以便后续 ls、cd 等操作使用
+    nowDirectory = fileSystem->getRootINode();
 }
 
 void UserInterface::chmod(std::string who, std::string how, std::vector<std::string> src)
@@ -755,428 +646,165 @@ void UserInterface::chmod(std::string who, std::string how, std::vector<std::str
         }
     }
     auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    Dirent item{};
+    if (findRes.first == 0 || !DirectoryFile(fileSystem, findRes.first).get(findRes.second, item))
     {
         std::cout << "chmod: " << RED << "failed" << RESET << ":no such file" << std::endl;
         return;
     }
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    fileSystem->write(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
     INode iNode{};
-    fileSystem->read(tmpDir.item[findRes.second].inodeIndex, 0, reinterpret_cast<char *>(&iNode), sizeof(iNode));
+    fileSystem->readINode(item.inodeIndex, iNode);
     iNode.flag &= rwxResult;
-    fileSystem->write(tmpDir.item[findRes.second].inodeIndex, 0, reinterpret_cast<char *>(&iNode), sizeof(iNode));
+    fileSystem->writeINode(item.inodeIndex, iNode);
+    // 同步该路径目录项中的权限摘要
+    DirectoryFile(fileSystem, findRes.first).setMode(findRes.second, iNode.flag & 0x3f);
 }
 
 void UserInterface::cd(std::vector<std::string> src)
 {
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    inodeno_t inodeIndex = findDirectory(src);
+    if (inodeIndex == 0)
     {
         std::cout << "cd: " << RED << "failed" << RESET << ":no such directory" << std::endl;
         return;
     }
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-    uint32_t InodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    INode dirInode{};
-    fileSystem->read(InodeDisk, 0, reinterpret_cast<char *>(&dirInode), sizeof(dirInode));
-    nowDiretoryDisk = dirInode.bno;
-    fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
+    nowDirectory = inodeIndex;
 }
 
 void UserInterface::mkdir(uint8_t uid, std::vector<std::string> src, std::string dirName)
 {
-    // 根据传入的路径 src（各级目录名），查找对应的磁盘块和目录项索引
-    // findRes.first  = 父目录所在的磁盘块号
-    // findRes.second = 在该目录中对应 src 最后一个元素的目录项索引
-    auto findRes = findDisk(std::move(src));
-    if (findRes.first == -1)
+    // 根据传入的路径 src（各级目录名），查找目标目录的 i-node
+    inodeno_t inodeIndex = findDirectory(std::move(src));
+    if (inodeIndex == 0)
     {
         // 如果未找到对应目录，输出错误并返回
         std::cout << "mkdir: " << RED << "failed" << RESET << ": no such directory" << std::endl;
         return;
     }
 
-    // 首先将 findRes.first 作为临时目录块号读取该目录结构
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    fileSystem->read(
-        tmpDirDisk,                        // 读取该磁盘块
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 结构中
-        sizeof(tmpDir));                   // 读取整个目录结构大小
-
-    // 从刚才读取的目录中，根据 findRes.second 获取目标子目录的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-
-    // 读取该 inode，拿到它的 bno，即“该子目录内容所在的数据块号”
-    INode iNode{};
-    fileSystem->read(
-        inodeDisk,                        // 子目录对应的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 将读取结果写入 iNode 结构
-        sizeof(iNode));                   // 读取整个 INode 大小
-
-    // 将 tmpDirDisk 更新为子目录数据块号（iNode.bno 指向实际的目录内容块）
-    tmpDirDisk = iNode.bno;
-
-    // 读取子目录对应的数据块，将该目录内容加载到 tmpDir 中
-    fileSystem->read(
-        tmpDirDisk,                        // 子目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 将内容读入 tmpDir
-        sizeof(tmpDir));                   // 读取整个目录结构大小
-
-    // 交换当前目录与 tmpDir，使得后续调用 mkdir(uid, dirName) 时，当前目录被切换到目标父目录
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-
-    // 在刚才切换到的目录下创建名为 dirName 的新目录
-    // 这里调用了重载的 mkdir(uid, dirName)，它只需在“当前目录”下建目录
+    // 暂时把当前目录切换到目标目录，使得后续调用的 mkdir(uid, std::move(dirName)) 作用于该目录
+    std::swap(nowDirectory, inodeIndex);
     mkdir(uid, std::move(dirName));
-
-    // 创建完成后，再将 directory 和 nowDiretoryDisk 交换回去，恢复原来的“当前目录”状态
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
+    // 完成后恢复原来的“当前目录”
+    std::swap(nowDirectory, inodeIndex);
 }
 
-void UserInterface::ls(std::vector<std::string> src)
+void UserInterface::ls(std::vector<std::string> src, bool detail)
 {
-    // 首先通过 findDisk 查找传入路径 src 对应的目录块和目录项索引
-    // findRes.first  = 目录所在磁盘块号
-    // findRes.second = 该目录在目录块中的目录项索引
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    // 首先通过 findDirectory 查找传入路径 src 对应目录的 i-node
+    inodeno_t inodeIndex = findDirectory(src);
+    if (inodeIndex == 0)
     {
         // 如果未找到对应目录，输出错误提示并返回
         std::cout << "ls: " << RED << "failed" << RESET << ": no such directory" << std::endl;
         return;
     }
 
-    // 将找到的目录块号保存到临时变量 tmpDirDisk
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    // 读取该目录块内容到 tmpDir 结构中
-    fileSystem->read(
-        tmpDirDisk,                        // 目标目录块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 中
-        sizeof(tmpDir));                   // 大小为整个目录结构
-
-    // 根据 findRes.second 获取该目录项对应的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    INode iNode{};
-    // 读取该 inode，拿到其 bno（目录内容所在的数据块号）
-    fileSystem->read(
-        inodeDisk,                        // 目录项对应的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 读取到 iNode 中
-        sizeof(iNode));                   // 大小为整个 INode 结构
-
-    // 将 tmpDirDisk 更新为子目录实际存放内容的块号
-    tmpDirDisk = iNode.bno;
-    // 读取子目录内容到 tmpDir 中
-    fileSystem->read(
-        tmpDirDisk,                        // 子目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 中
-        sizeof(tmpDir));                   // 大小为整个目录结构
-
-    // 交换当前目录和 tmpDir，使得后续调用 ls() 时在目标目录下执行
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-
-    // 在刚才切换到的目录下执行 ls，无参版本会列出当前目录的所有项
-    ls();
-
-    // ls 完成后，再将目录恢复为原来的“当前目录”
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
+    // 直接列出目标目录，不切换当前目录
+    listDirectory(inodeIndex, detail);
 }
 
 void UserInterface::touch(uint8_t uid, std::vector<std::string> src, std::string fileName)
 {
-    // 使用 findDisk 查找传入路径 src 对应的目录块号和目录项索引
-    // findRes.first  = 目录所在的磁盘块号
-    // findRes.second = 该目录在目录块中的目录项索引
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    // 根据传入的路径 src（各级目录名），查找目标目录的 i-node
+    inodeno_t inodeIndex = findDirectory(std::move(src));
+    if (inodeIndex == 0)
     {
-        // 未找到对应目录，输出错误提示并返回
+        // 如果未找到对应目录，输出错误并返回
         std::cout << "touch: " << RED << "failed" << RESET << ": no such directory" << std::endl;
         return;
     }
 
-    // 将找到的父目录块号保存到临时变量 tmpDirDisk
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    // 从磁盘读取该目录结构到 tmpDir
-    fileSystem->read(
-        tmpDirDisk,                        // 目标目录块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 结构
-        sizeof(tmpDir));                   // 读取整个目录结构大小
-
-    // 根据 findRes.second 获取该目录项对应的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    INode iNode{};
-    // 读取该 inode，拿到其 bno 字段（指向目录内容所在的数据块号）
-    fileSystem->read(
-        inodeDisk,                        // 目录项对应的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 将数据读到 iNode 结构
-        sizeof(iNode));                   // 读取整个 INode 大小
-
-    // 更新 tmpDirDisk 为子目录实际存放内容的块号（iNode.bno）
-    tmpDirDisk = iNode.bno;
-    // 从磁盘读取子目录内容到 tmpDir
-    fileSystem->read(
-        tmpDirDisk,                        // 子目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 结构
-        sizeof(tmpDir));                   // 读取整个目录结构大小
-
-    // 将当前目录与 tmpDir 交换，使得下面调用无参 touch(uid, fileName) 时
-    // 作用于刚才找到的目标目录
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-
-    // 在已经切换到的目标目录下调用无参版本的 touch，创建或更新文件
+    // 暂时把当前目录切换到目标目录，使得后续调用的 touch(uid, fileName) 作用于该目录
+    std::swap(nowDirectory, inodeIndex);
     touch(uid, fileName);
-
-    // 创建完成后，将目录状态恢复到原来的“当前目录”
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
+    // 完成后恢复原来的“当前目录”
+    std::swap(nowDirectory, inodeIndex);
 }
 
 void UserInterface::rm(uint8_t uid, std::vector<std::string> src, std::string fileName)
 {
-    // 使用 findDisk 查找 src 指定路径对应的目录块号和目录项索引
-    // findRes.first  = 目录所在的磁盘块号
-    // findRes.second = 该目录在目录块中的目录项索引
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    // 根据传入的路径 src（各级目录名），查找目标目录的 i-node
+    inodeno_t inodeIndex = findDirectory(std::move(src));
+    if (inodeIndex == 0)
     {
-        // 若未找到对应目录，提示错误并返回
+        // 如果未找到对应目录，输出错误并返回
         std::cout << "rm: " << RED << "failed" << RESET << ": no such directory" << std::endl;
         return;
     }
 
-    // 将找到的父目录块号保存到临时变量 tmpDirDisk
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    // 从磁盘读取该父目录内容到 tmpDir 结构
-    fileSystem->read(
-        tmpDirDisk,                        // 父目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 将内容读入 tmpDir
-        sizeof(tmpDir));                   // 大小为整个目录结构
-
-    // 根据 findRes.second 得到目标子目录或文件所在的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    INode iNode{};
-    // 读取该 inode，获取其 bno 字段（指向子目录内容所在的数据块号）
-    fileSystem->read(
-        inodeDisk,                        // 目标条目对应的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 将数据读入 iNode
-        sizeof(iNode));                   // 大小为整个 INode 结构
-
-    // 更新 tmpDirDisk 为子目录实际存放内容的块号
-    tmpDirDisk = iNode.bno;
-    // 从磁盘读取子目录内容到 tmpDir
-    fileSystem->read(
-        tmpDirDisk,                        // 子目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 将内容读入 tmpDir
-        sizeof(tmpDir));                   // 大小为整个目录结构
-
-    // 交换当前目录与 tmpDir，使得随后调用无参版本 rm(uid, fileName) 时
-    // 实际在刚才找到的目标目录下执行删除操作
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-
-    // 在切换到的目标目录下执行 rm(uid, fileName)，删除指定文件
+    // 暂时把当前目录切换到目标目录，使得后续调用的 rm(uid, fileName) 作用于该目录
+    std::swap(nowDirectory, inodeIndex);
     rm(uid, fileName);
-
-    // 删除完成后，将目录状态恢复到原来的“当前目录”
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
+    // 完成后恢复原来的“当前目录”
+    std::swap(nowDirectory, inodeIndex);
 }
 
 void UserInterface::rmdir(uint8_t uid, std::vector<std::string> src, std::string dirName)
 {
-    // 使用 findDisk 查找传入路径 src 对应的父目录块号和目录项索引
-    // findRes.first  = 父目录所在的磁盘块号
-    // findRes.second = 在该父目录中 src 对应目录项的索引
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    // 根据传入的路径 src（各级目录名），查找目标目录的 i-node
+    inodeno_t inodeIndex = findDirectory(std::move(src));
+    if (inodeIndex == 0)
     {
-        // 如果未找到对应目录，输出错误提示并返回
+        // 如果未找到对应目录，输出错误并返回
         std::cout << "rmdir: " << RED << "failed" << RESET << ": no such directory" << std::endl;
         return;
     }
 
-    // 将找到的父目录块号保存在临时变量 tmpDirDisk
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    // 从磁盘读取该父目录的内容到临时目录结构 tmpDir 中
-    fileSystem->read(
-        tmpDirDisk,                        // 父目录所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 将数据读入 tmpDir
-        sizeof(tmpDir));                   // 大小为整个目录结构
+    Dirent victim{};
+    bool found = DirectoryFile::lookup(fileSystem, inodeIndex, dirName, victim);
 
-    // 从 tmpDir 中根据 findRes.second 获取目标子目录的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    INode iNode{};
-    // 读取该子目录对应的 INode，获取其 bno（表示该目录内容所在的数据块号）
-    fileSystem->read(
-        inodeDisk,                        // 目标子目录的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 将数据读入 iNode
-        sizeof(iNode));                   // 读取整个 INode 大小
-
-    // 更新 tmpDirDisk 为子目录实际存放内容的块号（iNode.bno）
-    tmpDirDisk = iNode.bno;
-    // 读取子目录内容到临时目录结构 tmpDir 中
-    fileSystem->read(
-        tmpDirDisk,                        // 子目录内容所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 将数据读入 tmpDir
-        sizeof(tmpDir));                   // 读取整个目录结构大小
-
-    // 将当前目录与 tmpDir 交换，使得接下来调用的无参 rmdir(uid, dirName)
-    // 实际作用于刚才定位到的目标子目录
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-
-    // 在目标子目录下调用无参版本的 rmdir，删除指定名称的子目录
-    rmdir(uid, dirName);
-
-    // 完成后，将 directory 和 nowDiretoryDisk 恢复成原来所在的父目录状态
-    std::swap(directory, tmpDir);
-    std::swap(nowDiretoryDisk, tmpDirDisk);
-}
-
-int UserInterface::judge(std::vector<std::string> src)
-{
-    // 提取路径列表最后一个元素作为目标名称（文件或目录名）
-    std::string srcName = src.back();
-    src.pop_back(); // 从路径列表中移除最后一个元素
-
-    // tmpDirectoryDisk 用来暂存当前目录所在的磁盘块号，初始为当前目录
-    uint32_t tmpDirectoryDisk = nowDiretoryDisk;
-    // tmpDirectory 用来临时存储每次读取的目录内容
-    Directory tmpDirectory = directory;
-
-    // 先处理路径中的中间目录部分，逐层向下遍历
-    while (!src.empty())
+    // 暂时把当前目录切换到目标目录，使得后续调用的 rmdir(uid, dirName) 作用于该目录
+    std::swap(nowDirectory, inodeIndex);
+    bool removed = rmdir(uid, dirName);
+    // 完成后恢复原来的“当前目录”
+    std::swap(nowDirectory, inodeIndex);
+    // 被删除的子树要等后台回收后才释放，当前目录在其中时立即回到根目录
+    if (removed && found && isInside(nowDirectory, victim.inodeIndex))
     {
-        // 取出下一层的目录名
-        std::string dirName = src.front();
-        src.erase(src.begin()); // 将该目录名从列表中移除
-
-        int dirLocation = -1; // 用来记录在当前目录中找到的目录项索引
-
-        // 从磁盘读取 tmpDirectoryDisk 指定块号的目录数据到 tmpDirectory
-        fileSystem->read(
-            tmpDirectoryDisk,                        // 要读取的块号
-            0,                                       // 块内偏移 0
-            reinterpret_cast<char *>(&tmpDirectory), // 读取到 tmpDirectory 结构中
-            sizeof(tmpDirectory));                   // 读取整个目录结构大小
-
-        // 在 tmpDirectory 中查找名称为 dirName 的目录项
-        for (int i = 0; i < DIRECTORY_NUMS; i++)
-        {
-            // 如果遇到 inodeIndex 为 0，说明后面没有更多有效目录项，停止遍历
-            if (tmpDirectory.item[i].inodeIndex == 0)
-                break;
-
-            // strcmp 比较目录项名称与 dirName，并调用重载的 judge(inodeIndex) 检查该项是否是目录
-            if (strcmp(tmpDirectory.item[i].name, dirName.c_str()) == 0 &&
-                judge(tmpDirectory.item[i].inodeIndex))
-            {
-                // 找到匹配且是目录的项目，将索引记为 dirLocation 并退出循环
-                dirLocation = i;
-                break;
-            }
-        }
-
-        // 如果在这一层没有找到名为 dirName 的目录，打印错误并返回 0（表示路径错误）
-        if (dirLocation == -1)
-        {
-            std::cout << RED << "failed " << RESET << "'" << dirName << "' No such directory" << std::endl;
-            return 0;
-        }
-
-        // 读取该目录项对应的 INode，以获取它的 bno（即子目录内容块号）
-        INode dirInode{};
-        fileSystem->read(
-            tmpDirectory.item[dirLocation].inodeIndex, // 目录项的 INode 索引
-            0,                                         // 块内偏移 0
-            reinterpret_cast<char *>(&dirInode),       // 读取到 dirInode 结构
-            sizeof(dirInode));                         // 读取整个 INode 大小
-
-        // 更新 tmpDirectoryDisk 为子目录实际存放内容的块号（dirInode.bno）
-        tmpDirectoryDisk = dirInode.bno;
-        // 从磁盘读取该子目录内容到 tmpDirectory，准备进入下一层循环
-        fileSystem->read(
-            tmpDirectoryDisk,                        // 子目录内容所在块号
-            0,                                       // 块内偏移 0
-            reinterpret_cast<char *>(&tmpDirectory), // 将数据读入 tmpDirectory
-            sizeof(tmpDirectory));                   // 读取整个目录结构大小
+        goToRoot();
     }
+}
 
-    // 到达了目标名称的父目录，现在在 tmpDirectory 中查找最终的文件/目录名 srcName
-    int location = -1;
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
+bool UserInterface::isInside(inodeno_t dir, inodeno_t ancestor)
+{
+    // 沿 .. 逐级向上直到根目录，.. 的查找经过目录项缓存
+    inodeno_t root = fileSystem->getRootINode();
+    for (uint32_t depth = 0; depth < DIRECTORY_DEPTH_MAX; ++depth)
     {
-        // 如果 inodeIndex 为 0，则表示没有更多有效目录项，停止遍历
-        if (tmpDirectory.item[i].inodeIndex == 0)
-            break;
-
-        // 比较目录项名称与 srcName，找到后记录索引并退出循环
-        if (strcmp(tmpDirectory.item[i].name, srcName.c_str()) == 0)
-        {
-            location = i;
-            break;
-        }
+        if (dir == ancestor)
+            return true;
+        Dirent parent{};
+        if (dir == root || !DirectoryFile::lookup(fileSystem, dir, "..", parent))
+            return false;
+        dir = parent.inodeIndex;
     }
+    return false;
+}
 
-    // 如果父目录中没有找到 srcName，打印错误并返回 0（表示该文件或目录不存在）
-    if (location == -1)
-    {
-        std::cout << RED << "failed " << RESET << "'" << srcName << "' No such file or directory" << std::endl;
+int UserInterface::judge(std::vector<std::string> src)
+{
+    // 沿路径找到目标文件/目录对应的目录项，找不到时返回 0（表示路径错误）
+    Dirent item{};
+    if (!findItem(std::move(src), item))
         return 0;
-    }
 
-    // 读取目标文件/目录对应的 INode，以便判断它到底是文件还是目录
-    INode iNode{};
-    fileSystem->read(
-        tmpDirectory.item[location].inodeIndex, // 目标项的 INode 索引
-        0,                                      // 块内偏移 0
-        reinterpret_cast<char *>(&iNode),       // 读取到 iNode 结构
-        sizeof(iNode));                         // 读取整个 INode 大小
-
-    // 调用重载的 judge(bno) 来判断 iNode.bno 指向的块是目录还是文件
-    // 如果返回 true（非 0），表示是目录，函数返回 2
-    // 否则返回 1，表示是普通文件
-    if (judge(iNode.bno))
+    // 根据目录项中记录的文件类型判断是目录还是文件
+    // 是目录时函数返回 2，否则返回 1，表示是普通文件
+    if (item.fileType == FileType::DIRECTORY)
         return 2;
     else
         return 1;
 }
 
+std::mutex &UserInterface::getLock()
+{
+    return fileSystem->getLock();
+}
+
 void UserInterface::goToRoot()
 {
-    INode iNode{};
-    fileSystem->read(fileSystem->getRootLocation(), 0, reinterpret_cast<char *>(&iNode), sizeof(iNode));
-    nowDiretoryDisk = iNode.bno;
-    fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
+    nowDirectory = fileSystem->getRootINode();
 }
 
 void UserInterface::open(std::string how, std::vector<std::string> src)
@@ -1198,46 +826,25 @@ void UserInterface::open(std::string how, std::vector<std::string> src)
     if (hasW)
         rwResult |= _w; // 如果需要写，则在 rwResult 上 OR 上写位
 
-    // 根据传入的路径 src 查找对应文件所在的目录块号和目录项索引
-    auto findRes = findDisk(src);
-    if (findRes.first == -1)
+    // 根据传入的路径 src 经目录项缓存查找对应文件的目录项
+    Dirent item{};
+    if (!findItem(src, item))
     {
         // 如果没找到对应文件，输出错误并返回
         std::cout << "open: " << RED << "failed" << RESET << ": no such file" << std::endl;
         return;
     }
 
-    // 先将父目录块号存于 tmpDirDisk
-    uint32_t tmpDirDisk = findRes.first;
-    Directory tmpDir{};
-    // 读取该父目录的数据到 tmpDir
-    fileSystem->read(
-        tmpDirDisk,                        // 目录所在块号
-        0,                                 // 块内偏移 0
-        reinterpret_cast<char *>(&tmpDir), // 读取到 tmpDir 结构
-        sizeof(tmpDir));                   // 读取整个目录结构
-
-    // 获取目标文件对应的 inode 索引
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
+    // 获取目标文件对应的 inode 号
+    inodeno_t inodeIndex = item.inodeIndex;
     INode iNode{};
     // 读取该 inode，获取其元信息（以便后面存入打开表）
-    fileSystem->read(
-        inodeDisk,                        // 文件对应的 inode 索引
-        0,                                // 块内偏移 0
-        reinterpret_cast<char *>(&iNode), // 读取到 iNode 结构
-        sizeof(iNode));                   // 读取整个 INode 大小
+    fileSystem->readINode(inodeIndex, iNode);
 
     // 保存文件名，以便放入打开表中的 fileName 字段
-    std::string fileName = tmpDir.item[findRes.second].name;
-    // fileNumber 直接用 inodeDisk 作为该文件在打开表中的唯一标识
-    uint32_t fileNumber = inodeDisk;
-
-    // 再次读取文件索引表的 iNode，以保证 iNode 内含索引块信息等（此处与上面类似）
-    fileSystem->read(
-        tmpDir.item[findRes.second].inodeIndex, // 同样的 inode 索引
-        0,
-        reinterpret_cast<char *>(&iNode),
-        sizeof(iNode));
+    std::string fileName = item.name;
+    // fileNumber 直接用 inode 号作为该文件在打开表中的唯一标识
+    inodeno_t fileNumber = inodeIndex;
 
     // 在文件打开表（fileOpenTable）中寻找一个空闲槽或已打开同一文件的冲突
     int fileLocation = -1;
@@ -1276,31 +883,28 @@ void UserInterface::open(std::string how, std::vector<std::string> src)
     fileOpenTable[fileLocation].cursor = 0;
     // 5. 将权限标志（flag）设置为之前计算好的 rwResult
     fileOpenTable[fileLocation].flag = rwResult;
+    // 6. 清空预读状态与索引表定位缓存，从文件开头的读取视为顺序读
+    fileOpenTable[fileLocation].lastReadEnd = 0;
+    fileOpenTable[fileLocation].raWindow = 0;
+    fileOpenTable[fileLocation].raNext = 0;
+    fileOpenTable[fileLocation].indexCursor = FileIndexCursor{};
+    fileOpenTable[fileLocation].delayed.clear();
+    fileOpenTable[fileLocation].delayStart = 0;
+    fileOpenTable[fileLocation].home = homeOf(src);
 }
 
 // 关闭打开的文件
 void UserInterface::close(std::vector<std::string> src)
 {
-    // 在目录中查找给定路径对应的磁盘位置和目录项索引
-    auto findRes = findDisk(src);
-    // 如果未找到文件（返回的磁盘编号为 -1），则提示失败并返回
-    if (findRes.first == -1)
+    // 在目录中查找给定路径对应文件的 i-node 号，作为文件标识
+    inodeno_t fileNumber = findINode(src);
+    // 如果未找到文件（返回的 i-node 号为 0），则提示失败并返回
+    if (fileNumber == 0)
     {
         std::cout << "close: " << RED << "failed" << RESET << ":no such file" << std::endl;
         return;
     }
 
-    // 获取文件所在的磁盘编号
-    uint32_t tmpDirDisk = findRes.first;
-    // 从磁盘中读取该目录的数据结构
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-
-    // 根据目录项索引获取对应的 inode 索引 (i-node 编号)
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    // 将 inode 编号作为文件标识
-    uint32_t fileNumber = inodeDisk;
-
     // 在文件打开表中查找该文件是否已被打开
     int fileLocation = -1;
     for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
@@ -1318,44 +922,32 @@ void UserInterface::close(std::vector<std::string> src)
         return;
     }
 
+    // 延迟分配的数据在关闭时分配物理块并写出
+    flushDelayed(fileOpenTable[fileLocation]);
     // 如果该文件在打开时是以写标志（0x04）打开的，需要将内存中 i-node 的信息写回磁盘
     if ((fileOpenTable[fileLocation].flag & (0x04)) != 0)
     {
-        fileSystem->write(
-            fileOpenTable[fileLocation].fileNumber,                       // 写回的 i-node 对应的文件编号
-            0,                                                            // 偏移量设为 0，写回整个 i-node 结构
-            reinterpret_cast<char *>(&fileOpenTable[fileLocation].iNode), // i-node 数据
-            sizeof(fileOpenTable[fileLocation].iNode)                     // i-node 大小
-        );
+        fileSystem->writeINode(fileOpenTable[fileLocation].fileNumber, fileOpenTable[fileLocation].iNode);
     }
 
     // 清空文件打开表中对应位置的文件编号，表示该文件已被关闭
     fileOpenTable[fileLocation].fileNumber = 0;
+    // ON_CLOSE 持久化模式下，关闭文件时把缓存中的脏块写回磁盘
+    fileSystem->onFileClose();
 }
 
 // 设置文件操作的光标位置
-void UserInterface::setCursor(int code, std::vector<std::string> src, uint32_t offset)
+void UserInterface::setCursor(int code, std::vector<std::string> src, uint64_t offset)
 {
-    // 在目录中查找给定路径对应的磁盘号和目录项索引
-    auto findRes = findDisk(src);
+    // 在目录中查找给定路径对应文件的 i-node 号，作为文件标识
+    inodeno_t fileNumber = findINode(src);
     // 如果未找到该文件，提示失败并返回
-    if (findRes.first == -1)
+    if (fileNumber == 0)
     {
         std::cout << "setCursor: " << RED << "failed" << RESET << ":no such file" << std::endl;
         return;
     }
 
-    // 获取文件所在的磁盘编号
-    uint32_t tmpDirDisk = findRes.first;
-    // 从磁盘中读取该目录的数据结构
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-
-    // 根据目录项索引获取对应的 i-node 编号
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    // 将 i-node 编号作为文件标识
-    uint32_t fileNumber = inodeDisk;
-
     // 在文件打开表中查找该文件对应的打开项
     int fileLocation = -1;
     for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
@@ -1397,7 +989,11 @@ void UserInterface::setCursor(int code, std::vector<std::string> src, uint32_t o
 
 void UserInterface::updateDirNow()
 {
-    fileSystem->read(nowDiretoryDisk, 0, reinterpret_cast<char *>(&directory), sizeof(directory));
+    // 当前目录已被删除（例如从别处 rmdir）时回到根目录
+    if (!DirectoryFile(fileSystem, nowDirectory).isDirectory())
+    {
+        goToRoot();
+    }
 }
 
 // 从已打开的文件中读取数据
@@ -1406,26 +1002,15 @@ void UserInterface::read(uint8_t uid, std::vector<std::string> src, char *buf, u
     // 先将缓冲区首字符设置为终止符，防止之前内容干扰
     buf[0] = '\0';
 
-    // 在目录中查找给定路径 src 对应的磁盘编号和目录项索引
-    auto findRes = findDisk(src);
+    // 在目录中查找给定路径 src 对应文件的 i-node 号，作为文件标识
+    inodeno_t fileNumber = findINode(src);
     // 如果未找到该文件，打印错误信息并返回
-    if (findRes.first == -1)
+    if (fileNumber == 0)
     {
         std::cout << "read: " << RED << "failed" << RESET << ":no such file" << std::endl;
         return;
     }
 
-    // 获取找到的目录所在的磁盘编号
-    uint32_t tmpDirDisk = findRes.first;
-    // 从磁盘中读取该目录的数据结构
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-
-    // 根据目录项索引取得对应的 i-node 编号（inodeIndex）
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    // 将 i-node 编号作为文件唯一标识（fileNumber）
-    uint32_t fileNumber = inodeDisk;
-
     // 在文件打开表中查找该文件是否已经打开，找出它在打开表中的索引 fileLocation
     int fileLocation = -1;
     for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
@@ -1442,6 +1027,8 @@ void UserInterface::read(uint8_t uid, std::vector<std::string> src, char *buf, u
         std::cout << "read: " << RED << "failed" << RESET << ":no such file opened" << std::endl;
         return;
     }
+    // 延迟分配的数据先写出，之后按块映射读取
+    flushDelayed(fileOpenTable[fileLocation]);
 
     // 获取该文件的总容量和当前光标位置的引用
     auto &capacity = fileOpenTable[fileLocation].iNode.capacity;
@@ -1454,120 +1041,125 @@ void UserInterface::read(uint8_t uid, std::vector<std::string> src, char *buf, u
     // 在目标缓冲区中为字符串结尾留出空间
     buf[sz] = '\0';
 
-    // 读取该文件的第一个索引表（FileIndex 结构），它存储了该文件各数据块的块号
-    FileIndex fileIndexTable{};
-    fileSystem->read(
-        fileOpenTable[fileLocation].iNode.bno,     // 索引表所在的块号
-        0,                                         // 从块内偏移 0 开始读取
-        reinterpret_cast<char *>(&fileIndexTable), // 读取到内存中的 fileIndexTable
-        sizeof(fileIndexTable)                     // 读取大小为索引表结构体大小
-    );
-
-    // 当前光标位置
-    uint32_t nowCursor = fileOpenTable[fileLocation].cursor;
-    // 计算光标越过了多少个完整的索引表（每个索引表能存储 FILE_INDEX_SIZE * BLOCK_SIZE_BYTE 字节的信息）
-    int fileIndexTableNums = nowCursor / (FILE_INDEX_SIZE * BLOCK_SIZE_BYTE);
-    // 计算在当前索引表中对应的是第几个数据块（索引表的下标）
-    int fileIndexNums = (nowCursor % (FILE_INDEX_SIZE * BLOCK_SIZE_BYTE)) / BLOCK_SIZE_BYTE;
-
-    // 如果光标不在第一个索引表，则不断跳到下一个索引表中，直到找到光标所在的那个索引表
-    while (fileIndexTableNums > 0)
+    // 内联文件的内容在打开时已随 i-node 读入，不需要再访问磁盘
+    if (fileOpenTable[fileLocation].iNode.layout == FileLayout::INLINE)
     {
-        uint32_t nextFileIndexTableBlock = fileIndexTable.next; // 下一个索引表所在的块号
-        fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-        fileIndexNums--; // 因为已经越过了一个完整的索引表，索引下标要往前递减
-        fileIndexTableNums--;
+        memcpy(buf, fileOpenTable[fileLocation].iNode.data + cursor, sz);
+        cursor += sz;
+        return;
     }
 
-    // 文件当前光标所在的数据块号
-    uint32_t cursorBlock = fileIndexTable.index[fileIndexNums];
-    // 计算光标在当前数据块内的偏移量
-    uint16_t offset = nowCursor % BLOCK_SIZE_BYTE;
-    // 计算当前数据块从光标位置到块末尾还剩余多少字节
-    uint16_t resBlockSz = BLOCK_SIZE_BYTE - offset;
-
-    // 已经读取的字节数
-    uint16_t readByte = 0;
+    // 顺序读时异步预读后续数据块，与下面的同步读取重叠
+    readAhead(fileOpenTable[fileLocation], cursor, sz);
 
-    // 如果请求读取的大小 sz 小于等于当前块的剩余字节数
-    if (sz <= resBlockSz)
+    // 按文件的块映射逐段读取：块内的零碎部分按字节读，对齐的整块按物理连续的段一次读取
+    FileMap fileMap(fileSystem, fileOpenTable[fileLocation].iNode, &fileOpenTable[fileLocation].indexCursor);
+    uint16_t resByte = sz;
+    while (resByte > 0)
     {
-        // 直接从当前块的 offset 位置读取 sz 个字节到 buf
-        fileSystem->read(cursorBlock, offset, buf, sz);
-        readByte = sz;                                  // 本次读取的字节数就是 sz
-        buf += readByte;                                // 更新 buf 指针，后续可在 buf 后继续写入
-        fileOpenTable[fileLocation].cursor += readByte; // 更新文件的光标位置
-        return;                                         // 读取完成后直接返回
+        uint32_t run;
+        blockno_t cursorBlock = fileMap.lookup(cursor / BLOCK_SIZE_BYTE, run);
+        uint16_t offset = cursor % BLOCK_SIZE_BYTE;
+        uint16_t readByte;
+        if (cursorBlock == 0)
+        {
+            // 未映射的块读出为 0
+            readByte = std::min<uint16_t>(resByte, BLOCK_SIZE_BYTE - offset);
+            memset(buf, 0, readByte);
+        }
+        else if (offset == 0 && resByte >= BLOCK_SIZE_BYTE)
+        {
+            uint32_t blocks = std::min<uint32_t>(run, resByte / BLOCK_SIZE_BYTE);
+            fileSystem->readRun(cursorBlock, blocks, buf);
+            readByte = blocks * BLOCK_SIZE_BYTE;
+        }
+        else
+        {
+            readByte = std::min<uint16_t>(resByte, BLOCK_SIZE_BYTE - offset);
+            fileSystem->read(cursorBlock, offset, buf, readByte);
+        }
+        buf += readByte;
+        resByte -= readByte;
+        // 更新光标位置，使下一次读取从这里继续，顺序读才能被识别
+        cursor += readByte;
     }
+}
 
-    // 否则，先把当前块剩余的 resBlockSz 字节读完
-    fileSystem->read(cursorBlock, offset, buf, resBlockSz);
-    readByte = resBlockSz;                          // 已读字节数等于当前块剩余字节数
-    buf += readByte;                                // 更新 buf 指针
-    fileOpenTable[fileLocation].cursor += readByte; // 更新光标位置
-
-    // 计算剩余还需要读取的字节数 ResByte（超过当前块的部分）
-    uint16_t ResByte = sz - resBlockSz;
-
-    // 计算剩余字节数需要多少个完整的数据块
-    int blocksToRead = ResByte / BLOCK_SIZE_BYTE;
-    // 计算最后一个不完整块需要读取的字节偏移量
-    int lastBlockToReadOffset = ResByte % BLOCK_SIZE_BYTE;
-
-    // 然后逐块读取所有完整的数据块
-    while (blocksToRead--)
+void UserInterface::readAhead(FileOpenItem &item, uint64_t start, uint16_t sz)
+{
+    if (sz == 0)
     {
-        fileIndexNums++; // 在当前索引表中下一个数据块的下标
-        // 如果索引下标已经超出当前索引表的范围，需要加载下一个索引表
-        if (fileIndexNums == FILE_INDEX_SIZE)
-        {
-            uint32_t nextFileIndexTableBlock = fileIndexTable.next;
-            fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-            fileIndexNums = 0; // 新索引表要从 0 开始
-        }
-        // 从 fileIndexTable.index[fileIndexNums] 块开始读取整整一个块的数据到 buf
-        fileSystem->read(fileIndexTable.index[fileIndexNums], 0, buf, BLOCK_SIZE_BYTE);
-        buf += BLOCK_SIZE_BYTE;                                // 更新 buf 指针
-        fileOpenTable[fileLocation].cursor += BLOCK_SIZE_BYTE; // 更新光标位置
+        return;
+    }
+    uint64_t lastBlock = (start + sz - 1) / BLOCK_SIZE_BYTE; // 本次读取涉及的最后一个逻辑块
+    bool sequential = start == item.lastReadEnd;
+    item.lastReadEnd = start + sz;
+    // 随机访问：预读窗口收缩为0
+    if (!sequential)
+    {
+        item.raWindow = 0;
+        item.raNext = 0;
+        return;
+    }
+    // 预读窗口不超过缓存的四分之一，否则预读的块会在被读取前互相换出；未启用缓存时不预读
+    uint32_t maxWindow = std::min<uint32_t>(READAHEAD_MAX_BLOCKS, fileSystem->getCacheCapacity() / 4);
+    if (maxWindow == 0)
+    {
+        return;
+    }
+    // 顺序访问：首次建立初始窗口；已预读的块被读掉一半后窗口翻倍并继续预读，否则本次不需要预读
+    if (item.raWindow == 0)
+    {
+        item.raWindow = std::min<uint32_t>(READAHEAD_MIN_BLOCKS, maxWindow);
+    }
+    else if (lastBlock + item.raWindow / 2 >= item.raNext)
+    {
+        item.raWindow = std::min<uint32_t>(item.raWindow * 2, maxWindow);
+    }
+    else
+    {
+        return;
     }
 
-    // 最后，将最后一个不完整块的剩余字节也读取到 buf
-    fileIndexNums++;
-    if (fileIndexNums == FILE_INDEX_SIZE)
+    uint64_t fileBlocks = (item.iNode.capacity + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE;
+    uint64_t from = std::max(item.raNext, lastBlock + 1);
+    uint64_t to = std::min(lastBlock + 1 + item.raWindow, fileBlocks);
+    if (from >= to)
     {
-        // 如果已经读完当前索引表，则先读取下一个索引表
-        uint32_t nextFileIndexTableBlock = fileIndexTable.next;
-        fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-        fileIndexNums = 0;
+        return;
+    }
+    // 窗口内的块按映射逐段取出，物理连续的段一次取完
+    FileMap fileMap(fileSystem, item.iNode, &item.indexCursor);
+    std::vector<blockno_t> blocks;
+    for (uint64_t blk = from; blk < to;)
+    {
+        uint32_t run;
+        blockno_t pblk = fileMap.lookup(blk, run);
+        if (pblk == 0)
+        {
+            break;
+        }
+        for (uint32_t k = 0; k < run && blk < to; ++k, ++blk)
+        {
+            blocks.push_back(pblk + k);
+        }
     }
-    // 从当前数据块读取最后 lastBlockToReadOffset 个字节到 buf
-    fileSystem->read(fileIndexTable.index[fileIndexNums], 0, buf, lastBlockToReadOffset);
-    // 最后无需手动更新 cursor，因为读取操作结束后不会再次使用光标
+    item.raNext = to;
+    fileSystem->prefetch(blocks);
 }
 
 // 向已打开的文件中写入数据
 void UserInterface::write(uint8_t uid, std::vector<std::string> src, const char *buf, uint16_t sz)
 {
-    // 在目录中查找给定路径 src 对应的磁盘号和目录项索引
-    auto findRes = findDisk(std::move(src));
+    // 在目录中查找给定路径 src 对应文件的 i-node 号，作为文件标识
+    inodeno_t fileNumber = findINode(src);
     // 如果未找到该文件，打印错误信息并返回
-    if (findRes.first == -1)
+    if (fileNumber == 0)
     {
         std::cout << "write: " << RED << "failed" << RESET << ":no such file" << std::endl;
         return;
     }
 
-    // 获取文件所在目录的磁盘编号
-    uint32_t tmpDirDisk = findRes.first;
-    // 从磁盘中读取该目录的数据结构
-    Directory tmpDir{};
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-
-    // 根据目录项索引获取对应的 i-node 编号（inodeIndex）
-    uint32_t inodeDisk = tmpDir.item[findRes.second].inodeIndex;
-    // 将 i-node 编号作为文件唯一标识（fileNumber）
-    uint32_t fileNumber = inodeDisk;
-
     // 在文件打开表中查找该文件是否已打开，记录其在表中的位置 fileLocation
     int fileLocation = -1;
     for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
@@ -1588,245 +1180,1312 @@ void UserInterface::write(uint8_t uid, std::vector<std::string> src, const char
     // 引用文件的当前容量和光标位置
     auto &capacity = fileOpenTable[fileLocation].iNode.capacity;
     auto &cursor = fileOpenTable[fileLocation].cursor;
-    // 如果写入的新数据会超过当前容量，则扩展容量并标记该文件已被修改
-    if (cursor + sz > capacity)
+    if (sz == 0)
+    {
+        return;
+    }
+    FileOpenItem &item = fileOpenTable[fileLocation];
+    // 切换为立即分配后，先写出之前延迟分配的数据
+    if (!delayedAllocation)
     {
-        capacity = cursor + sz;
-        fileOpenTable[fileLocation].flag |= (0x04); // 设置写回标志
+        flushDelayed(item);
+    }
+    FileMap fileMap(fileSystem, fileOpenTable[fileLocation].iNode, &fileOpenTable[fileLocation].indexCursor);
+    bool remapped = false;
+    if (fileOpenTable[fileLocation].iNode.layout == FileLayout::INLINE)
+    {
+        // 写入后仍放得下时直接改写 i-node 中的内联内容，只写一次 i-node
+        if (cursor + sz <= INLINE_DATA_SIZE)
+        {
+            memcpy(fileOpenTable[fileLocation].iNode.data + cursor, buf, sz);
+            cursor += sz;
+            if (cursor > capacity)
+            {
+                capacity = cursor;
+            }
+            fileSystem->writeINode(fileNumber, fileOpenTable[fileLocation].iNode);
+            return;
+        }
+        if (delayedAllocation)
+        {
+            // 延迟分配时原有内容转入延迟写缓冲，映射保持为空，磁盘上的 i-node 在写出前仍是内联的
+            if (!fileSystem->reserveBlocks((capacity + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE))
+            {
+                std::cout << "write: no space left on disk" << std::endl;
+                return;
+            }
+            item.delayed.assign(item.iNode.data, item.iNode.data + capacity);
+            item.delayStart = 0;
+            FileMap::init(item.iNode, fileSystem->getFileLayout());
+        }
+        // 超出内联上限，原有内容搬到数据块后按挂载选项指定的布局继续写入
+        else if (!fileMap.expandInline(fileSystem->getFileLayout(), item.home))
+        {
+            std::cout << "write: no space left on disk" << std::endl;
+            return;
+        }
+        else
+        {
+            remapped = true;
+        }
+    }
+    // 光标不会越过文件末尾，需要新分配的恰好是已映射部分之后、本次写入涉及的块，写入前一次批量分配；
+    // 有延迟分配的数据时，已映射部分在其之前结束
+    uint64_t mapped = item.delayed.empty() ? fileMap.mappedBlocks() : item.delayStart / BLOCK_SIZE_BYTE;
+    uint64_t last = (cursor + sz - 1) / BLOCK_SIZE_BYTE;
+    uint16_t delayedByte = 0;
+    if (delayedAllocation && last >= mapped)
+    {
+        // 已映射部分之后的数据只放入延迟写缓冲，按块预留空间，物理块在写出时为整段一次选定
+        uint64_t boundary = mapped * BLOCK_SIZE_BYTE;
+        item.delayStart = boundary;
+        uint64_t start = std::max(cursor, boundary);
+        uint64_t end = cursor + sz - boundary;
+        if (end > item.delayed.size())
+        {
+            uint64_t more = (end + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE -
+                            (item.delayed.size() + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE;
+            if (!fileSystem->reserveBlocks(more))
+            {
+                std::cout << "write: no space left on disk" << std::endl;
+                return;
+            }
+            item.delayed.resize(end);
+        }
+        delayedByte = cursor + sz - start;
+        memcpy(item.delayed.data() + (start - boundary), buf + (start - cursor), delayedByte);
+        sz -= delayedByte;
+    }
+    else if (last >= mapped)
+    {
+        uint32_t need = last + 1 - mapped;
+        std::vector<blockno_t> fresh(need);
+        // 接在文件最后一块之后分配，还没有数据块时在所在目录附近分配
+        uint32_t got = fileSystem->blockAllocateN(need, fresh.data(), mapped > 0 ? fileMap.goal() : item.home);
+        if (got != need)
+        {
+            // 空闲块不足，归还已分配的部分，文件内容保持不变
+            fileSystem->blockFreeN(fresh.data(), got);
+            if (remapped)
+            {
+                fileSystem->writeINode(fileNumber, fileOpenTable[fileLocation].iNode);
+                fileSystem->update();
+            }
+            std::cout << "write: no space left on disk" << std::endl;
+            return;
+        }
+        // 新块按物理连续的段追加到映射末尾
+        uint32_t done = fileMap.appendBlocks(mapped, fresh.data(), need);
+        if (done != need)
+        {
+            // 映射元数据分配失败，归还尚未映射的块
+            fileSystem->blockFreeN(fresh.data() + done, need - done);
+            fileSystem->writeINode(fileNumber, fileOpenTable[fileLocation].iNode);
+            fileSystem->update();
+            std::cout << "write: no space left on disk" << std::endl;
+            return;
+        }
+        remapped = true;
     }
 
-    // 读取当前文件的第一个索引表（FileIndex 结构），用于定位数据块
-    FileIndex fileIndexTable{};
-    uint32_t fileIndexTableBlock = fileOpenTable[fileLocation].iNode.bno;
-    fileSystem->read(fileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
+    // 按映射逐段写入：块内的零碎部分按字节写，对齐的整块按物理连续的段一次写入
+    uint16_t resByte = sz;
+    while (resByte > 0)
+    {
+        uint32_t run;
+        blockno_t cursorBlock = fileMap.lookup(cursor / BLOCK_SIZE_BYTE, run);
+        uint16_t offset = cursor % BLOCK_SIZE_BYTE;
+        uint16_t writeByte;
+        if (offset == 0 && resByte >= BLOCK_SIZE_BYTE)
+        {
+            uint32_t blocks = std::min<uint32_t>(run, resByte / BLOCK_SIZE_BYTE);
+            fileSystem->writeRun(cursorBlock, blocks, buf);
+            writeByte = blocks * BLOCK_SIZE_BYTE;
+        }
+        else
+        {
+            writeByte = std::min<uint16_t>(resByte, BLOCK_SIZE_BYTE - offset);
+            fileSystem->write(cursorBlock, offset, buf, writeByte);
+        }
+        buf += writeByte;
+        resByte -= writeByte;
+        cursor += writeByte;
+    }
+    cursor += delayedByte;
+    // 如果写入的新数据超过了当前容量，则扩展容量
+    if (cursor > capacity)
+    {
+        capacity = cursor;
+    }
 
-    // 获取当前光标位置
-    uint32_t nowCursor = fileOpenTable[fileLocation].cursor;
-    // 计算光标跨越了多少个完整的索引表
-    int fileIndexTableNums = nowCursor / (FILE_INDEX_SIZE * BLOCK_SIZE_BYTE);
-    // 计算光标在当前索引表中的下标（代表第几个数据块）
-    int fileIndexNums = (nowCursor % (FILE_INDEX_SIZE * BLOCK_SIZE_BYTE)) / BLOCK_SIZE_BYTE;
+    // 标记该文件已被修改，需要在关闭时将 i-node 写回磁盘
+    fileOpenTable[fileLocation].flag |= (0x04);
+    // 积攒的数据过多时立即写出，限制占用的内存
+    if (item.delayed.size() >= static_cast<uint64_t>(DELAYED_ALLOC_MAX_BLOCKS) * BLOCK_SIZE_BYTE)
+    {
+        flushDelayed(item);
+    }
+    // 映射根在 i-node 中，映射有变化时立即写回 i-node，整个写入只提交一次元数据
+    if (remapped)
+    {
+        fileSystem->writeINode(fileNumber, fileOpenTable[fileLocation].iNode);
+        fileSystem->update();
+    }
+}
 
-    // 如果光标不在第一个索引表，则循环读取下一个索引表，直到定位到光标所在的索引表
-    while (fileIndexTableNums > 0)
+bool UserInterface::flushDelayed(FileOpenItem &item)
+{
+    if (item.delayed.empty())
     {
-        uint32_t nextFileIndexTableBlock = fileIndexTable.next;
-        fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-        fileIndexNums--;      // 调整在新索引表中的块下标
-        fileIndexTableNums--; // 已跳过一个索引表
+        return true;
     }
+    // 先取消预留再一次批量分配，位图分配器能找到足够长的空闲段时整段物理连续
+    uint32_t need = (item.delayed.size() + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE;
+    item.delayed.resize(static_cast<uint64_t>(need) * BLOCK_SIZE_BYTE, 0);
+    fileSystem->unreserveBlocks(need);
+    uint64_t first = item.delayStart / BLOCK_SIZE_BYTE;
+    FileMap fileMap(fileSystem, item.iNode, &item.indexCursor);
+    std::vector<blockno_t> fresh(need);
+    uint32_t got = fileSystem->blockAllocateN(need, fresh.data(), first > 0 ? fileMap.goal() : item.home);
+    uint32_t done = fileMap.appendBlocks(first, fresh.data(), got);
+    fileSystem->blockFreeN(fresh.data() + done, got - done);
+
+    // 按映射逐段写出，每段物理连续的块一次写入
+    for (uint32_t i = 0; i < done;)
+    {
+        uint32_t run;
+        blockno_t bno = fileMap.lookup(first + i, run);
+        run = std::min(run, done - i);
+        fileSystem->writeRun(bno, run, item.delayed.data() + static_cast<uint64_t>(i) * BLOCK_SIZE_BYTE);
+        i += run;
+    }
+    if (done != need)
+    {
+        // 映射元数据占用了预留之外的块导致空间不足，文件截止到已写出的数据
+        item.iNode.capacity = std::min<uint64_t>(item.iNode.capacity, (first + done) * BLOCK_SIZE_BYTE);
+        item.cursor = std::min(item.cursor, item.iNode.capacity);
+        std::cout << "write: no space left on disk" << std::endl;
+    }
+    item.delayed.clear();
+    item.delayed.shrink_to_fit();
+    fileSystem->writeINode(item.fileNumber, item.iNode);
+    fileSystem->update();
+    return done == need;
+}
 
-    // 定位到当前光标所在的数据块号
-    uint32_t cursorBlock = fileIndexTable.index[fileIndexNums];
-    // 计算光标在该数据块内的偏移量
-    uint16_t offset = nowCursor % BLOCK_SIZE_BYTE;
-    // 计算当前块从光标位置到块末尾剩余的可写字节数
-    uint16_t resBlockSz = BLOCK_SIZE_BYTE - offset;
+// 为文件预分配数据块：覆盖前 length 字节的块一次批量分配，预留在文件末尾之后，之后的写入直接使用
+void UserInterface::fallocate(std::vector<std::string> src, uint64_t length)
+{
+    Dirent item{};
+    if (!findItem(src, item) || item.fileType != FileType::REGULAR)
+    {
+        std::cout << "fallocate: " << RED << "failed" << RESET << ":no such file" << std::endl;
+        return;
+    }
 
-    // 记录已经写入的字节数
-    uint16_t writeByte = 0;
+    // 已打开的文件直接修改打开表中的 i-node，并先写出延迟分配的数据；否则读入 i-node 修改后写回
+    FileOpenItem *opened = nullptr;
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
+    {
+        if (fileOpenTable[i].fileNumber == item.inodeIndex)
+        {
+            opened = &fileOpenTable[i];
+            flushDelayed(*opened);
+            break;
+        }
+    }
+    INode local{};
+    if (opened == nullptr && !fileSystem->readINode(item.inodeIndex, local))
+    {
+        std::cout << "fallocate: " << RED << "failed" << RESET << ":no such file" << std::endl;
+        return;
+    }
+    INode &iNode = opened != nullptr ? opened->iNode : local;
+    blockno_t home = opened != nullptr ? opened->home : homeOf(src);
 
-    // 如果待写入数据 sz 小于等于当前块剩余空间，则直接写入并更新光标，返回
-    if (sz <= resBlockSz)
+    // 内联文件放得下时不需要数据块
+    if (iNode.layout == FileLayout::INLINE && length <= INLINE_DATA_SIZE)
+    {
+        return;
+    }
+    FileMap fileMap(fileSystem, iNode, opened != nullptr ? &opened->indexCursor : nullptr);
+    if (!fileMap.expandInline(fileSystem->getFileLayout(), home))
     {
-        fileSystem->write(cursorBlock, offset, buf, sz);
-        writeByte = sz;
-        buf += writeByte;                                // 更新 buf 指针到下一个待写位置
-        fileOpenTable[fileLocation].cursor += writeByte; // 更新光标位置
+        std::cout << "fallocate: no space left on disk" << std::endl;
         return;
     }
+    uint64_t mapped = fileMap.mappedBlocks();
+    uint64_t want = (length + BLOCK_SIZE_BYTE - 1) / BLOCK_SIZE_BYTE;
+    if (want > mapped)
+    {
+        if (want - mapped > fileSystem->getFreeBlockNumber())
+        {
+            fileSystem->writeINode(item.inodeIndex, iNode);
+            fileSystem->update();
+            std::cout << "fallocate: no space left on disk" << std::endl;
+            return;
+        }
+        uint32_t need = want - mapped;
+        std::vector<blockno_t> fresh(need);
+        uint32_t got = fileSystem->blockAllocateN(need, fresh.data(), mapped > 0 ? fileMap.goal() : home);
+        uint32_t done = got == need ? fileMap.appendBlocks(mapped, fresh.data(), need) : 0;
+        fileSystem->blockFreeN(fresh.data() + done, got - done);
+        if (done != need)
+        {
+            std::cout << "fallocate: no space left on disk" << std::endl;
+        }
+    }
+    fileSystem->writeINode(item.inodeIndex, iNode);
+    fileSystem->update();
+}
 
-    // 否则，先将当前块剩余空间写满
-    fileSystem->write(cursorBlock, offset, buf, resBlockSz);
-    writeByte = resBlockSz;
-    buf += writeByte;                                // 更新 buf 指针
-    fileOpenTable[fileLocation].cursor += writeByte; // 更新光标位置
+// 复制文件或目录：在目标目录下创建源文件/目录的硬链接（仅复制目录项及分配新的 i-node，未复制实际数据）
+void UserInterface::cp(std::vector<std::string> src, std::vector<std::string> des)
+{
+    /*==================== 查找源文件或目录的 i-node ====================*/
 
-    // 计算剩余还需写入的字节数（超出当前块部分）
-    uint16_t ResByte = sz - resBlockSz;
-    // 计算剩余字节数可以完整填满多少个数据块
-    int blocksToWrite = ResByte / BLOCK_SIZE_BYTE;
-    // 计算最后一个不完整块需要写入的字节数
-    int lastBlockToWriteOffset = ResByte % BLOCK_SIZE_BYTE;
+    // 名字过长的文件不可能存在
+    if (!DirectoryFile::validName(src.back()))
+    {
+        std::cout << "cp: " << RED << "failed" << RESET << ":File name too long" << std::endl;
+        return;
+    }
+    // 在文件系统中查找 src 路径，对应的目录 i-node 号和目录项索引
+    auto findRes = findDisk(src);
+    Dirent srcItem{};
+    // 如果未找到源文件或目录，打印错误并返回
+    if (findRes.first == 0 || !DirectoryFile(fileSystem, findRes.first).get(findRes.second, srcItem))
+    {
+        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
+        return;
+    }
+
+    /*==================== 查找目标目录 ====================*/
+
+    // 在文件系统中查找 des 路径对应目录的 i-node 号
+    inodeno_t desInodeIndex = findDirectory(des);
+    // 如果目标不存在或不是目录，打印错误并返回
+    if (desInodeIndex == 0)
+    {
+        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find des" << std::endl;
+        return;
+    }
+    DirectoryFile desDir(fileSystem, desInodeIndex);
+    if (desDir.find(srcItem.name) != -1)
+    {
+        std::cout << "cp: " << RED << "failed" << RESET << ":des file exists" << std::endl;
+        return;
+    }
+
+    /*==================== 在目标目录中创建新目录项 ====================*/
+
+    // 目录的复制需要递归建立整棵子树，暂不支持
+    INode srcInode{};
+    fileSystem->readINode(srcItem.inodeIndex, srcInode);
+    if ((srcInode.flag & 0xC0) == 0x40)
+    {
+        std::cout << "cp: " << RED << "failed" << RESET << ":omitting directory" << std::endl;
+        return;
+    }
+    // 从 i 节点表分配新的 i-node，复制源文件的属主与权限，内容为空的内联文件
+    inodeno_t newInodeIndex = fileSystem->allocINode();
+    if (newInodeIndex == 0)
+    {
+        std::cout << "cp: no space left on disk" << std::endl;
+        return;
+    }
+    INode newInode{};
+    newInode.uid = srcInode.uid;
+    newInode.flag = srcInode.flag;
+    newInode.links = 1;
+    FileMap::init(newInode, FileLayout::INLINE);
+    fileSystem->writeINode(newInodeIndex, newInode);
+
+    // 在目标目录中加入与源文件同名的目录项，全部写满时目录自动扩展一块
+    if (!desDir.add(srcItem.name, newInodeIndex, srcItem.fileType, srcItem.mode))
+    {
+        fileSystem->freeINode(newInodeIndex);
+        std::cout << "cp: no space left on disk" << std::endl;
+    }
+    // 更新文件系统元数据（如位图、空闲块信息等）
+    fileSystem->update();
+
+    // 注意：此处仅完成了目录项的创建和新的 i-node 分配，真正的文件内容未被复制。
+    // 若需实现深度复制，还需递归地复制源文件/目录的所有数据块与子目录项，并写入到新的 i-node 和数据块中。
+}
 
-    // 写入所有能够完整填充的块
-    while (blocksToWrite--)
+void UserInterface::logOut()
+{
+    // 关闭所有未关闭的文件
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; ++i)
     {
-        fileIndexNums++; // 进入下一个块下标
-        // 如果当前索引表已满，则需要新建下一个索引表
-        if (fileIndexNums == FILE_INDEX_SIZE)
+        if (fileOpenTable[i].fileNumber != 0)
         {
-            // 为新的索引表分配一个磁盘块
-            uint32_t nextFileIndexTableBlock = fileSystem->blockAllocate();
-            // 更新旧索引表的 next 指针指向新块
-            fileIndexTable.next = nextFileIndexTableBlock;
-            // 将更新后的索引表写回磁盘
-            fileSystem->write(fileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-            fileSystem->update(); // 提交元数据更改
+            flushDelayed(fileOpenTable[i]);
+        }
+        if (fileOpenTable[i].fileNumber != 0 && 0 != (fileOpenTable[i].flag & 0x04))
+        {
+            fileSystem->writeINode(fileOpenTable[i].fileNumber, fileOpenTable[i].iNode);
+        }
+    }
+    // 更新信息，并把缓存中的脏块写回磁盘
+    fileSystem->sync();
+}
 
-            // 读取新索引表，开始操作
-            fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-            fileIndexNums = 0; // 在新索引表中从第 0 个下标开始
+void UserInterface::bench(std::vector<FileLayout> layouts, uint32_t ops)
+{
+    static const uint64_t sizes[] = {1, 16, 256, 1024, 4096}; // 测试文件大小（MB）
+    static const char *names[] = {"index", "extent", "blockmap"};
+    std::mt19937_64 rng(ops);
+    std::vector<char> buf(BLOCK_SIZE_BYTE);
+    std::cout << "layout\tsize(MB)\tus/op\tmap reads/op" << std::endl;
+    for (FileLayout layout : layouts)
+    {
+        for (uint64_t size : sizes)
+        {
+            uint64_t blocks = size * 1024 * 1024 / BLOCK_SIZE_BYTE;
+            std::cout << names[static_cast<int>(layout)] << "\t" << size << "\t";
+            if (blocks + FileMap::metadataBound(blocks) > fileSystem->getFreeBlockNumber())
+            {
+                std::cout << "skipped: not enough free blocks" << std::endl;
+                continue;
+            }
+            // 测试文件的 i 结点只在内存中，不加入目录；只分配并映射数据块，不写入数据
+            INode iNode{};
+            FileMap::init(iNode, layout);
+            FileIndexCursor cursor{};
+            FileMap fileMap(fileSystem, iNode, &cursor);
+            std::vector<blockno_t> batch(BLOCKMAP_PER_BLOCK);
+            uint64_t mapped = 0;
+            while (mapped < blocks)
+            {
+                uint32_t want = std::min<uint64_t>(batch.size(), blocks - mapped);
+                uint32_t got = fileSystem->blockAllocateN(want, batch.data());
+                uint32_t done = fileMap.appendBlocks(mapped, batch.data(), got);
+                fileSystem->blockFreeN(batch.data() + done, got - done);
+                mapped += done;
+                if (done != want)
+                {
+                    break;
+                }
+            }
+            iNode.capacity = mapped * BLOCK_SIZE_BYTE;
+
+            if (mapped == blocks)
+            {
+                // 随机定位并读取一个块，统计每次定位额外读取的映射元数据块数
+                DiskStat disk = fileSystem->getDiskStat();
+                CacheStat cache = fileSystem->getCacheStat();
+                auto start = std::chrono::steady_clock::now();
+                for (uint32_t i = 0; i < ops; i++)
+                {
+                    uint32_t run;
+                    blockno_t pblk = fileMap.lookup(rng() % blocks, run);
+                    fileSystem->read(pblk, 0, buf.data(), BLOCK_SIZE_BYTE);
+                }
+                auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                CacheStat cacheNow = fileSystem->getCacheStat();
+                uint64_t accesses = fileSystem->getCacheCapacity() > 0
+                                        ? cacheNow.hits + cacheNow.misses - cache.hits - cache.misses
+                                        : fileSystem->getDiskStat().readCalls - disk.readCalls;
+                std::cout << static_cast<double>(cost.count()) / ops << "\t"
+                          << static_cast<double>(accesses - ops) / ops << std::endl;
+            }
+            else
+            {
+                std::cout << "skipped: no space left on disk" << std::endl;
+            }
+
+            // 回收测试文件占用的所有块
+            std::vector<blockno_t> used;
+            fileMap.collect(used);
+            fileSystem->blockFreeN(used.data(), used.size());
+            fileSystem->update();
         }
+    }
+}
 
-        // 如果当前索引项尚未分配数据块，则为其分配一个新块
-        if (fileIndexTable.index[fileIndexNums] == 0)
+void UserInterface::dirbench(uint32_t entries, uint32_t ops, uint32_t dirs)
+{
+    // 在当前目录下建立测试目录，其中再建立dirs个子目录，测试结束后整个删除
+    const std::string benchName = "dirbench";
+    if (duplicateDetection(benchName))
+    {
+        std::cout << "dirbench: " << RED << "failed" << RESET << ": '" << benchName << "' exists" << std::endl;
+        return;
+    }
+    mkdir(0, benchName);
+    Dirent item{};
+    if (DirectoryFile(fileSystem, nowDirectory).find(benchName, &item) == -1)
+    {
+        return;
+    }
+    inodeno_t benchDirectory = item.inodeIndex;
+    std::swap(nowDirectory, benchDirectory);
+    std::vector<inodeno_t> directories;
+    for (uint32_t d = 0; d < dirs; d++)
+    {
+        mkdir(0, "d" + std::to_string(d));
+        if (DirectoryFile(fileSystem, nowDirectory).find("d" + std::to_string(d), &item) == -1)
         {
-            uint32_t newBlock = fileSystem->blockAllocate();
-            fileIndexTable.index[fileIndexNums] = newBlock;
-            fileSystem->update(); // 提交元数据更改
+            break;
         }
+        directories.push_back(item.inodeIndex);
+    }
+    std::swap(nowDirectory, benchDirectory);
+    if (directories.size() != dirs)
+    {
+        rmdir(0, benchName);
+        return;
+    }
+
+    // 统计一段操作访问的块数：启用缓存时为缓存的访问次数，否则为磁盘读次数
+    auto blockAccesses = [this]()
+    {
+        CacheStat cache = fileSystem->getCacheStat();
+        return fileSystem->getCacheCapacity() > 0 ? cache.hits + cache.misses : fileSystem->getDiskStat().readCalls;
+    };
+    auto report = [](const char *op, uint64_t count, std::chrono::steady_clock::time_point start, uint64_t accesses)
+    {
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << op << "\t" << count << "\t" << static_cast<double>(cost.count()) / count << "\t"
+                  << static_cast<double>(accesses) / count << std::endl;
+    };
+    std::cout << "op\tcount\tus/op\tblock reads/op" << std::endl;
 
-        // 将一个整块数据写入到分配好的块
-        fileSystem->write(fileIndexTable.index[fileIndexNums], 0, buf, BLOCK_SIZE_BYTE);
-        buf += BLOCK_SIZE_BYTE;                                // 更新 buf 指针
-        fileOpenTable[fileLocation].cursor += BLOCK_SIZE_BYTE; // 更新光标位置
+    // 创建：与 touch 相同的路径，包括重名检测和目录扩展；第i个文件放在第i%dirs个目录中
+    inodeno_t saved = nowDirectory;
+    uint64_t before = blockAccesses();
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < entries; i++)
+    {
+        nowDirectory = directories[i % dirs];
+        touch(0, "f" + std::to_string(i));
     }
+    report("create", entries, start, blockAccesses() - before);
 
-    // 写入最后一个不足一整块的数据
-    fileIndexNums++;
-    // 如果当前索引表已满，需要新建并跳转到下一个索引表
-    if (fileIndexNums == FILE_INDEX_SIZE)
+    // 随机按名字查找
+    std::mt19937 rng(entries);
+    uint32_t missed = 0;
+    before = blockAccesses();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < ops; i++)
     {
-        // 分配新索引表块
-        uint32_t nextFileIndexTableBlock = fileSystem->blockAllocate();
-        // 更新并写回当前索引表
-        fileIndexTable.next = nextFileIndexTableBlock;
-        fileSystem->write(fileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-        fileSystem->update();
+        uint32_t n = rng() % entries;
+        if (DirectoryFile(fileSystem, directories[n % dirs]).find("f" + std::to_string(n)) == -1)
+        {
+            missed++;
+        }
+    }
+    report("lookup", ops, start, blockAccesses() - before);
 
-        // 读取新索引表并重置索引下标
-        fileSystem->read(nextFileIndexTableBlock, 0, reinterpret_cast<char *>(&fileIndexTable), sizeof(fileIndexTable));
-        fileIndexNums = 0;
+    // 删除：与 rm 相同的路径，删除前ops个文件
+    uint32_t removed = std::min(ops, entries);
+    before = blockAccesses();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < removed; i++)
+    {
+        nowDirectory = directories[i % dirs];
+        rm(0, "f" + std::to_string(i));
     }
+    report("remove", removed, start, blockAccesses() - before);
+    nowDirectory = saved;
 
-    // 如果分配给最后一段写入的块尚未分配，则先分配一个块
-    if (fileIndexTable.index[fileIndexNums] == 0)
+    // 列出：按顺序遍历全部目录项
+    uint64_t listed = 0;
+    before = blockAccesses();
+    start = std::chrono::steady_clock::now();
+    for (inodeno_t dir : directories)
     {
-        uint32_t newBlock = fileSystem->blockAllocate();
-        fileIndexTable.index[fileIndexNums] = newBlock;
-        fileSystem->update();
+        DirectoryFile(fileSystem, dir).forEach([&listed](uint32_t, const Dirent &)
+        {
+            listed++;
+            return true;
+        });
+    }
+    report("list", listed, start, blockAccesses() - before);
+    if (missed != 0 || listed != entries - removed + 2 * static_cast<uint64_t>(dirs))
+    {
+        std::cout << "dirbench: " << RED << "failed" << RESET << ": " << missed << " lookups missed, "
+                  << listed << " entries listed" << std::endl;
     }
 
-    // 将最后一个零碎部分写入到对应块
-    fileSystem->write(fileIndexTable.index[fileIndexNums], 0, buf, lastBlockToWriteOffset);
+    // 删除测试目录及其中的所有文件
+    rmdir(0, benchName);
+}
 
-    // 标记该文件已被修改，需要在关闭时将 i-node 写回磁盘
-    fileOpenTable[fileLocation].flag |= (0x04);
+uint64_t UserInterface::countExtents(INode &iNode, uint64_t &blocks)
+{
+    FileMap fileMap(fileSystem, iNode);
+    blocks = fileMap.mappedBlocks();
+    uint64_t extents = 0;
+    blockno_t next = 0;
+    for (uint64_t lblk = 0; lblk < blocks;)
+    {
+        uint32_t run;
+        blockno_t pblk = fileMap.lookup(lblk, run);
+        if (pblk == 0)
+        {
+            break;
+        }
+        // 映射返回的段可能在映射元数据的边界处断开，与上一段物理相接时仍算同一段
+        if (pblk != next)
+        {
+            extents++;
+        }
+        next = pblk + run;
+        lblk += run;
+    }
+    return extents;
 }
 
-// 复制文件或目录：在目标目录下创建源文件/目录的硬链接（仅复制目录项及分配新的 i-node，未复制实际数据）
-void UserInterface::cp(std::vector<std::string> src, std::vector<std::string> des)
+void UserInterface::allocbench(uint32_t files, uint32_t size)
 {
-    /*==================== 查找源文件或目录的 i-node ====================*/
+    static const char *names[] = {"immediate", "fallocate", "delayed"};
+    static const uint16_t chunk = 16 * 1024; // 每个文件每轮写入的字节数
+    const std::string benchName = "allocbench";
+    if (duplicateDetection(benchName))
+    {
+        std::cout << "allocbench: " << RED << "failed" << RESET << ": '" << benchName << "' exists" << std::endl;
+        return;
+    }
+    uint64_t bytes = static_cast<uint64_t>(size) * 1024 * 1024;
+    std::vector<char> buf(chunk);
+    for (uint16_t i = 0; i < chunk; i++)
+    {
+        buf[i] = static_cast<char>('a' + i % 26);
+    }
+    mkdir(0, benchName);
+    Dirent item{};
+    if (DirectoryFile(fileSystem, nowDirectory).find(benchName, &item) == -1)
+    {
+        return;
+    }
+    inodeno_t saved = nowDirectory;
+    bool savedMode = delayedAllocation;
+    std::cout << "mode	extents/file	read MB/s	disk reads/MB" << std::endl;
+    for (int mode = 0; mode < 3; mode++)
+    {
+        std::cout << names[mode] << "\t";
+        uint64_t blocks = bytes / BLOCK_SIZE_BYTE;
+        if ((blocks + FileMap::metadataBound(blocks)) * files > fileSystem->getFreeBlockNumber())
+        {
+            std::cout << "skipped: not enough free blocks" << std::endl;
+            continue;
+        }
+        // 每种方式在各自的子目录中建立并打开全部测试文件
+        nowDirectory = item.inodeIndex;
+        mkdir(0, names[mode]);
+        cd(names[mode]);
+        std::vector<std::vector<std::string>> srcs;
+        for (uint32_t f = 0; f < files; f++)
+        {
+            touch(0, "f" + std::to_string(f));
+            srcs.push_back({"f" + std::to_string(f)});
+            if (mode == 1)
+            {
+                fallocate(srcs.back(), bytes);
+            }
+            open("rw", srcs.back());
+        }
+        delayedAllocation = mode == 2;
 
-    // 存储被复制的文件或目录的 i-node 块号
-    uint32_t srcInodeIndex = 0;
-    // 临时目录结构，用于读取源文件所在目录的信息
-    Directory tmpDirSrc{};
-    // 存储源文件所在目录所在的磁盘块号
-    uint32_t tmpDirDiskSrc;
-    // 存储源文件在目录中的项索引
-    int srcIndex;
+        // 各文件轮流写入一段，模拟同时写入的多个文件
+        for (uint64_t written = 0; written < bytes; written += chunk)
+        {
+            uint16_t sz = std::min<uint64_t>(chunk, bytes - written);
+            for (auto &src : srcs)
+            {
+                write(0, src, buf.data(), sz);
+            }
+        }
+        for (auto &src : srcs)
+        {
+            close(src);
+        }
+        delayedAllocation = savedMode;
 
-    // 在文件系统中查找 src 路径，对应的目录块号和目录项索引
-    auto findRes = findDisk(src);
-    // 如果未找到源文件或目录，打印错误并返回
-    if (findRes.first == -1)
+        // 碎片数：每个文件的数据块按物理连续划分的段数
+        uint64_t extents = 0;
+        for (auto &src : srcs)
+        {
+            INode iNode{};
+            fileSystem->readINode(findINode(src), iNode);
+            uint64_t mapped;
+            extents += countExtents(iNode, mapped);
+        }
+
+        // 顺序读取：先把脏块写回，依次从头到尾读完每个文件
+        fileSystem->sync();
+        std::vector<char> out(chunk + 1);
+        uint64_t reads = fileSystem->getDiskStat().readCalls;
+        auto start = std::chrono::steady_clock::now();
+        for (auto &src : srcs)
+        {
+            open("r", src);
+            for (uint64_t done = 0; done < bytes; done += chunk)
+            {
+                read(0, src, out.data(), chunk);
+            }
+            close(src);
+        }
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        double total = static_cast<double>(bytes) * files / (1024 * 1024);
+        std::cout << static_cast<double>(extents) / files << "\t"
+                  << total / std::max<double>(1, cost.count()) * 1000000 << "\t"
+                  << static_cast<double>(fileSystem->getDiskStat().readCalls - reads) / total << std::endl;
+    }
+    // 删除全部测试文件
+    nowDirectory = saved;
+    rmdir(0, benchName);
+}
+
+void UserInterface::iobench(uint32_t files, uint32_t rounds)
+{
+    static const DiskMode modes[] = {DiskMode::STREAM, DiskMode::POSITIONAL, DiskMode::MAPPED};
+    static const char *names[] = {"stream", "pread", "mmap"};
+    static const uint16_t size = BLOCK_SIZE_BYTE; // 每个测试文件的字节数，超出内联容量，读写都落在数据块上
+    const std::string benchName = "iobench";
+    // 切换后端需要重新挂载，打开的文件会失效
+    if (anyOpened())
+    {
+        std::cout << "iobench: " << RED << "failed" << RESET << ": close all files first" << std::endl;
+        return;
+    }
+    if (duplicateDetection(benchName))
+    {
+        std::cout << "iobench: " << RED << "failed" << RESET << ": '" << benchName << "' exists" << std::endl;
+        return;
+    }
+    if (static_cast<uint64_t>(files) * 2 + 16 > fileSystem->getFreeBlockNumber())
+    {
+        std::cout << "iobench: skipped: not enough free blocks" << std::endl;
+        return;
+    }
+    mkdir(0, benchName);
+    Dirent item{};
+    if (DirectoryFile(fileSystem, nowDirectory).find(benchName, &item) == -1)
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
         return;
     }
+    inodeno_t saved = nowDirectory;
+    nowDirectory = item.inodeIndex;
+    std::vector<char> buf(size);
+    for (uint16_t i = 0; i < size; i++)
+    {
+        buf[i] = static_cast<char>('a' + i % 26);
+    }
+    std::vector<std::vector<std::string>> srcs;
+    for (uint32_t f = 0; f < files; f++)
+    {
+        touch(0, "f" + std::to_string(f));
+        srcs.push_back({"f" + std::to_string(f)});
+        open("w", srcs.back());
+        write(0, srcs.back(), buf.data(), size);
+        close(srcs.back());
+    }
+
+    // 每种后端关闭块缓存重新挂载，每次块读写都直接到达后端；系统调用数为后端估算的次数
+    MountOptions options = fileSystem->getMountOptions();
+    auto report = [this](const char *mode, const char *op, uint64_t count, std::chrono::steady_clock::time_point start,
+                         uint64_t syscalls)
+    {
+        auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << mode << "\t" << op << "\t" << count << "\t"
+                  << static_cast<double>(fileSystem->getDiskStat().syscalls - syscalls) / count << "\t"
+                  << static_cast<double>(count) / std::max<double>(1, cost.count()) * 1000000 << std::endl;
+    };
+    std::cout << "mode\top\tcount\tsyscalls/op\tops/s" << std::endl;
+    for (int m = 0; m < 3; m++)
+    {
+        MountOptions bench = options;
+        bench.diskMode = modes[m];
+        bench.cacheBlocks = 0;
+        if (!fileSystem->remount(bench))
+        {
+            std::cout << names[m] << "\tskipped: mount failed" << std::endl;
+            continue;
+        }
+
+        // ls：与 ls -l 相同，读出全部目录项并批量读取 i 结点，不输出
+        uint64_t syscalls = fileSystem->getDiskStat().syscalls;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            std::vector<inodeno_t> inos;
+            DirectoryFile(fileSystem, nowDirectory).forEach([&inos](uint32_t, const Dirent &entry)
+            {
+                inos.push_back(entry.inodeIndex);
+                return true;
+            });
+            std::vector<INode> iNodes;
+            fileSystem->readINodes(inos, iNodes);
+        }
+        report(names[m], "ls", rounds, start, syscalls);
+
+        // open/read：打开每个文件读出全部内容后关闭
+        syscalls = fileSystem->getDiskStat().syscalls;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            for (auto &src : srcs)
+            {
+                open("r", src);
+                read(0, src, buf.data(), size);
+                close(src);
+            }
+        }
+        report(names[m], "read", static_cast<uint64_t>(rounds) * files, start, syscalls);
+
+        // write：打开每个文件从头覆盖写入全部内容后关闭
+        syscalls = fileSystem->getDiskStat().syscalls;
+        start = std::chrono::steady_clock::now();
+        for (uint32_t r = 0; r < rounds; r++)
+        {
+            for (auto &src : srcs)
+            {
+                open("w", src);
+                write(0, src, buf.data(), size);
+                close(src);
+            }
+        }
+        report(names[m], "write", static_cast<uint64_t>(rounds) * files, start, syscalls);
+    }
 
-    // 获取源文件所在目录的磁盘块号
-    tmpDirDiskSrc = findRes.first;
-    // 从磁盘上读取该目录结构到 tmpDirSrc 中
-    fileSystem->read(tmpDirDiskSrc, 0, reinterpret_cast<char *>(&tmpDirSrc), sizeof(tmpDirSrc));
+    // 恢复原来的挂载选项，删除全部测试文件
+    fileSystem->remount(options);
+    nowDirectory = saved;
+    rmdir(0, benchName);
+}
 
-    // 获取源文件在目录中的索引
-    srcIndex = findRes.second;
-    // 根据目录项索引，获取源文件的 i-node 块号
-    srcInodeIndex = tmpDirSrc.item[srcIndex].inodeIndex;
+void UserInterface::diskbench(std::vector<uint64_t> sizes)
+{
+    // 在临时磁盘上依次创建并格式化各容量的磁盘
+    withScratchDisk("diskbench", "./diskbench.zhl", [&](const MountOptions &options)
+    {
+        std::cout << "size(MB)\tmode\tcreate ms\tformat ms\tfootprint(MB)" << std::endl;
+        for (uint64_t size : sizes)
+        {
+            for (bool preallocate : {false, true})
+            {
+                std::cout << size << "\t" << (preallocate ? "prealloc" : "sparse") << "\t";
+                // 与首次运行相同：创建磁盘文件，挂载后格式化
+                auto start = std::chrono::steady_clock::now();
+                bool created = fileSystem->createDisk(size * 1024 * 1024, preallocate);
+                auto create = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                if (!created)
+                {
+                    std::cout << "skipped: disk create failed" << std::endl;
+                    continue;
+                }
+                fileSystem->mount(options);
+                start = std::chrono::steady_clock::now();
+                bool formatted = fileSystem->format(BLOCK_SIZE / 8);
+                auto format = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                if (formatted)
+                {
+                    fileSystem->sync();
+                    std::cout << create.count() / 1000.0 << "\t" << format.count() / 1000.0 << "\t"
+                              << static_cast<double>(fileSystem->getFootprint()) / (1024 * 1024) << std::endl;
+                }
+                else
+                {
+                    std::cout << "skipped: format failed" << std::endl;
+                }
+                fileSystem->unmount();
+            }
+        }
+    });
+}
 
-    // 如果 i-node 块号为 0，则说明找不到源文件，打印错误并返回
-    if (srcInodeIndex == 0)
+void UserInterface::fillbench(uint32_t size)
+{
+    static const uint16_t chunk = 32 * 1024; // 每次写入的字节数，整块写入
+    static const uint64_t report = 1024 * 1024 * 1024; // 每写入1GB输出一次进度
+    withScratchDisk("fillbench", "./fillbench.zhl", [&](const MountOptions &options)
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find src" << std::endl;
+        uint64_t capacity = static_cast<uint64_t>(size) * 1024 * 1024 * 1024;
+        bool ready = fileSystem->createDisk(capacity, false);
+        if (ready)
+        {
+            fileSystem->mount(options);
+            ready = fileSystem->format(BLOCK_SIZE / 8);
+        }
+        if (!ready)
+        {
+            std::cout << "fillbench: " << RED << "failed" << RESET << ": cannot create " << size << "GB disk" << std::endl;
+        }
+        else
+        {
+            // 扣除映射元数据需要的块，其余空间全部写入一个文件
+            uint64_t blocks = fileSystem->getFreeBlockNumber();
+            blocks -= FileMap::metadataBound(blocks);
+            uint64_t bytes = blocks * BLOCK_SIZE_BYTE / chunk * chunk;
+            inodeno_t saved = nowDirectory;
+            nowDirectory = fileSystem->getRootINode();
+            std::vector<std::string> src{"fill"};
+            touch(0, src[0]);
+            open("rw", src);
+            std::vector<char> buf(chunk);
+            for (uint16_t i = 0; i < chunk; i++)
+            {
+                buf[i] = static_cast<char>('a' + i % 26);
+            }
+            std::cout << "written(GB)\tMB/s\tfootprint(MB)" << std::endl;
+            auto start = std::chrono::steady_clock::now();
+            auto elapsed = [&start]()
+            {
+                auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+                return std::max<double>(1, cost.count()) / 1000000;
+            };
+            // 每段开头记下段的序号，之后读回第一段与最后一段，确认超过4GB的偏移没有回绕
+            uint64_t written = 0;
+            for (uint64_t n = 0; written < bytes; n++)
+            {
+                std::memcpy(buf.data(), &n, sizeof n);
+                write(0, src, buf.data(), chunk);
+                written += chunk;
+                if (written % report == 0 || written == bytes)
+                {
+                    std::cout << static_cast<double>(written) / report << "\t"
+                              << static_cast<double>(written) / (1024 * 1024) / elapsed() << "\t"
+                              << static_cast<double>(fileSystem->getFootprint()) / (1024 * 1024) << std::endl;
+                }
+            }
+            close(src);
+            fileSystem->sync();
+            std::cout << "filled " << static_cast<double>(written) / report << " GB of a " << size << " GB sparse image in "
+                      << elapsed() << " s (" << static_cast<double>(written) / (1024 * 1024) / elapsed() << " MB/s), image footprint "
+                      << static_cast<double>(fileSystem->getFootprint()) / (1024 * 1024) << " MB" << std::endl;
+
+            std::vector<char> out(chunk + 1);
+            uint64_t last = bytes / chunk - 1;
+            bool intact = true;
+            open("r", src);
+            for (uint64_t n : {static_cast<uint64_t>(0), last})
+            {
+                setCursor(2, src, n * chunk);
+                read(0, src, out.data(), chunk);
+                uint64_t stamp;
+                std::memcpy(&stamp, out.data(), sizeof stamp);
+                intact = intact && stamp == n;
+            }
+            close(src);
+            if (!intact)
+            {
+                std::cout << "fillbench: " << RED << "failed" << RESET << ": data read back does not match" << std::endl;
+            }
+            nowDirectory = saved;
+        }
+    });
+}
+
+void UserInterface::allocatorbench(uint32_t files, uint32_t size)
+{
+    static const AllocatorKind kinds[] = {AllocatorKind::STACK, AllocatorKind::BITMAP, AllocatorKind::GROUPS};
+    static const char *names[] = {"stack", "bitmap", "groups"};
+    static const uint16_t chunk = 16 * 1024; // 每个文件每轮写入的字节数
+    static const uint32_t batch = 256;       // allocateN每批分配的块数
+    uint64_t bytes = static_cast<uint64_t>(size) * 1024 * 1024;
+    std::vector<char> buf(chunk);
+    for (uint16_t i = 0; i < chunk; i++)
+    {
+        buf[i] = static_cast<char>('a' + i % 26);
+    }
+    // 空闲空间管理方式在格式化时选定，每种方式在临时磁盘上格式化后测试
+    withScratchDisk("allocatorbench", "./allocatorbench.zhl", [&](const MountOptions &options)
+    {
+        inodeno_t saved = nowDirectory;
+        bool savedMode = delayedAllocation;
+        auto nsPerOp = [](std::chrono::steady_clock::time_point start, uint64_t count)
+        {
+            auto cost = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            return static_cast<double>(cost.count()) / std::max<uint64_t>(1, count);
+        };
+        std::cout << "allocator\tallocate ns/op\tallocateN ns/block\tfree ns/op\tsequential extents/file\tinterleaved extents/file"
+                  << std::endl;
+        for (int k = 0; k < 3; k++)
+        {
+            std::cout << names[k] << "\t";
+            // 磁盘容量为测试文件总大小的两倍，另留出管理结构的空间
+            MountOptions bench = options;
+            bench.allocator = kinds[k];
+            bool ready = fileSystem->createDisk(bytes * files * 2 + 64 * 1024 * 1024, false);
+            if (ready)
+            {
+                fileSystem->mount(bench);
+                ready = fileSystem->format(BLOCK_SIZE / 8);
+            }
+            if (!ready)
+            {
+                std::cout << "skipped: cannot create disk" << std::endl;
+                fileSystem->unmount();
+                continue;
+            }
+
+            // 单块分配与回收：分配空闲块的一半，再逐块回收
+            std::vector<blockno_t> blocks(fileSystem->getFreeBlockNumber() / 2);
+            auto start = std::chrono::steady_clock::now();
+            for (blockno_t &bno : blocks)
+            {
+                bno = fileSystem->blockAllocate();
+            }
+            double allocate = nsPerOp(start, blocks.size());
+            start = std::chrono::steady_clock::now();
+            for (blockno_t bno : blocks)
+            {
+                fileSystem->blockFree(bno);
+            }
+            double free = nsPerOp(start, blocks.size());
+
+            // 批量分配同样多的块，每批batch块，之后一次批量回收
+            start = std::chrono::steady_clock::now();
+            uint64_t got = 0;
+            while (got < blocks.size())
+            {
+                uint32_t want = std::min<uint64_t>(batch, blocks.size() - got);
+                uint32_t n = fileSystem->blockAllocateN(want, blocks.data() + got);
+                got += n;
+                if (n != want)
+                {
+                    break;
+                }
+            }
+            double allocateN = nsPerOp(start, got);
+            fileSystem->blockFreeN(blocks.data(), got);
+            fileSystem->update();
+
+            // 连续性：先逐个顺序写入测试文件，再与 allocbench 相同按立即分配交替写入，统计每个文件的段数
+            nowDirectory = fileSystem->getRootINode();
+            delayedAllocation = false;
+            uint64_t extents[2] = {0, 0};
+            for (int interleaved = 0; interleaved < 2; interleaved++)
+            {
+                std::vector<std::vector<std::string>> srcs;
+                for (uint32_t f = 0; f < files; f++)
+                {
+                    srcs.push_back({(interleaved ? "f" : "s") + std::to_string(f)});
+                    touch(0, srcs.back()[0]);
+                    open("rw", srcs.back());
+                }
+                for (size_t f = 0; f < (interleaved ? 1 : srcs.size()); f++)
+                {
+                    for (uint64_t written = 0; written < bytes; written += chunk)
+                    {
+                        uint16_t sz = std::min<uint64_t>(chunk, bytes - written);
+                        for (size_t g = 0; g < srcs.size(); g++)
+                        {
+                            if (interleaved || g == f)
+                            {
+                                write(0, srcs[g], buf.data(), sz);
+                            }
+                        }
+                    }
+                }
+                for (auto &src : srcs)
+                {
+                    close(src);
+                    INode iNode{};
+                    fileSystem->readINode(findINode(src), iNode);
+                    uint64_t mapped;
+                    extents[interleaved] += countExtents(iNode, mapped);
+                }
+            }
+            delayedAllocation = savedMode;
+            nowDirectory = saved;
+            std::cout << allocate << "\t" << allocateN << "\t" << free << "\t"
+                      << static_cast<double>(extents[0]) / files << "\t" << static_cast<double>(extents[1]) / files << std::endl;
+            fileSystem->unmount();
+        }
+    });
+}
+
+void UserInterface::withScratchDisk(const char *cmd, const std::string &name, const std::function<void(const MountOptions &)> &body)
+{
+    // 临时磁盘与当前磁盘共用一个磁盘驱动，期间卸载当前磁盘，打开的文件会失效
+    if (anyOpened())
+    {
+        std::cout << cmd << ": " << RED << "failed" << RESET << ": close all files first" << std::endl;
+        return;
+    }
+    if (std::ifstream(name).is_open())
+    {
+        std::cout << cmd << ": " << RED << "failed" << RESET << ": '" << name << "' exists" << std::endl;
         return;
     }
+    MountOptions options = fileSystem->getMountOptions();
+    fileSystem->unmount();
+    std::string previous = DiskDriver::getDiskName();
+    DiskDriver::setDiskName(name);
+    body(options);
+    // 删除临时磁盘，重新挂载原来的磁盘
+    fileSystem->unmount();
+    std::remove(name.c_str());
+    DiskDriver::setDiskName(previous);
+    fileSystem->mount(options);
+}
 
-    /*==================== 查找目标目录 ====================*/
+FileOpenItem *UserInterface::findOpened(inodeno_t ino)
+{
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
+    {
+        if (fileOpenTable[i].fileNumber == ino)
+        {
+            return &fileOpenTable[i];
+        }
+    }
+    return nullptr;
+}
 
-    // 在文件系统中查找 des 路径，对应的目录块号和目录项索引
-    auto findResDes = findDisk(des);
-    // 用于读取目标目录或其父目录的信息
-    Directory tmpDir{};
-    // 获取目标路径所在的目录块号
-    uint32_t tmpDirDisk = findResDes.first;
-    // 从磁盘中读取该目录结构到 tmpDir 中
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-
-    // 获取目标目录项对应的 i-node 块号
-    uint32_t desInodeIndex = tmpDir.item[findResDes.second].inodeIndex;
-    // 如果 i-node 块号为 0，则目标不存在，打印错误并返回
-    if (desInodeIndex == 0)
+void UserInterface::collectFiles(inodeno_t dir, std::vector<inodeno_t> &files, std::set<inodeno_t> &seen)
+{
+    // 先收集再整理，整理过程中不修改目录
+    DirectoryFile(fileSystem, dir).forEach([&](uint32_t, const Dirent &item)
+    {
+        if (item.name == "." || item.name == "..")
+            return true;
+        if (item.fileType == FileType::DIRECTORY)
+            collectFiles(item.inodeIndex, files, seen);
+        else if (item.fileType == FileType::REGULAR && seen.insert(item.inodeIndex).second)
+            files.push_back(item.inodeIndex);
+        return true;
+    });
+}
+
+DefragStat UserInterface::fragmentation(const std::vector<inodeno_t> &files)
+{
+    DefragStat stat{};
+    for (inodeno_t ino : files)
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":cannot find des" << std::endl;
-        return;
+        FileOpenItem *opened = findOpened(ino);
+        INode iNode{};
+        if (opened != nullptr)
+        {
+            iNode = opened->iNode;
+        }
+        else if (!fileSystem->readINode(ino, iNode))
+        {
+            continue;
+        }
+        uint64_t blocks;
+        uint64_t extents = countExtents(iNode, blocks);
+        if (blocks == 0)
+        {
+            continue;
+        }
+        stat.files++;
+        stat.fragmented += extents > 1 ? 1 : 0;
+        stat.extents += extents;
+        stat.blocks += blocks;
     }
+    return stat;
+}
 
-    // 读取目标目录自身的 i-node，获取该目录在磁盘上的数据块号（bno）
-    INode desInode{};
-    fileSystem->read(desInodeIndex, 0, reinterpret_cast<char *>(&desInode), sizeof(desInode));
-    // 目标目录的数据块号（bno）存储了该目录的实际目录项表
-    tmpDirDisk = desInode.bno;
-    // 读取目标目录的实际目录结构到 tmpDir 中
-    fileSystem->read(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
+bool UserInterface::defragFile(inodeno_t ino, uint32_t rate, uint64_t &moved, std::chrono::steady_clock::time_point start)
+{
+    // 已打开的文件直接修改打开表中的 i-node，并先写出延迟分配的数据
+    FileOpenItem *opened = findOpened(ino);
+    if (opened != nullptr)
+    {
+        flushDelayed(*opened);
+    }
+    INode local{};
+    if (opened == nullptr && !fileSystem->readINode(ino, local))
+    {
+        return false;
+    }
+    INode &iNode = opened != nullptr ? opened->iNode : local;
+    uint64_t mapped;
+    uint64_t extents = countExtents(iNode, mapped);
+    if (extents <= 1 || mapped > UINT32_MAX)
+    {
+        return false;
+    }
+    uint32_t n = mapped;
+    // 搬移期间新旧数据块同时占用
+    if (n + FileMap::metadataBound(n) > fileSystem->getFreeBlockNumber())
+    {
+        return false;
+    }
 
-    /* 在目标目录中查找第一个空闲的目录项位置 */
-    int location = -1;
-    for (int i = 0; i < DIRECTORY_NUMS; i++)
+    // 从文件现在的第一块开始找一段连续的空闲块；不是一整段时整理一次空闲空间再试，只要比原来更连续就搬移
+    FileMap oldMap(fileSystem, iNode, opened != nullptr ? &opened->indexCursor : nullptr);
+    uint32_t run;
+    std::vector<blockno_t> fresh(n);
+    for (int attempt = 0;; attempt++)
     {
-        if (tmpDir.item[i].inodeIndex == 0)
+        uint32_t got = fileSystem->blockAllocateN(n, fresh.data(), oldMap.lookup(0, run));
+        std::sort(fresh.begin(), fresh.begin() + got);
+        uint64_t runs = got > 0 ? 1 : 0;
+        for (uint32_t i = 1; i < got; i++)
+        {
+            runs += fresh[i] != fresh[i - 1] + 1 ? 1 : 0;
+        }
+        if (got == n && (runs == 1 || (attempt > 0 && runs < extents)))
         {
-            location = i;
             break;
         }
+        fileSystem->blockFreeN(fresh.data(), got);
+        if (attempt > 0)
+        {
+            return false;
+        }
+        fileSystem->compactFree();
     }
-    // 如果目标目录已满，没有空闲目录项，则打印错误并返回
-    if (location == -1)
+
+    // 每次按旧映射读入一批块，再按新块的物理连续段写出；限速时按已搬移的字节数休眠到应有的时刻
+    std::vector<char> buf(static_cast<size_t>(DEFRAG_CHUNK_BLOCKS) * BLOCK_SIZE_BYTE);
+    for (uint32_t lblk = 0; lblk < n;)
     {
-        std::cout << "mv: " << RED << "failed" << RESET << ":des directory full" << std::endl;
-        return;
+        uint32_t count = std::min<uint32_t>(DEFRAG_CHUNK_BLOCKS, n - lblk);
+        for (uint32_t k = 0; k < count; k += run)
+        {
+            blockno_t pblk = oldMap.lookup(lblk + k, run);
+            if (pblk == 0)
+            {
+                fileSystem->blockFreeN(fresh.data(), n);
+                return false;
+            }
+            run = std::min(run, count - k);
+            fileSystem->readRun(pblk, run, buf.data() + static_cast<size_t>(k) * BLOCK_SIZE_BYTE);
+        }
+        for (uint32_t k = 0; k < count; k += run)
+        {
+            run = 1;
+            while (k + run < count && fresh[lblk + k + run] == fresh[lblk + k] + run)
+            {
+                run++;
+            }
+            fileSystem->writeRun(fresh[lblk + k], run, buf.data() + static_cast<size_t>(k) * BLOCK_SIZE_BYTE);
+        }
+        lblk += count;
+        moved += static_cast<uint64_t>(count) * BLOCK_SIZE_BYTE;
+        if (rate != 0)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(moved * 1000000 / (rate * 1024ull * 1024)));
+        }
     }
 
-    /*==================== 在目标目录中创建新目录项 ====================*/
-
-    // 将源文件/目录的名称（src 的最后一个路径组件）复制到目标目录项的 name 字段
-    strcpy(tmpDir.item[location].name, src.back().c_str());
-    // 为目标目录项分配一个新的 i-node 块号，用于“复制”源文件/目录的 i-node（目前仅分配，未写入具体 i-node 数据）
-    tmpDir.item[location].inodeIndex = fileSystem->blockAllocate();
+    // 在 i-node 的副本中建立新映射，映射元数据在新数据块之后分配；写回 i-node 即一次切换到新映射
+    INode relocated = iNode;
+    FileMap::init(relocated, iNode.layout);
+    FileMap newMap(fileSystem, relocated);
+    uint32_t done = newMap.appendBlocks(0, fresh.data(), n);
+    if (done != n)
+    {
+        std::vector<blockno_t> unused(fresh.begin() + done, fresh.end());
+        newMap.collect(unused);
+        fileSystem->blockFreeN(unused.data(), unused.size());
+        fileSystem->update();
+        return false;
+    }
+    fileSystem->writeINode(ino, relocated);
 
-    // 将修改后的目标目录结构写回磁盘
-    fileSystem->write(tmpDirDisk, 0, reinterpret_cast<char *>(&tmpDir), sizeof(tmpDir));
-    // 更新文件系统元数据（如位图、空闲块信息等）
+    // 切换之后再回收旧的数据块与映射元数据块
+    std::vector<blockno_t> old;
+    oldMap.collect(old);
+    if (opened != nullptr)
+    {
+        opened->iNode = relocated;
+        opened->indexCursor = FileIndexCursor{};
+    }
+    fileSystem->blockFreeN(old.data(), old.size());
     fileSystem->update();
+    return true;
+}
 
-    // 注意：此处仅完成了目录项的创建和新的 i-node 分配，真正的文件内容或子目录内容未被复制。
-    // 若需实现深度复制，还需递归地复制源文件/目录的所有数据块与子目录项，并写入到新的 i-node 和数据块中。
+void UserInterface::defrag(std::vector<std::string> src, uint32_t rate, bool dryRun)
+{
+    Dirent item{};
+    if (!findItem(src, item) || (item.fileType != FileType::DIRECTORY && item.fileType != FileType::REGULAR))
+    {
+        std::cout << "defrag: " << RED << "failed" << RESET << ":no such file or directory" << std::endl;
+        return;
+    }
+    std::vector<inodeno_t> files;
+    if (item.fileType == FileType::DIRECTORY)
+    {
+        std::set<inodeno_t> seen;
+        collectFiles(item.inodeIndex, files, seen);
+    }
+    else
+    {
+        files.push_back(item.inodeIndex);
+    }
+
+    auto report = [](const char *when, const DefragStat &stat)
+    {
+        std::cout << when << "\t" << stat.files << "\t" << stat.fragmented << "\t\t" << stat.extents << "\t"
+                  << stat.blocks << "\t" << static_cast<double>(stat.extents) / std::max<uint64_t>(1, stat.files) << std::endl;
+    };
+    std::cout << "\tfiles\tfragmented\textents\tblocks\textents/file" << std::endl;
+    report("before", fragmentation(files));
+    if (dryRun)
+    {
+        return;
+    }
+
+    uint64_t moved = 0;
+    uint64_t relocated = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (inodeno_t ino : files)
+    {
+        relocated += defragFile(ino, rate, moved, start) ? 1 : 0;
+    }
+    auto cost = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    report("after", fragmentation(files));
+    double mb = static_cast<double>(moved) / (1024 * 1024);
+    std::cout << "relocated " << relocated << " files, moved " << mb << " MB in "
+              << static_cast<double>(cost.count()) / 1000000 << " s ("
+              << mb / std::max<double>(1, cost.count()) * 1000000 << " MB/s)" << std::endl;
 }
 
-void UserInterface::logOut()
+void UserInterface::sync()
 {
-    // 关闭所有未关闭的文件
-    for (int i = 0; i < FILE_OPEN_MAX_NUM; ++i)
+    // 延迟分配的数据先分配物理块写出
+    for (int i = 0; i < FILE_OPEN_MAX_NUM; i++)
     {
-        if (fileOpenTable[i].fileNumber != 0 && 0 != (fileOpenTable[i].flag & 0x04))
+        if (fileOpenTable[i].fileNumber != 0)
         {
-            fileSystem->write(fileOpenTable[i].fileNumber, 0, reinterpret_cast<char *>(&fileOpenTable[i].iNode),
-                              sizeof(fileOpenTable[i].iNode));
+            flushDelayed(fileOpenTable[i]);
         }
     }
-    // 更新信息
-    fileSystem->update();
+    fileSystem->sync();
+}
+
+void UserInterface::fstrim()
+{
+    uint64_t before = fileSystem->getFootprint();
+    uint32_t ranges = 0;
+    uint32_t blocks = fileSystem->trim(ranges);
+    uint64_t after = fileSystem->getFootprint();
+    std::cout << "trimmed " << blocks << " blocks in " << ranges << " ranges" << std::endl;
+    std::cout << "image footprint: " << before / 1024 << " KB -> " << after / 1024 << " KB" << std::endl;
+}
+
+void UserInterface::iostat(bool reset)
+{
+    const DiskStat &stat = fileSystem->getDiskStat();
+    std::cout << "disk reads: " << stat.readCalls << "\t" << "bytes: " << stat.bytesRead << std::endl;
+    std::cout << "disk writes: " << stat.writeCalls << "\t" << "bytes: " << stat.bytesWritten << std::endl;
+    std::cout << "seeks: " << stat.seekCalls << "\t" << "syscalls: " << stat.syscalls << std::endl;
+    std::cout << "discards: " << stat.discardCalls << "\t" << "bytes: " << stat.bytesDiscarded << "\t"
+              << "pending blocks: " << fileSystem->getPendingDiscard() << "\t" << "hole blocks: " << fileSystem->getDiscardedBlocks() << "\t"
+              << "image footprint: " << fileSystem->getFootprint() / 1024 << " KB" << std::endl;
+    CacheStat cacheStat = fileSystem->getCacheStat();
+    std::cout << "cache blocks: " << fileSystem->getCacheCapacity() << "\t" << "hits: " << cacheStat.hits << "\t"
+              << "misses: " << cacheStat.misses << "\t" << "evictions: " << cacheStat.evictions << std::endl;
+    std::cout << "cache prefetched: " << cacheStat.prefetches << "\t" << "prefetch hits: " << cacheStat.prefetchHits << std::endl;
+    std::cout << "cache dirty: " << fileSystem->getCacheDirty() << "\t" << "writebacks: " << cacheStat.writebacks << "\t"
+              << "flush ios: " << cacheStat.flushIOs << std::endl;
+    DentryCache *dentries = fileSystem->getDentryCache();
+    DentryStat dentryStat = dentries->getStat();
+    std::cout << "orphans: " << fileSystem->getOrphanCount() << "\t" << "reclaimed blocks: "
+              << fileSystem->getReclaimedBlocks() << "\t" << "reserved blocks: " << fileSystem->getReservedBlocks() << std::endl;
+    std::cout << "dentries: " << dentries->size() << "\t" << "hits: " << dentryStat.hits << "\t"
+              << "negative hits: " << dentryStat.negativeHits << "\t" << "misses: " << dentryStat.misses << std::endl;
+    if (reset)
+    {
+        fileSystem->resetDiskStat();
+    }
 }
@@ -12,7 +12,26 @@
 #include "entity/FileIndex.h"
 #include "Tools.h"
 #include "vector"
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <thread>
 #include "entity/FileOpenItem.h"
+#include "FileMap.h"
+#include "DirectoryFile.h"
+
+/*
+ * @brief 碎片统计，只统计有数据块的普通文件
+ */
+struct DefragStat
+{
+    uint64_t files;      // 文件数
+    uint64_t fragmented; // 数据块不止一段的文件数
+    uint64_t extents;    // 各文件数据块按物理连续划分的段数之和
+    uint64_t blocks;     // 各文件已映射的数据块数之和
+};
 
 /*
  * @brief 为用户提供的接口，支持用户常用的功能
@@ -21,13 +40,13 @@ class UserInterface
 {
 public:
     static UserInterface *getInstance(); // 为了防止冲突，使用单例获取用户接口对象
-    void initialize();                   // 初始化
+    void initialize(const MountOptions &options); // 按挂载选项初始化
     // zhl:mkdir检查通过
     void mkdir(uint8_t uid, std::string directoryName);                               // mkdir命令接口,创建目录
     void mkdir(uint8_t uid, std::vector<std::string> src, std::string directoryName); // mkdir命令接口,根据src指出的路径创建目录
     // zhl:ls检查通过
-    void ls();                             // ls命令接口,显示当前目录所有文件信息
-    void ls(std::vector<std::string> src); // ls命令接口,src指出的目录的所有文件信息
+    void ls(bool detail = false);                             // ls命令接口,显示当前目录所有文件信息,detail为真时批量读取i结点显示权限、链接数、所有者和大小
+    void ls(std::vector<std::string> src, bool detail = false); // ls命令接口,src指出的目录的所有文件信息
     // zhl:touch检查通过
     void touch(uint8_t uid, std::string fileName);                               // touch命令接口,创建文件
     void touch(uint8_t uid, std::vector<std::string> src, std::string fileName); // touch命令接口,根据src路径创建文件
@@ -35,9 +54,9 @@ public:
     bool cd(std::string directoryName);    // cd命令接口,进入当前目录的文件夹，返回切换是否成功
     void cd(std::vector<std::string> src); // cd命令接口,根据src提供的路径进入文件夹
     // zhl:rmdir和rm检查通过
-    void rm(uint8_t uid, std::string fileName);                                 // rm命令接口,删除文件
+    void rm(uint8_t uid, std::string fileName);                                 // rm命令接口,删除文件;已打开的文件不删除
     void rm(uint8_t uid, std::vector<std::string> src, std::string fileName);   // rm命令接口,根据src路径删除文件
-    void rmdir(uint8_t uid, std::string dirName);                               // rmdir命令接口,删除文件夹
+    bool rmdir(uint8_t uid, std::string dirName);                               // rmdir命令接口,删除文件夹;子树中有打开的文件时不删除,返回是否删除
     void rmdir(uint8_t uid, std::vector<std::string> src, std::string dirName); // rmdir命令接口,根据src路径删除文件夹
 
     void mv(std::vector<std::string> src, std::vector<std::string> des);        // mv命令接口,移动文件或者目录
@@ -47,11 +66,23 @@ public:
     // 格式为chmod oau rwx src
     void open(std::string how, std::vector<std::string> src);                            // open命令接口,对src指出的文件以how方式打开并设置文件打开表
     void close(std::vector<std::string> src);                                            // close命令接口,关闭src指出的文件并设置文件打开表
-    void setCursor(int code, std::vector<std::string> src, uint32_t offset);             // 移动文件指针,code=1表示根据当前文件指针设置偏移,code=2表示从0开始设置偏移
+    void setCursor(int code, std::vector<std::string> src, uint64_t offset);             // 移动文件指针,code=1表示根据当前文件指针设置偏移,code=2表示从0开始设置偏移
     void read(uint8_t uid, std::vector<std::string> src, char *buf, uint16_t sz);        // 将src指出的文件读sz个字节到buf数组中
     void write(uint8_t uid, std::vector<std::string> src, const char *buf, uint16_t sz); // 将buf数组的数据写入到src指出的文件中
+    void fallocate(std::vector<std::string> src, uint64_t length);                      // fallocate命令接口,为src指出的文件一次分配覆盖前length字节的数据块,不改变文件大小
     void updateDirNow();                                                                 // 更新当前目录信息
     void cp(std::vector<std::string> src, std::vector<std::string> des);                 // cp命令接口,复制文件或者目录
+    void iostat(bool reset);                                                             // iostat命令接口,显示磁盘读写统计,reset为真时清空统计
+    void sync();                                                                         // sync命令接口,把缓存中的脏块全部写回磁盘
+    void fstrim();                                                                       // fstrim命令接口,对所有尚未打洞的空闲块在磁盘文件上打洞,显示磁盘文件实际占用的变化
+    void defrag(std::vector<std::string> src, uint32_t rate, bool dryRun);               // defrag命令接口,把src指出的文件或目录子树中碎片化的文件搬到连续的空闲块中,rate为每秒最多搬移的MB数(0不限速),dryRun为真时只报告碎片情况
+    void bench(std::vector<FileLayout> layouts, uint32_t ops);                           // bench命令接口,按各块映射方式建立1MB到4GB的测试文件,测量ops次随机定位读取的耗时
+    void dirbench(uint32_t entries, uint32_t ops, uint32_t dirs);                        // dirbench命令接口,在dirs个目录中共创建entries个文件,测量创建、ops次随机查找、删除ops个文件和列出目录的耗时
+    void allocbench(uint32_t files, uint32_t size);                                      // allocbench命令接口,分别按立即分配、预分配和延迟分配交替写入files个size MB的文件,测量碎片数和顺序读取速度
+    void iobench(uint32_t files, uint32_t rounds);                                       // iobench命令接口,关闭块缓存依次以各磁盘后端重新挂载,测量ls、打开读取和打开写入files个文件各rounds轮的系统调用数和吞吐
+    void diskbench(std::vector<uint64_t> sizes);                                         // diskbench命令接口,在临时磁盘文件上测量各容量(MB)的稀疏与预分配磁盘的创建、格式化耗时和实际占用空间
+    void fillbench(uint32_t size);                                                       // fillbench命令接口,在临时的size GB稀疏磁盘上顺序写满一个文件,输出写入吞吐和磁盘文件实际占用空间
+    void allocatorbench(uint32_t files, uint32_t size);                                  // allocatorbench命令接口,在临时磁盘上依次按各空闲空间管理方式格式化,测量单块分配、批量分配和回收的耗时,以及顺序写入和交替写入files个size MB文件后的段数
 
     ~UserInterface();
     void revokeInstance();
@@ -61,24 +92,42 @@ public:
     void logOut();                                                    // 一个用户退出后的处理
     void getUser(uint8_t uid, User *user);                            // 根据uid提取用户信息
     void goToRoot();                                                  // 进入根目录
+    std::mutex &getLock();                                            // 文件系统锁,执行每条命令时持有,与后台回收线程互斥
 
 private:
     static UserInterface *instance;
-    Directory directory;      // 当前目录
-    uint32_t nowDiretoryDisk; // 当前目录所在磁盘块号
+    inodeno_t nowDirectory;   // 当前目录的i结点号
     FileSystem *fileSystem;
+    bool delayedAllocation;   // 延迟分配模式,写到文件末尾之后的数据先积攒在打开表项中,写出时才分配物理块
 
     FileOpenItem fileOpenTable[FILE_OPEN_MAX_NUM]; // 文件打开表
 
     // 非接口函数设为私有，不让上层调用
-    std::pair<uint32_t, int>
-    findDisk(std::vector<std::string> src); // 从当前目录开始,根据src数组提供的路径,找到对应文件或者目录所在的目录所在的磁盘块号和该文件或者目录的i结点所在的目录项序号
-    // 第一个为对应文件或者目录所在的目录所在的磁盘块号;第二个为该文件或者目录的i结点所在的目录项序号;code为方式码,1为文件,2为目录
-    uint32_t fileIndexBlockFree(uint32_t disk); // 回收文件索引表中所有文件的块以及文件索引表本身的块,并返回还有没有下一个索引
-    void wholeDirItemsMove(int itemLocation);   // 将从指定位置开始的目录项整体前移
+    std::pair<inodeno_t, uint32_t>
+    findDisk(std::vector<std::string> src); // 从当前目录开始,根据src数组提供的路径,找到对应文件或者目录所在的目录的i结点号和该文件或者目录在其中的目录项位置;不改变当前目录
+    // 第一个为对应文件或者目录所在的目录的i结点号,找不到时为0;第二个为该文件或者目录在该目录中的目录项序号
+    bool walk(const std::vector<std::string> &src, size_t count, inodeno_t &dir); // 从当前目录开始经目录项缓存沿src的前count级目录查找,dir为到达的目录;不改变当前目录,找不到返回false
+    bool findItem(std::vector<std::string> src, Dirent &item); // 根据src数组提供的路径经目录项缓存找到对应文件或者目录的目录项,找不到返回false
+    inodeno_t findINode(std::vector<std::string> src); // 根据src数组提供的路径找到对应文件或者目录的i结点号,找不到返回0
+    inodeno_t findDirectory(std::vector<std::string> src); // 根据src数组提供的路径找到对应目录的i结点号,找不到或不是目录返回0;按目录项记录的类型判断,不读取i结点
+    void collectFileBlocks(inodeno_t ino, std::vector<blockno_t> &blocks);       // 收集文件占用的所有块(映射元数据、数据块),由调用者批量回收;i结点立即归还i节点表
+    void collectDirectoryBlocks(inodeno_t ino, std::vector<blockno_t> &blocks);  // 递归收集目录子树占用的所有块,由调用者批量回收;子树的i结点立即归还i节点表
     bool duplicateDetection(std::string name);  // 重复名检测
-    bool judge(uint32_t disk);                  // 判断i结点指向的是目录还是文件,目录真,文件假
-    int judge(std::vector<std::string> src);    // 判断src指向的是目录还是文件,文件1,目录2
+    bool isInside(inodeno_t dir, inodeno_t ancestor); // dir是否为ancestor自身或在其子树中,沿..向上查找
+    void listDirectory(inodeno_t dir, bool detail); // 列出dir目录中的所有目录项,只用目录项中记录的名字和类型
+    void listDetail(inodeno_t dir);             // 列出dir目录中的所有目录项及其i结点信息,i结点批量读取
+    int judge(std::vector<std::string> src);    // 判断src指向的是目录还是文件,文件1,目录2,按目录项记录的类型判断
+    void readAhead(FileOpenItem &item, uint64_t start, uint16_t sz);              // 识别顺序读并异步预读后续数据块,随机读时收缩预读窗口
+    blockno_t homeOf(const std::vector<std::string> &src); // src所在目录的第一个目录块,新文件的第一个数据块在它附近分配
+    bool flushDelayed(FileOpenItem &item);      // 为延迟分配的数据一次分配物理块并写出,写回i结点;空间不足时丢弃放不下的部分并返回false
+    uint64_t countExtents(INode &iNode, uint64_t &blocks); // 文件已映射的数据块按物理连续划分的段数,blocks为已映射的块数
+    FileOpenItem *findOpened(inodeno_t ino);    // ino号文件在打开表中的表项,没有打开时返回nullptr
+    bool anyOpened();                           // 打开表中是否有文件
+    void withScratchDisk(const char *cmd, const std::string &name, const std::function<void(const MountOptions &)> &body); // 卸载当前磁盘,在新的name磁盘文件上执行body,结束后删除该文件并重新挂载原来的磁盘;有打开的文件或name已存在时输出错误并返回
+    bool hasOpened(inodeno_t dir);              // dir目录本身或其子树中是否有文件或目录在打开表中
+    void collectFiles(inodeno_t dir, std::vector<inodeno_t> &files, std::set<inodeno_t> &seen); // 递归收集目录子树中的普通文件,seen用于去掉硬链接重复的文件
+    DefragStat fragmentation(const std::vector<inodeno_t> &files); // 统计files中各文件的碎片情况,已打开的文件按打开表中的i结点统计
+    bool defragFile(inodeno_t ino, uint32_t rate, uint64_t &moved, std::chrono::steady_clock::time_point start); // 把文件的数据块搬到更连续的空闲块中,一次写回i结点切换到新映射后回收旧块;moved累计搬移的字节数,按rate限速;没有更连续的空闲空间时不搬移并返回false
 
     UserInterface();
 };
@@ -0,0 +1,21 @@
+
+
+#ifndef FILESYSTEM_BLOCKMAP_H
+#define FILESYSTEM_BLOCKMAP_H
+
+#include <cstdint>
+#include "../Constraints.h"
+
+/*
+ * @brief 多级块映射的根，存放在i节点的data中；逻辑块依次由直接块、一级、二级、三级间接块映射，
+ *        间接块中是BLOCKMAP_PER_BLOCK个块号，0表示未映射
+ */
+class BlockMapRoot
+{
+public:
+    uint32_t mapped;                    // 已映射的逻辑块数
+    blockno_t direct[BLOCKMAP_DIRECT];  // 直接块
+    blockno_t indirect[3];              // 一级、二级、三级间接块
+};
+
+#endif // FILESYSTEM_BLOCKMAP_H
@@ -5,13 +5,13 @@
 #include "DirectoryItem.h"
 
 /*
- * @brief 目录类，一个目录恰好是一个块大小
+ * @brief 旧格式的定长目录块，一个块大小，只在挂载时转换旧磁盘用到
  */
 class Directory
 {
 public:
     DirectoryItem item[BLOCK_SIZE / DIRECTORY_ITEM_SIZE]; // 32768 / 128 = 256
-    // 从头开始遍历第一个inodeindex==0的项为空闲目录项
+    // 单块目录中从头开始遍历第一个inodeindex==0的项为空闲目录项，多块目录中inodeindex==0的项是空位
 };
 
 #endif // FILESYSTEM_DIRECTORY_H
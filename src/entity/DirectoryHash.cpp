@@ -0,0 +1,3 @@
+
+
+#include "DirectoryHash.h"
@@ -0,0 +1,20 @@
+
+
+#ifndef FILESYSTEM_DIRECTORYHASH_H
+#define FILESYSTEM_DIRECTORYHASH_H
+
+#include <cstdint>
+#include "../Constraints.h"
+
+/*
+ * @brief 目录散列索引的一个槽；散列索引是按线性探测组织的开放寻址表，槽数为2的幂，
+ *        pos为对应目录项记录在目录文件中的字节偏移加1，0表示空槽
+ */
+class DirectoryHashSlot
+{
+public:
+    uint32_t hash; // 目录项名字的散列值
+    uint32_t pos;  // 目录项记录的字节偏移加1
+};
+
+#endif // FILESYSTEM_DIRECTORYHASH_H
@@ -7,12 +7,12 @@
 #include "../Constraints.h"
 
 /*
- * @brief 目录项
+ * @brief 旧格式的定长目录项，只在挂载时转换旧磁盘用到
  */
 class DirectoryItem
 {
 public:
-    uint32_t inodeIndex;         // 本目录项指向的i节点所在的磁盘块号
+    inodeno_t inodeIndex;        // 本目录项指向的i节点号
     char name[FILE_NAME_LENGTH]; // 文件名\目录名
 };
 
@@ -0,0 +1,3 @@
+
+
+#include "Dirent.h"
@@ -0,0 +1,55 @@
+
+
+#ifndef FILESYSTEM_DIRENT_H
+#define FILESYSTEM_DIRENT_H
+
+#include <cstdint>
+#include <string>
+#include "../Constraints.h"
+
+/*
+ * @brief 目录项中记录的文件类型，与i节点flag的高2位对应
+ */
+enum class FileType : uint8_t
+{
+    UNKNOWN = 0,
+    REGULAR = 1,   // 普通文件
+    DIRECTORY = 2, // 目录
+    SYMLINK = 3    // 软链接
+};
+
+/*
+ * @brief 变长目录项记录的头部，其后紧跟nameLength字节的名字（不以0结尾）；
+ *        一个目录块由若干条记录首尾相接铺满，记录不跨块，inodeIndex为0的记录是空位
+ */
+class DirentHeader
+{
+public:
+    inodeno_t inodeIndex;  // 本目录项指向的i节点号，0表示空位
+    uint16_t recordLength; // 本记录占用的字节数，即到下一条记录的距离，4字节对齐
+    uint8_t nameLength;    // 名字的字节数
+    uint8_t typeMode;      // 低2位为文件类型，见FileType；高6位为权限摘要，即i节点flag的低6位
+};
+
+/*
+ * @brief 以变长记录存放的目录块
+ */
+class DirentBlock
+{
+public:
+    char bytes[BLOCK_SIZE_BYTE];
+};
+
+/*
+ * @brief 读出到内存中的目录项
+ */
+class Dirent
+{
+public:
+    inodeno_t inodeIndex; // 本目录项指向的i节点号
+    FileType fileType;    // 文件类型
+    uint8_t mode;         // 权限摘要，同i节点flag的低6位：中间3位为信赖者的rwx，低3位为其余用户的rwx
+    std::string name;     // 文件名\目录名
+};
+
+#endif // FILESYSTEM_DIRENT_H
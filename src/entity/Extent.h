@@ -0,0 +1,42 @@
+
+
+#ifndef FILESYSTEM_EXTENT_H
+#define FILESYSTEM_EXTENT_H
+
+#include <cstdint>
+#include "../Constraints.h"
+
+/*
+ * @brief 区段，叶子节点中表示逻辑块[logical,logical+length)映射到从start开始的连续物理块；
+ *        索引节点中start为子节点所在磁盘块，logical为子树的第一个逻辑块，length不使用
+ */
+class Extent
+{
+public:
+    uint32_t logical; // 起始逻辑块号
+    blockno_t start;  // 起始物理块号，或子节点所在磁盘块号
+    uint32_t length;  // 块数
+};
+
+/*
+ * @brief 区段树节点头部
+ */
+class ExtentHeader
+{
+public:
+    uint16_t count;    // 有效项数
+    uint16_t depth;    // 节点高度，叶子为0
+    uint32_t reserved; // 保留，为0
+};
+
+/*
+ * @brief 存放在一个磁盘块中的区段树节点
+ */
+class ExtentNode
+{
+public:
+    ExtentHeader header;
+    Extent entries[EXTENT_PER_BLOCK];
+};
+
+#endif // FILESYSTEM_EXTENT_H
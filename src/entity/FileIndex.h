@@ -12,8 +12,17 @@
 class FileIndex
 {
 public:
-    uint32_t index[BLOCK_SIZE / 32 - 1]; // 数据存放的磁盘块号,4092
-    uint32_t next;                       // 下一个索引的磁盘块号，支持大文件,没有为0
+    blockno_t index[BLOCK_SIZE / 32 - 1]; // 数据存放的磁盘块号,4092
+    blockno_t next;                       // 下一个索引的磁盘块号，支持大文件,没有为0
+};
+
+/*
+ * @brief 索引表链表的定位缓存，记录最近访问的是第几个索引表及其所在磁盘块
+ */
+struct FileIndexCursor
+{
+    uint64_t tableNo; // 最近访问的索引表是文件的第几个索引表
+    blockno_t block;  // 最近访问的索引表所在磁盘块，0表示尚未访问，定位时从这里继续沿链表查找
 };
 
 #endif // FILESYSTEM_FILEINDEX_H
@@ -4,19 +4,28 @@
 #define FILESYSTEM_FILEOPENITEM_H
 
 #include <cstdint>
+#include <vector>
 #include "../Constraints.h"
 #include "INode.h"
+#include "FileIndex.h"
 /**
  * @brief 用户打开文件表表项
  */
 class FileOpenItem
 {
 public:
-    char fileName[FILE_NAME_LENGTH]; // 文件名
+    char fileName[DIRENT_NAME_MAX + 1]; // 文件名
     uint8_t flag;                    // 标志位，低2位是读写方式10读，01写，11读写，第3位是修改标记，0未修改1已修改
-    uint32_t fileNumber;             // 将文件i节点所在磁盘块设置为该文件的文件号，0说明是空文件打开表项
+    inodeno_t fileNumber;            // 将文件的i节点号设置为该文件的文件号，0说明是空文件打开表项
     INode iNode;                     // 文件i节点
-    uint32_t cursor;                 // 文件指针，指向当前所在位置
+    uint64_t cursor;                 // 文件指针，指向当前所在位置
+    uint64_t lastReadEnd;            // 上一次读取结束的位置，本次从这里开始读视为顺序读
+    uint32_t raWindow;               // 预读窗口大小（块数），0表示未在预读
+    uint64_t raNext;                 // 下一个尚未预读的文件内逻辑块号
+    FileIndexCursor indexCursor;     // INDEX布局下最近访问的索引表，定位时从这里继续沿链表查找
+    std::vector<char> delayed;       // 延迟分配：写到已映射部分之后、尚未分配物理块的数据，为其按块预留了空间
+    uint64_t delayStart;             // delayed第一个字节在文件中的偏移，总是块对齐且等于已映射部分的末尾
+    blockno_t home;                  // 文件所在目录的第一个目录块，文件还没有数据块时在它附近分配
 };
 
 #endif // FILESYSTEM_FILEOPENITEM_H
@@ -5,6 +5,8 @@
 
 #include <cstdint>
 #include "User.h"
+#include "INode.h"
+#include "../Constraints.h"
 
 /*
  * @brief 超级块对象
@@ -12,18 +14,27 @@
 class FileSystemInfo
 {
 public:
-    uint32_t rootLocation; // 根目录所在磁盘块
+    uint32_t rootLocation; // 根目录的i节点号；没有i节点表的旧格式中为根目录i节点所在磁盘块
 
     uint32_t freeBlockNumber;      // 空闲块个数
-    uint32_t freeBlockStackTop;    // 空闲块栈的栈顶（栈底根据块大小和磁盘大小可以计算）
+    blockno_t freeBlockStackTop;   // 空闲块栈的栈顶（栈底根据块大小和磁盘大小可以计算）
     uint16_t freeBlockStackOffset; // 空闲块栈栈顶指针所在的块内偏移
 
-    uint32_t avaliableCapasity; // 磁盘可用容量
+    uint64_t avaliableCapasity; // 磁盘可用容量
 
     User users[8];             // 用户列表，最多为8
     uint8_t trustMatrix[8][8]; // 信赖者矩阵，trustMatrix[i][j]=1代表对i而言j可信赖
 
     uint8_t flag; // 超级块修改标记
+
+    uint32_t features; // 格式特性位，见Constraints.h中的FEATURE_*，0为旧格式
+
+    INode inodeTable;         // i节点表本身按文件存放，这是它的i节点，块映射的根在超级块中
+    uint32_t inodeCount;      // i节点表中的记录数
+    uint32_t freeINodeNumber; // 空闲i节点个数
+    uint32_t inodeHint;       // 下一次分配i节点时从这条记录所在的块开始查找
+
+    inodeno_t orphanDirectory; // 孤儿目录的i节点号，已从目录中删除、等待回收的i节点以i节点号为名挂在其下
 };
 
 #endif // FILESYSTEM_FILESYSTEMINFO_H
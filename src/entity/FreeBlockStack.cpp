@@ -2,24 +2,24 @@
 
 #include "FreeBlockStack.h"
 
-FreeBlockStack::FreeBlockStack() : maxSize(BLOCK_SIZE / (8 * sizeof(uint32_t)))
+FreeBlockStack::FreeBlockStack() : maxSize(BLOCK_SIZE / (8 * sizeof(blockno_t)))
 {
 }
 
-uint32_t FreeBlockStack::getBlock()
+blockno_t FreeBlockStack::getBlock()
 {
-    uint32_t ret = blocks[stackTop];
+    blockno_t ret = blocks[stackTop];
     stackTop++;
     return ret;
 }
 
-void FreeBlockStack::revokeBlock(uint32_t block)
+void FreeBlockStack::revokeBlock(blockno_t block)
 {
     stackTop--;
     blocks[stackTop] = block;
 }
 
-uint32_t *FreeBlockStack::getBlocks()
+blockno_t *FreeBlockStack::getBlocks()
 {
     return blocks;
 }
@@ -10,9 +10,9 @@ class FreeBlockStack
 {
 public:
     FreeBlockStack();
-    uint32_t getBlock();
-    void revokeBlock(uint32_t block);
-    uint32_t *getBlocks();
+    blockno_t getBlock();
+    void revokeBlock(blockno_t block);
+    blockno_t *getBlocks();
     uint32_t getMaxSize();
     bool empty();
     bool full();
@@ -21,7 +21,7 @@ public:
 private:
     const uint32_t maxSize;                               // 栈大小
     uint32_t stackTop;                                    // 栈顶指针
-    uint32_t blocks[BLOCK_SIZE / (8 * sizeof(uint32_t))]; // 栈本体，占一个块大小
+    blockno_t blocks[BLOCK_SIZE / (8 * sizeof(blockno_t))]; // 栈本体，占一个块大小
 };
 
 #endif // FILESYSTEM_FREEBLOCKSTACK_H
@@ -4,15 +4,32 @@
 #define FILESYSTEM_INODE_H
 
 #include <cstdint>
+#include "../Constraints.h"
 
+/*
+ * @brief 文件的块映射方式，记录在i节点的layout字段中
+ */
+enum class FileLayout : uint8_t
+{
+    INDEX = 0,   // 索引表链表（旧格式），bno为第一个索引表所在块；目录的bno直接是目录项所在块
+    EXTENT = 1,  // 区段树，树根存放在i节点的data中，叶子记录(逻辑块,物理块,长度)
+    BLOCKMAP = 2, // 直接块加一、二、三级间接块，任意逻辑块最多经过三次间接查找
+    INLINE = 3    // 文件内容直接存放在i节点的data中，不占用数据块；超过INLINE_DATA_SIZE字节时转换为其他布局
+};
+
+/*
+ * @brief i节点，固定INODE_SIZE字节，末尾的data按layout存放块映射的根
+ */
 class INode
 {
 public:
-    uint8_t uid;       // 所属用户ID，默认文件创建者就是文件所有者，拥有该文件所有权限
-    uint8_t flag;      // 高2位00表示文件，01表示目录，10表示软链接，中间3位以rwx格式表示信赖者的访问权限，低3位表示其余用户访问权限
-    uint32_t bno;      // 该文件所在磁盘块号
-    uint32_t capacity; // 文件大小
-    // 还可以添加创建修改时间等信息
+    uint8_t uid;                  // 所属用户ID，默认文件创建者就是文件所有者，拥有该文件所有权限
+    uint8_t flag;                 // 高2位00表示文件，01表示目录，10表示软链接，中间3位以rwx格式表示信赖者的访问权限，低3位表示其余用户访问权限
+    FileLayout layout;            // 块映射方式
+    uint8_t links;                // 引用该i节点的目录项数，i节点表中为0的记录是空闲的
+    blockno_t bno;                // INDEX布局下该文件所在磁盘块号；其余布局的目录为散列索引文件的i节点号，0表示没有索引
+    uint64_t capacity;            // 文件大小
+    uint8_t data[INODE_DATA_SIZE]; // 块映射的根，按layout解释
 };
 
 #endif // FILESYSTEM_INODE_H